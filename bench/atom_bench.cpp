@@ -0,0 +1,151 @@
+// Reader threads keep loading the current version of a cow::vector and
+// reading from it, while a few writer threads publish edited versions.
+// Compares cow::atom, read through load() or borrowed in a read_guard,
+// with a mutex around a plain cow::ptr root.
+//
+//   atom_bench [milliseconds] [readers] [writers]
+
+#include "cow/atom.h"
+#include "cow/vector.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using root_type = cow::vector<long>;
+
+constexpr long entries = 100'000;
+
+struct mutex_root {
+  long read(size_t at) {
+    cow::ptr<root_type> snapshot;
+    {
+      std::lock_guard lock(mutex);
+      snapshot = root;
+    }
+    return (*snapshot)[at];
+  }
+
+  template <typename Update>
+  void swap(Update&& update) {
+    std::lock_guard lock(mutex);
+    root = update(root);
+  }
+
+  std::mutex mutex;
+  cow::ptr<root_type> root;
+};
+
+struct atom_root {
+  long read(size_t at) {
+    const cow::ptr<root_type> snapshot = cell.load();
+    return (*snapshot)[at];
+  }
+
+  template <typename Update>
+  void swap(Update&& update) {
+    cell.swap(update);
+  }
+
+  cow::atom<root_type> cell;
+};
+
+struct borrowed_root : atom_root {
+  long read(size_t at) {
+    cow::read_guard guard;
+    return (*cell.borrow(guard))[at];
+  }
+};
+
+struct result {
+  double readsPerSecond;
+  double writesPerSecond;
+};
+
+template <typename Root>
+result run(Root& cell, int milliseconds, int readers, int writers) {
+  std::atomic<bool> done{false};
+  std::atomic<long> reads{0};
+  std::atomic<long> writes{0};
+
+  std::vector<std::thread> threads;
+  for (int r = 0; r < readers; ++r) {
+    threads.emplace_back([&, r] {
+      long count = 0;
+      long sum = 0;
+      while (!done.load(std::memory_order_relaxed)) {
+        sum += cell.read(size_t((count * 7919 + r) % entries));
+        ++count;
+      }
+      if (sum < 0) {
+        std::abort();
+      }
+      reads.fetch_add(count, std::memory_order_relaxed);
+    });
+  }
+  for (int w = 0; w < writers; ++w) {
+    threads.emplace_back([&, w] {
+      long count = 0;
+      while (!done.load(std::memory_order_relaxed)) {
+        const size_t at = size_t((count * 104729 + w) % entries);
+        cell.swap([&](cow::ptr<root_type> root) {
+          root.write()->set(at, (*root)[at] + 1);
+          return root;
+        });
+        ++count;
+      }
+      writes.fetch_add(count, std::memory_order_relaxed);
+    });
+  }
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(milliseconds));
+  done.store(true);
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  const double seconds = milliseconds / 1000.0;
+  return {reads.load() / seconds, writes.load() / seconds};
+}
+
+cow::ptr<root_type> initial() {
+  auto root = cow::make<root_type>();
+  for (long i = 0; i < entries; ++i) {
+    root.write()->push_back(i);
+  }
+  return root;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const int milliseconds = argc > 1 ? std::atoi(argv[1]) : 1000;
+  const int readers = argc > 2 ? std::atoi(argv[2]) : 6;
+  const int writers = argc > 3 ? std::atoi(argv[3]) : 1;
+
+  mutex_root locked;
+  locked.root = initial();
+  const result withMutex = run(locked, milliseconds, readers, writers);
+
+  atom_root loaded;
+  loaded.cell.store(initial());
+  const result withLoad = run(loaded, milliseconds, readers, writers);
+
+  borrowed_root borrowed;
+  borrowed.cell.store(initial());
+  const result withBorrow = run(borrowed, milliseconds, readers, writers);
+
+  std::printf("%d readers, %d writers, %ld entries\n", readers, writers, entries);
+  std::printf("  mutex:       %10.0f reads/s %10.0f writes/s\n", withMutex.readsPerSecond,
+              withMutex.writesPerSecond);
+  std::printf("  atom load:   %10.0f reads/s %10.0f writes/s\n", withLoad.readsPerSecond,
+              withLoad.writesPerSecond);
+  std::printf("  atom borrow: %10.0f reads/s %10.0f writes/s\n", withBorrow.readsPerSecond,
+              withBorrow.writesPerSecond);
+  return 0;
+}
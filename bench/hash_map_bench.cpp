@@ -0,0 +1,98 @@
+// A map that readers hold snapshots of while a writer changes it. Compares
+// cow::hash_map with the copy-the-whole-map approach, a std::unordered_map
+// inside a cow::ptr, for lookups, inserts and erases (each made while a
+// snapshot is held) and a full iteration.
+//
+//   hash_map_bench [entries] [iterations]
+
+#include "cow/hash_map.h"
+#include "cow/ptr.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+template <typename Func>
+double time_per_iteration(long iterations, Func&& func) {
+  const auto start = std::chrono::steady_clock::now();
+  for (long i = 0; i < iterations; ++i) {
+    func(i);
+  }
+  const auto stop = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(stop - start).count() / iterations;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const int entries = argc > 1 ? std::atoi(argv[1]) : 10'000;
+  const long iterations = argc > 2 ? std::atol(argv[2]) : 2'000;
+
+  std::mt19937 random(42);
+  std::vector<int> keys(entries);
+  for (int& key : keys) {
+    key = int(random());
+  }
+
+  cow::hash_map<int, long> champ;
+  auto whole = cow::make<std::unordered_map<int, long>>();
+  for (int i = 0; i < entries; ++i) {
+    champ.insert(keys[i], i);
+    whole--->emplace(keys[i], i);
+  }
+
+  long sink = 0;
+  const long lookups = iterations * 100;
+  const double findChamp = time_per_iteration(lookups, [&](long i) {
+    sink += *champ.find(keys[i % entries]);
+  });
+  const double findWhole = time_per_iteration(lookups, [&](long i) {
+    sink += whole->find(keys[i % entries])->second;
+  });
+
+  // Each change is made while a reader holds the previous version.
+  const double insertChamp = time_per_iteration(iterations, [&](long i) {
+    auto snapshot = champ;
+    champ.insert_or_assign(keys[i % entries], i);
+  });
+  const double insertWhole = time_per_iteration(iterations, [&](long i) {
+    auto snapshot = whole;
+    whole--->insert_or_assign(keys[i % entries], i);
+  });
+
+  const double eraseChamp = time_per_iteration(iterations, [&](long i) {
+    auto snapshot = champ;
+    champ.erase(keys[i % entries]);
+    champ.insert(keys[i % entries], i);
+  });
+  const double eraseWhole = time_per_iteration(iterations, [&](long i) {
+    auto snapshot = whole;
+    auto* map = whole.write();
+    map->erase(keys[i % entries]);
+    map->emplace(keys[i % entries], i);
+  });
+
+  const long scans = iterations / 10 + 1;
+  const double iterateChamp = time_per_iteration(scans, [&](long) {
+    for (const auto& entry : champ) {
+      sink += entry.second;
+    }
+  });
+  const double iterateWhole = time_per_iteration(scans, [&](long) {
+    for (const auto& entry : *whole) {
+      sink += entry.second;
+    }
+  });
+
+  std::printf("%d entries                 hash_map      copied unordered_map\n", entries);
+  std::printf("  find                   %10.1f ns  %10.1f ns\n", findChamp, findWhole);
+  std::printf("  insert_or_assign       %10.1f ns  %10.1f ns\n", insertChamp, insertWhole);
+  std::printf("  erase and re-insert    %10.1f ns  %10.1f ns\n", eraseChamp, eraseWhole);
+  std::printf("  iterate all            %10.1f ns  %10.1f ns\n", iterateChamp, iterateWhole);
+  return sink == 42 ? 1 : 0;
+}
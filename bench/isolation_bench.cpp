@@ -0,0 +1,89 @@
+// Reader threads read a shared object through a raw pointer while copier
+// threads keep copying and dropping ptrs to it, writing its refcount.
+// Compares an ordinary block, where the refcount shares a cache line with
+// the start of the object, with one whose type sets cow::isolate_refcount.
+//
+//   isolation_bench [milliseconds] [readers] [copiers]
+
+#include "cow/ptr.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct plain_node {
+  long values[6];
+};
+
+struct isolated_node {
+  long values[6];
+};
+
+}  // namespace
+
+template <>
+inline constexpr bool cow::isolate_refcount<isolated_node> = true;
+
+namespace {
+
+template <typename Node>
+double reads_per_second(int milliseconds, int readers, int copiers) {
+  const cow::ptr<Node> shared = cow::make<Node>(Node{{1, 2, 3, 4, 5, 6}});
+  std::atomic<bool> done{false};
+  std::atomic<long> reads{0};
+
+  std::vector<std::thread> threads;
+  for (int c = 0; c < copiers; ++c) {
+    threads.emplace_back([&] {
+      while (!done.load(std::memory_order_relaxed)) {
+        cow::ptr<Node> copy = shared;
+      }
+    });
+  }
+  for (int r = 0; r < readers; ++r) {
+    threads.emplace_back([&] {
+      const Node* node = shared.get();
+      long count = 0;
+      long sum = 0;
+      while (!done.load(std::memory_order_relaxed)) {
+        for (int i = 0; i < 6; ++i) {
+          sum += static_cast<const volatile long&>(node->values[i]);
+        }
+        ++count;
+      }
+      if (sum != count * 21) {
+        std::abort();
+      }
+      reads.fetch_add(count, std::memory_order_relaxed);
+    });
+  }
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(milliseconds));
+  done.store(true);
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  return reads.load() / (milliseconds / 1000.0);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const int milliseconds = argc > 1 ? std::atoi(argv[1]) : 1000;
+  const int readers = argc > 2 ? std::atoi(argv[2]) : 3;
+  const int copiers = argc > 3 ? std::atoi(argv[3]) : 1;
+
+  const double plain = reads_per_second<plain_node>(milliseconds, readers, copiers);
+  const double isolated = reads_per_second<isolated_node>(milliseconds, readers, copiers);
+
+  std::printf("%d readers, %d copiers, %u hardware threads\n", readers, copiers,
+              std::thread::hardware_concurrency());
+  std::printf("  shared line:   %12.0f reads/s\n", plain);
+  std::printf("  isolated line: %12.0f reads/s\n", isolated);
+  return 0;
+}
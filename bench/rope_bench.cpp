@@ -0,0 +1,146 @@
+// Small edits to a large blob, each made while a reader holds the previous
+// version. Compares cow::rope with a std::string inside a cow::ptr, which
+// copies the whole blob on every edit: time per edit, and the memory taken
+// by the last few versions kept alive.
+//
+//   rope_bench [blob bytes] [edits] [versions kept]
+
+#include "cow/pool.h"
+#include "cow/ptr.h"
+#include "cow/rope.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Live bytes from the global operator new. Pool slabs are counted
+// separately, from block_pool::reserved_bytes().
+std::atomic<long long> g_liveBytes{0};
+constexpr size_t header_size = alignof(std::max_align_t);
+
+long long heap_bytes() {
+  return g_liveBytes.load() + static_cast<long long>(cow::default_pool().reserved_bytes());
+}
+
+template <typename Func>
+double time_per_iteration(long iterations, Func&& func) {
+  const auto start = std::chrono::steady_clock::now();
+  for (long i = 0; i < iterations; ++i) {
+    func(i);
+  }
+  const auto stop = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(stop - start).count() / iterations;
+}
+
+}  // namespace
+
+void* operator new(size_t size) {
+  void* block = std::malloc(size + header_size);
+  if (!block) {
+    throw std::bad_alloc();
+  }
+  *static_cast<size_t*>(block) = size;
+  g_liveBytes += (long long)size;
+  return static_cast<char*>(block) + header_size;
+}
+
+void operator delete(void* object) noexcept {
+  if (object) {
+    void* block = static_cast<char*>(object) - header_size;
+    g_liveBytes -= (long long)*static_cast<size_t*>(block);
+    std::free(block);
+  }
+}
+
+void operator delete(void* object, size_t) noexcept {
+  operator delete(object);
+}
+
+int main(int argc, char** argv) {
+  const size_t size = argc > 1 ? std::atol(argv[1]) : 4 << 20;
+  const long edits = argc > 2 ? std::atol(argv[2]) : 2'000;
+  const size_t kept = argc > 3 ? std::atol(argv[3]) : 100;
+
+  std::string payload(size, ' ');
+  for (size_t i = 0; i < size; ++i) {
+    payload[i] = char('a' + i % 26);
+  }
+
+  std::mt19937 random(1);
+  std::vector<size_t> positions(edits);
+  for (size_t& at : positions) {
+    at = random() % (size - 1);
+  }
+
+  // Alternate a one-byte insert and a one-byte erase, so the size holds.
+  auto edit_blob = [&](cow::ptr<std::string>& blob, long i) {
+    if (i % 2 == 0) {
+      blob--->insert(positions[i], 1, 'x');
+    } else {
+      blob--->erase(positions[i], 1);
+    }
+  };
+  auto edit_rope = [&](cow::rope& text, long i) {
+    if (i % 2 == 0) {
+      text.insert(positions[i], "x");
+    } else {
+      text.erase(positions[i], 1);
+    }
+  };
+
+  long long blobMemory = 0;
+  double blobTime = 0;
+  {
+    auto blob = cow::make<std::string>(payload);
+    blobTime = time_per_iteration(edits, [&](long i) {
+      auto snapshot = blob;
+      edit_blob(blob, i);
+    });
+
+    const long long before = heap_bytes();
+    std::deque<cow::ptr<std::string>> versions;
+    for (long i = 0; i < edits; ++i) {
+      versions.push_back(blob);
+      if (versions.size() > kept) {
+        versions.pop_front();
+      }
+      edit_blob(blob, i);
+    }
+    blobMemory = heap_bytes() - before;
+  }
+
+  long long ropeMemory = 0;
+  double ropeTime = 0;
+  {
+    cow::rope text(payload);
+    ropeTime = time_per_iteration(edits, [&](long i) {
+      auto snapshot = text;
+      edit_rope(text, i);
+    });
+
+    const long long before = heap_bytes();
+    std::deque<cow::rope> versions;
+    for (long i = 0; i < edits; ++i) {
+      versions.push_back(text);
+      if (versions.size() > kept) {
+        versions.pop_front();
+      }
+      edit_rope(text, i);
+    }
+    ropeMemory = heap_bytes() - before;
+  }
+
+  std::printf("%zu byte blob, %zu versions kept      rope        whole-blob CoW\n", size, kept);
+  std::printf("  one-byte edit              %10.1f ns  %12.1f ns\n", ropeTime, blobTime);
+  std::printf("  memory for kept versions   %10.1f KiB %12.1f KiB\n",
+              ropeMemory / 1024.0, blobMemory / 1024.0);
+  return 0;
+}
@@ -0,0 +1,69 @@
+// Replacing the payload of a shared node with a large member: write() clones
+// the whole node and then overwrites it, update() builds the new node from
+// the replacement directly. Also appends to a unique node, with write() and
+// with update_move().
+//
+//   update_bench [iterations] [payload size]
+
+#include "cow/ptr.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct document {
+  std::string title;
+  std::vector<int> body;
+};
+
+template <typename Func>
+double time_per_iteration(long iterations, Func&& func) {
+  const auto start = std::chrono::steady_clock::now();
+  for (long i = 0; i < iterations; ++i) {
+    func(i);
+  }
+  const auto stop = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(stop - start).count() / iterations;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const long iterations = argc > 1 ? std::atol(argv[1]) : 100'000;
+  const size_t size = argc > 2 ? std::atol(argv[2]) : 4096;
+  const std::vector<int> replacement(size, 1);
+
+  auto doc = cow::make<document>("title", std::vector<int>(size, 0));
+
+  const double replaceWrite = time_per_iteration(iterations, [&](long) {
+    auto snapshot = doc;
+    doc--->body = replacement;
+  });
+  const double replaceUpdate = time_per_iteration(iterations, [&](long) {
+    auto snapshot = doc;
+    doc.update([&](const document& old) { return document{old.title, replacement}; });
+  });
+
+  auto log = cow::make<document>("log", std::vector<int>(size, 0));
+  const double appendWrite = time_per_iteration(iterations, [&](long i) {
+    log--->body.push_back(int(i));
+  });
+  const double appendUpdate = time_per_iteration(iterations, [&](long i) {
+    log.update_move([i](auto&& old) {
+      document result(std::forward<decltype(old)>(old));
+      result.body.push_back(int(i));
+      return result;
+    });
+  });
+
+  std::printf("payload of %zu ints\n", size);
+  std::printf("  shared, replace body  write(): %8.1f ns  update():      %8.1f ns\n",
+              replaceWrite, replaceUpdate);
+  std::printf("  unique, append        write(): %8.1f ns  update_move(): %8.1f ns\n",
+              appendWrite, appendUpdate);
+  return 0;
+}
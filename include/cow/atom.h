@@ -0,0 +1,151 @@
+#pragma once
+
+#include "cow/ptr.h"
+#include "cow/ref.h"
+
+#include <atomic>
+
+namespace cow {
+
+namespace detail {
+// Each thread that reads an atom has a hazard record, naming the block it's
+// about to take a reference to, and the read epoch its read_guards started
+// in. Records are reused once their thread exits, and never freed.
+struct hazard_record {
+  std::atomic<const control_block*> hazard{nullptr};
+
+  // Zero outside a read_guard. Only the owning thread changes it.
+  std::atomic<size_t> epoch{0};
+  unsigned guards{0};
+
+  std::atomic<bool> active{false};
+  hazard_record* next{nullptr};
+};
+
+hazard_record* acquire_hazard_record();
+
+inline thread_local hazard_record* t_hazardRecord = nullptr;
+
+// Bumped each time a writer retires a root. A root retired in epoch E can
+// be borrowed by any read_guard that started in E or before.
+inline std::atomic<size_t> g_readEpoch{1};
+}  // namespace detail
+
+class read_guard;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// atom
+//
+// A root that threads can read and replace at the same time without a
+// lock. Copying a ptr isn't safe against another thread assigning to it,
+// so publishing new versions of a structure would otherwise need a mutex
+// around the root.
+//
+//   cow::atom<config> current(load_config());
+//
+//   // Readers, on any thread:
+//   cow::ptr<config> snapshot = current.load();
+//
+//   // Writers:
+//   current.swap([](cow::ptr<config> c) {
+//     c.write()->retries += 1;    // copies, since the atom still shares it
+//     return c;
+//   });
+//
+// The hard part is load(): the block it read from the atom can be replaced
+// and released before it gets to take its reference. Readers announce the
+// block they're about to take in a per-thread hazard slot, and then check
+// the atom still holds it. Writers check the slots before releasing the
+// root they replaced. If a reader has it announced, the release is put off
+// until that thread's next store or compare_exchange, or until it exits.
+// Neither side ever waits for the other.
+//
+// swap(update) retries update() on the latest root until its result can
+// be put in with compare_exchange, backing off between attempts. update
+// gets its own copy of the root, so write() path-copies it, and the root
+// it was given isn't changed when an attempt fails.
+//
+// Readers that only look can skip the reference entirely. Inside a
+// read_guard, borrow() returns a ref to the root with no refcount traffic
+// at all, and roots that writers replace meanwhile aren't released until
+// every guard that could have seen them has ended:
+//
+//   {
+//     cow::read_guard guard;
+//     cow::ref<config> c = current.borrow(guard);   // valid until guard ends
+//     use(c->timeout);
+//   }
+//
+// A guard held for a long time keeps every root retired during it alive,
+// so keep them short.
+//
+// The atom's blocks must not be local; publish them first.
+//
+
+template <typename T>
+class atom {
+ public:
+  atom() noexcept = default;
+  explicit atom(ptr<T> value) noexcept;
+  ~atom();
+
+  atom(const atom&) = delete;
+  atom& operator=(const atom&) = delete;
+
+  ptr<T> load() const;
+
+  // The root, without taking a reference. Valid until guard ends, and
+  // own() on it until then takes one.
+  ref<T> borrow(const read_guard& guard) const noexcept;
+
+  void store(ptr<T> value);
+
+  // Puts value in, and returns the root it replaced.
+  ptr<T> exchange(ptr<T> value);
+
+  // Puts desired in if the atom still holds expected's block. Otherwise
+  // loads what it does hold into expected.
+  bool compare_exchange(ptr<T>& expected, ptr<T> desired);
+
+  // Replaces the root with update(ptr<T>), retrying with the latest root
+  // until nobody else got in first. Returns the root it put in.
+  template <typename Update>
+  ptr<T> swap(Update&& update);
+
+ private:
+  void retire(T* old);
+
+  std::atomic<T*> root{nullptr};
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// read_guard
+//
+// Marks the thread as reading, so atom::borrow() can hand out the root
+// without a reference. Guards nest; the outermost one decides when the
+// borrowed objects may go.
+//
+
+class read_guard {
+ public:
+  read_guard();
+  ~read_guard();
+
+  read_guard(const read_guard&) = delete;
+  read_guard& operator=(const read_guard&) = delete;
+
+ private:
+  detail::hazard_record* record;
+};
+
+// Releases whatever roots this thread's writes retired that no reader can
+// still see. That happens anyway on the thread's next atom write and when
+// it exits; this is for writers that go quiet. Returns how many are still
+// waiting.
+size_t collect_roots() noexcept;
+
+}  // namespace cow
+
+#include "cow/detail/atom.h"
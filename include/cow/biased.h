@@ -0,0 +1,38 @@
+#pragma once
+
+#include "cow/ptr.h"
+
+#include <cstddef>
+
+namespace cow {
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Biased refcounting
+//
+// A block made with allocate_make(pool, block_flags::biased, ...) remembers
+// the thread that made it. That thread counts its own references in a plain
+// field in front of the block, with no atomic read-modify-writes, and every
+// other thread counts in the usual atomic word. Copying and dropping ptrs to
+// a root that one thread hammers while a few readers look on then costs the
+// owner about as much as an int increment.
+//
+// When the owner drops its last reference, the two counts are merged and the
+// block turns into an ordinary atomic block. If another thread's drop takes
+// the shared count below zero first, only the owner can tell whether the
+// block is dead, so the block is queued to the owner. The owner works through
+// its queue when it makes its next biased block, when it calls
+// collect_biased(), and when it exits. Blocks owned by an exited thread are
+// merged by whichever thread finds them.
+//
+// A thread that owns long-lived biased blocks but rarely makes new ones
+// should call collect_biased() now and then, or queued blocks wait until it
+// exits. Clones made by write() are biased to the thread that wrote. Inside
+// a cow::local_scope blocks are local instead.
+//
+
+// Processes the calling thread's queue. Returns the number of queued blocks
+// it merged.
+size_t collect_biased() noexcept;
+
+}  // namespace cow
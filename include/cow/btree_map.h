@@ -0,0 +1,203 @@
+#pragma once
+
+#include "cow/diff.h"
+#include "cow/path.h"
+
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <optional>
+#include <utility>
+
+namespace cow {
+
+namespace detail {
+// Keys per leaf and children per branch. With 4- or 8-byte keys a node's
+// key array is two to four cache lines, searched front to back.
+inline constexpr size_t btree_width = 32;
+inline constexpr size_t btree_min_fill = btree_width / 2;
+inline constexpr unsigned btree_max_height = 16;
+
+template <typename Key, typename Value>
+class btree_node;
+
+template <typename Key, typename Value>
+class btree_leaf;
+
+template <typename Key, typename Value>
+class btree_branch;
+}  // namespace detail
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// btree_map
+//
+// A persistent ordered map: copying one is O(1) and shares everything, and
+// changing a copy leaves the original alone.
+//
+//   cow::btree_map<int64_t, order> book = ...;
+//   auto snapshot = book;                      // readers scan this freely
+//   book.insert_or_assign(id, o);              // copies one leaf and the
+//   book.erase(from, to);                      // branches above it
+//
+// It's a B+tree of cow::ptr nodes. Leaves hold up to 32 sorted keys and
+// their values, branches up to 32 children, and every leaf is at the same
+// depth. A node's keys are one flat array: for arithmetic keys with the
+// default ordering, the search is a branch-free count of the keys below the
+// one sought, which compilers vectorize; other keys use a binary search.
+//
+// Iterators only read, so any number of threads can scan snapshots of one
+// map at once. A cursor is a cow::path from the root to a leaf: write() on
+// it copies just the shared nodes on that path and returns the value to
+// change. Any other change to the map invalidates its cursors.
+//
+// Keys and values must be copyable and movable. Nodes construct only the
+// entries they hold, so copying one copies just those. erase(from, to)
+// drops whole subtrees between the two ends and only rebalances along
+// them, so nodes next to a range erase may be left less than half full.
+//
+
+template <typename Key, typename Value, typename Compare = std::less<Key>>
+class btree_map {
+ public:
+  using key_type = Key;
+  using mapped_type = Value;
+  using size_type = size_t;
+  using key_compare = Compare;
+
+  class const_iterator;
+  using iterator = const_iterator;
+  class cursor;
+
+  btree_map() = default;
+  explicit btree_map(const Compare& compare);
+
+  key_compare key_comp() const;
+
+  size_t size() const noexcept;
+  bool empty() const noexcept;
+
+  // The value for key, or nullptr if it isn't there.
+  const Value* find(const Key& key) const;
+  bool contains(const Key& key) const;
+
+  const_iterator begin() const;
+  const_iterator end() const noexcept;
+
+  // The first entry whose key isn't less than key.
+  const_iterator lower_bound(const Key& key) const;
+
+  // As lower_bound(), but able to write the value it points at.
+  cursor seek(const Key& key);
+
+  // Adds key if it isn't already there. Returns whether it was added.
+  bool insert(Key key, Value value);
+
+  // Adds key, or replaces its value. Returns whether it was added.
+  bool insert_or_assign(Key key, Value value);
+
+  // Returns whether key was there.
+  bool erase(const Key& key);
+
+  // Erases every key in [from, to), and returns how many there were.
+  size_t erase(const Key& from, const Key& to);
+
+  void clear() noexcept;
+
+  // Reports how after differs from this map, in key order, through
+  // visitor.added(key, value), visitor.removed(key, value) and
+  // visitor.changed(key, before, after). See cow::diff().
+  template <typename Visitor>
+  void diff(const btree_map& after, Visitor&& visitor) const;
+
+ private:
+  using node = detail::btree_node<Key, Value>;
+  using leaf = detail::btree_leaf<Key, Value>;
+  using branch = detail::btree_branch<Key, Value>;
+
+  ptr<node> insert_into(ptr<node>& where, unsigned height, Key& key,
+                        Value& value, bool& added,
+                        std::optional<Key>& separator) const;
+  void erase_from(ptr<node>& where, unsigned height, const Key& key) const;
+  size_t erase_range(ptr<node>& where, unsigned height, const Key& from,
+                     const Key& to) const;
+  static void rebalance(branch* parent, size_t child, unsigned childHeight);
+  static void remove_child(branch* parent, size_t child);
+  static size_t count_below(const node* from, unsigned height);
+  static bool skip_shared(const_iterator& was, const_iterator& now) noexcept;
+  void shrink() noexcept;
+
+  [[no_unique_address]] Compare compare;
+  size_t count{0};
+  unsigned height{0};
+  ptr<node> root;
+};
+
+template <typename Key, typename Value, typename Compare>
+class btree_map<Key, Value, Compare>::const_iterator {
+ public:
+  using iterator_category = std::forward_iterator_tag;
+  using value_type = std::pair<Key, Value>;
+  using difference_type = std::ptrdiff_t;
+  using pointer = void;
+  using reference = std::pair<const Key&, const Value&>;
+
+  const_iterator() noexcept = default;
+
+  const Key& key() const noexcept;
+  const Value& value() const noexcept;
+  reference operator*() const noexcept;
+
+  const_iterator& operator++() noexcept;
+  const_iterator operator++(int) noexcept;
+
+  bool operator==(const const_iterator& other) const noexcept;
+  bool operator!=(const const_iterator& other) const noexcept;
+
+ private:
+  friend class btree_map;
+
+  void next_leaf() noexcept;
+  void skip(unsigned depth) noexcept;
+  const node* node_at(unsigned depth) const noexcept;
+
+  // The branch at each depth above the leaf, and the child taken from it.
+  const branch* branches[detail::btree_max_height]{};
+  size_t slots[detail::btree_max_height]{};
+  unsigned height{0};
+  const leaf* at{nullptr};
+  size_t index{0};
+};
+
+template <typename Key, typename Value, typename Compare>
+class btree_map<Key, Value, Compare>::cursor {
+ public:
+  cursor() noexcept = default;
+
+  explicit operator bool() const noexcept;
+
+  const Key& key() const noexcept;
+  const Value& value() const noexcept;
+
+  // The value, after copying the nodes from the root to its leaf that are
+  // shared.
+  Value* write() noexcept;
+
+  cursor& operator++() noexcept;
+
+ private:
+  friend class btree_map;
+
+  const leaf* current() const noexcept;
+  void next_leaf() noexcept;
+  void descend(size_t slot) noexcept;
+
+  path<node> where;
+  size_t slots[detail::btree_max_height]{};
+  unsigned height{0};
+  size_t index{0};
+};
+
+}  // namespace cow
+
+#include "cow/detail/btree_map.h"
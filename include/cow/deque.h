@@ -0,0 +1,154 @@
+#pragma once
+
+#include "cow/ptr.h"
+
+#include <cstddef>
+#include <initializer_list>
+#include <utility>
+
+namespace cow {
+
+namespace detail {
+// Elements are kept in leaves of up to deque_chunk_size.
+inline constexpr size_t deque_chunk_size = 32;
+
+template <typename T>
+struct deque_item;
+
+template <typename T>
+struct deque_branch;
+
+template <typename T>
+class deque_leaf;
+
+template <typename T>
+struct deque_spine;
+}  // namespace detail
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// deque
+//
+// A persistent double-ended queue: copying one is O(1) and shares
+// everything, and changing a copy leaves the original alone.
+//
+//   cow::deque<event> window = ...;
+//   window.push_back(latest);
+//   window.pop_front();
+//   auto [older, newer] = window.split(window.size() / 2);
+//   older.append(newer);   // and back again
+//
+// It's a 2-3 finger tree of cow::ptr nodes, over leaves of up to 32
+// elements. Each level of the spine keeps one to four items at either end,
+// and each level down holds 2-3 branches of the items above it. Pushes and
+// pops at either end are amortized O(1); they mostly change the outermost
+// leaf in place, or copy it if it's shared. split() and append() are
+// O(log n), and so is indexing, since every item caches its element count.
+//
+// All the nodes are ordinary refcounted blocks, so any version can be
+// handed to other threads.
+//
+
+template <typename T>
+class deque {
+ public:
+  using value_type = T;
+  using size_type = size_t;
+  using reference = const T&;
+  using const_reference = const T&;
+
+  deque() noexcept = default;
+  deque(std::initializer_list<T> values);
+
+  template <typename Range>
+  static deque from_range(Range&& values);
+
+  size_t size() const noexcept;
+  bool empty() const noexcept;
+
+  const T& operator[](size_t index) const noexcept;
+  const T& front() const noexcept;
+  const T& back() const noexcept;
+
+  // A writable reference to one element, after copying whatever is shared
+  // on the way down to it. Valid until this deque is next changed.
+  T& write(size_t index);
+
+  void push_back(T value);
+  template <typename... ArgTypes>
+  T& emplace_back(ArgTypes&&... args);
+  void push_front(T value);
+  template <typename... ArgTypes>
+  T& emplace_front(ArgTypes&&... args);
+  void pop_back();
+  void pop_front();
+  void clear() noexcept;
+
+  // Adds other's elements at the back, sharing its nodes. O(log n).
+  void append(const deque& other);
+
+  // The first at elements, and the rest. O(log n).
+  std::pair<deque, deque> split(size_t at) const;
+
+  // Calls func(const T* data, size_t count) for each run of contiguous
+  // elements, in order.
+  template <typename ChunkFunc>
+  void for_each_chunk(ChunkFunc&& func) const;
+
+ private:
+  using item = detail::deque_item<T>;
+  using branch = detail::deque_branch<T>;
+  using leaf = detail::deque_leaf<T>;
+  using spine = detail::deque_spine<T>;
+
+  // A run of items from one level, such as a digit or the items between
+  // two spines being joined.
+  struct item_run {
+    ptr<item> items[12];
+    size_t count{0};
+  };
+
+  struct split_parts {
+    ptr<spine> before;
+    ptr<item> at;
+    ptr<spine> after;
+  };
+
+  explicit deque(ptr<spine> from) noexcept;
+
+  template <typename Spine>
+  static auto& first_leaf(Spine& from) noexcept;
+  template <typename Spine>
+  static auto& last_leaf(Spine& from) noexcept;
+
+  static size_t size_of(const ptr<spine>& tree) noexcept;
+  static ptr<item> make_branch(const ptr<item>* children, size_t count);
+  static void push_front(ptr<spine>& tree, ptr<item> x);
+  static void push_back(ptr<spine>& tree, ptr<item> x);
+  static ptr<item> pop_front(ptr<spine>& tree);
+  static ptr<item> pop_back(ptr<spine>& tree);
+  static ptr<spine> from_items(const ptr<item>* items, size_t count);
+  static ptr<spine> make_deep(const ptr<item>* front, size_t frontCount,
+                              ptr<spine> middle, const ptr<item>* back,
+                              size_t backCount);
+  static ptr<spine> deep_left(const ptr<item>* front, size_t frontCount,
+                              ptr<spine> middle, const ptr<item>* back,
+                              size_t backCount);
+  static ptr<spine> deep_right(const ptr<item>* front, size_t frontCount,
+                               ptr<spine> middle, const ptr<item>* back,
+                               size_t backCount);
+  static ptr<spine> concat(ptr<spine> left, const item_run& middle,
+                           const ptr<spine>& right);
+  static split_parts split_tree(const ptr<spine>& tree, size_t index);
+
+  template <typename ChunkFunc>
+  static void visit(const spine* from, unsigned level, ChunkFunc& func);
+  template <typename ChunkFunc>
+  static void visit(const item* from, unsigned level, ChunkFunc& func);
+
+  ptr<spine> root;
+};
+
+}  // namespace cow
+
+#include "cow/detail/deque.h"
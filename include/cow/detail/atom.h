@@ -0,0 +1,137 @@
+#pragma once
+
+#include "cow/atom.h"
+
+#include <assert.h>
+#include <utility>
+
+namespace cow {
+
+namespace detail {
+using release_function = void (*)(control_block*) noexcept;
+
+// Drops a reference a writer took out of an atom, once no reader has the
+// block announced. Defined in atom.cpp.
+void retire_root(control_block* block, release_function release) noexcept;
+
+// Waits a little longer after each failed attempt.
+void atom_backoff(unsigned attempt) noexcept;
+
+template <typename T>
+void release_root(control_block* block) noexcept {
+  static_cast<control_block_with_object<T>*>(block)->decRef();
+}
+}  // namespace detail
+
+template <typename T>
+inline atom<T>::atom(ptr<T> value) noexcept : root(detail::ptr_access::release(value)) {
+  assert(!root.load(std::memory_order_relaxed) ||
+         !detail::ptr_access::control_of(root.load(std::memory_order_relaxed))->is_local());
+}
+
+template <typename T>
+inline atom<T>::~atom() {
+  // Objects borrowed from it can outlive the atom itself.
+  retire(root.load(std::memory_order_acquire));
+}
+
+template <typename T>
+inline ptr<T> atom<T>::load() const {
+  detail::hazard_record* record = detail::t_hazardRecord;
+  if (!record) {
+    record = detail::acquire_hazard_record();
+  }
+  T* object = root.load(std::memory_order_acquire);
+  for (;;) {
+    if (!object) {
+      return nullptr;
+    }
+    record->hazard.store(detail::ptr_access::control_of(object), std::memory_order_seq_cst);
+    T* const again = root.load(std::memory_order_seq_cst);
+    if (again == object) {
+      break;
+    }
+    object = again;
+  }
+  detail::ptr_access::control_of(object)->incRef();
+  record->hazard.store(nullptr, std::memory_order_release);
+  return detail::ptr_access::adopt(object);
+}
+
+template <typename T>
+inline ref<T> atom<T>::borrow(const read_guard&) const noexcept {
+  return detail::ptr_access::borrow(root.load(std::memory_order_seq_cst));
+}
+
+template <typename T>
+inline void atom<T>::store(ptr<T> value) {
+  assert(!value || !detail::ptr_access::control(value)->is_local());
+  retire(root.exchange(detail::ptr_access::release(value), std::memory_order_seq_cst));
+}
+
+template <typename T>
+inline ptr<T> atom<T>::exchange(ptr<T> value) {
+  assert(!value || !detail::ptr_access::control(value)->is_local());
+  T* const old = root.exchange(detail::ptr_access::release(value), std::memory_order_seq_cst);
+  if (!old) {
+    return nullptr;
+  }
+  // The atom's reference can't be handed over as it is: the caller could
+  // drop it while a reader is still about to take one of its own.
+  detail::ptr_access::control_of(old)->incRef();
+  retire(old);
+  return detail::ptr_access::adopt(old);
+}
+
+template <typename T>
+inline bool atom<T>::compare_exchange(ptr<T>& expected, ptr<T> desired) {
+  assert(!desired || !detail::ptr_access::control(desired)->is_local());
+  T* old = const_cast<T*>(expected.get());
+  if (root.compare_exchange_strong(old, const_cast<T*>(desired.get()), std::memory_order_seq_cst)) {
+    detail::ptr_access::release(desired);
+    retire(old);
+    return true;
+  }
+  expected = load();
+  return false;
+}
+
+template <typename T>
+template <typename Update>
+inline ptr<T> atom<T>::swap(Update&& update) {
+  ptr<T> current = load();
+  for (unsigned attempt = 0;; ++attempt) {
+    ptr<T> next = update(ptr<T>(current));
+    if (compare_exchange(current, next)) {
+      return next;
+    }
+    detail::atom_backoff(attempt);
+  }
+}
+
+template <typename T>
+inline void atom<T>::retire(T* old) {
+  if (old) {
+    detail::retire_root(detail::ptr_access::control_of(old), &detail::release_root<T>);
+  }
+}
+
+inline read_guard::read_guard() : record(detail::t_hazardRecord) {
+  if (!record) {
+    record = detail::acquire_hazard_record();
+  }
+  // Reading the epoch with acquire means a guard that starts after a root
+  // was retired sees the root that replaced it.
+  if (record->guards++ == 0) {
+    record->epoch.store(detail::g_readEpoch.load(std::memory_order_acquire),
+                        std::memory_order_seq_cst);
+  }
+}
+
+inline read_guard::~read_guard() {
+  if (--record->guards == 0) {
+    record->epoch.store(0, std::memory_order_release);
+  }
+}
+
+}  // namespace cow
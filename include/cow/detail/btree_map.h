@@ -0,0 +1,912 @@
+#pragma once
+
+#include "cow/btree_map.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <optional>
+#include <type_traits>
+
+namespace cow {
+
+namespace detail {
+
+// A leaf's keys are its entries'; a branch's keys()[i] is the smallest key
+// under children()[i + 1], so it has one fewer key than children. Nodes
+// keep keys, values and children in raw storage and construct only the
+// ones in use, which each kind of node counts from size, so a copy copies
+// just those.
+template <typename Key, typename Value>
+class btree_node {
+ public:
+  virtual ~btree_node() = default;
+
+  btree_node& operator=(const btree_node&) = delete;
+
+  const Key* keys() const noexcept {
+    return std::launder(reinterpret_cast<const Key*>(keyStorage));
+  }
+
+  Key* keys() noexcept {
+    return std::launder(reinterpret_cast<Key*>(keyStorage));
+  }
+
+  size_t size{0};
+
+ protected:
+  btree_node() noexcept = default;
+
+  // The derived node copies the keys, and sets size once it has.
+  btree_node(const btree_node&) noexcept {}
+
+ private:
+  alignas(Key) std::byte keyStorage[sizeof(Key) * btree_width];
+};
+
+template <typename Key, typename Value>
+class btree_leaf final : public btree_node<Key, Value> {
+ public:
+  btree_leaf() noexcept = default;
+
+  btree_leaf(const btree_leaf& other) : btree_node<Key, Value>(other) {
+    std::uninitialized_copy_n(other.keys(), other.size, this->keys());
+    try {
+      std::uninitialized_copy_n(other.values(), other.size, values());
+    } catch (...) {
+      std::destroy_n(this->keys(), other.size);
+      throw;
+    }
+    this->size = other.size;
+  }
+
+  ~btree_leaf() {
+    std::destroy_n(this->keys(), this->size);
+    std::destroy_n(values(), this->size);
+  }
+
+  const Value* values() const noexcept {
+    return std::launder(reinterpret_cast<const Value*>(valueStorage));
+  }
+
+  Value* values() noexcept {
+    return std::launder(reinterpret_cast<Value*>(valueStorage));
+  }
+
+ private:
+  alignas(Value) std::byte valueStorage[sizeof(Value) * btree_width];
+};
+
+template <typename Key, typename Value>
+class btree_branch final : public btree_node<Key, Value> {
+ public:
+  using child_type = ptr<btree_node<Key, Value>>;
+
+  btree_branch() noexcept = default;
+
+  btree_branch(const btree_branch& other) : btree_node<Key, Value>(other) {
+    std::uninitialized_copy_n(other.keys(), other.key_count(), this->keys());
+    std::uninitialized_copy_n(other.children(), other.size, children());
+    this->size = other.size;
+  }
+
+  ~btree_branch() {
+    std::destroy_n(this->keys(), key_count());
+    std::destroy_n(children(), this->size);
+  }
+
+  size_t key_count() const noexcept {
+    return this->size > 0 ? this->size - 1 : 0;
+  }
+
+  const child_type* children() const noexcept {
+    return std::launder(reinterpret_cast<const child_type*>(childStorage));
+  }
+
+  child_type* children() noexcept {
+    return std::launder(reinterpret_cast<child_type*>(childStorage));
+  }
+
+ private:
+  alignas(child_type) std::byte childStorage[sizeof(child_type) * btree_width];
+};
+
+// Moves the moved items at from into items[at, at + moved), moving the
+// count items from at up to make room. The slots past count are raw, so
+// they're constructed, and the rest assigned, working down from the top.
+template <typename T>
+inline void btree_insert(T* items, size_t count, size_t at, T* from,
+                         size_t moved) {
+  for (size_t i = count + moved; i-- > at;) {
+    T& source = i >= at + moved ? items[i - moved] : from[i - at];
+    if (i >= count) {
+      ::new (static_cast<void*>(items + i)) T(std::move(source));
+    } else {
+      items[i] = std::move(source);
+    }
+  }
+}
+
+// Removes items[first, last) from the count items, moving the rest down
+// and destroying the slots that leaves at the end.
+template <typename T>
+inline void btree_erase(T* items, size_t count, size_t first,
+                        size_t last) noexcept {
+  std::move(items + last, items + count, items + first);
+  std::destroy(items + count - (last - first), items + count);
+}
+
+template <typename T>
+inline void btree_append(T* items, size_t count, T* from, size_t moved) {
+  btree_insert(items, count, count, from, moved);
+}
+
+// Whether keys can be compared with a plain <, which leaves the count of
+// smaller keys as a loop the compiler can vectorize.
+template <typename Key, typename Compare>
+inline constexpr bool btree_linear_search =
+    std::is_arithmetic_v<Key> && (std::is_same_v<Compare, std::less<Key>> ||
+                                  std::is_same_v<Compare, std::less<>>);
+
+// How many of keys[0, count) are less than key.
+template <typename Key, typename Compare>
+inline size_t btree_count_less(const Key* keys, size_t count, const Key& key,
+                               const Compare& compare) {
+  if constexpr (btree_linear_search<Key, Compare>) {
+    size_t result = 0;
+    for (size_t i = 0; i < count; ++i) {
+      result += size_t(keys[i] < key);
+    }
+    return result;
+  } else {
+    return size_t(std::lower_bound(keys, keys + count, key, compare) - keys);
+  }
+}
+
+// How many of keys[0, count) are not greater than key.
+template <typename Key, typename Compare>
+inline size_t btree_count_not_greater(const Key* keys, size_t count,
+                                      const Key& key, const Compare& compare) {
+  if constexpr (btree_linear_search<Key, Compare>) {
+    size_t result = 0;
+    for (size_t i = 0; i < count; ++i) {
+      result += size_t(!(key < keys[i]));
+    }
+    return result;
+  } else {
+    return size_t(std::upper_bound(keys, keys + count, key, compare) - keys);
+  }
+}
+
+}  // namespace detail
+
+template <typename Key, typename Value, typename Compare>
+inline btree_map<Key, Value, Compare>::btree_map(const Compare& compare)
+    : compare(compare) {}
+
+template <typename Key, typename Value, typename Compare>
+inline Compare btree_map<Key, Value, Compare>::key_comp() const {
+  return compare;
+}
+
+template <typename Key, typename Value, typename Compare>
+inline size_t btree_map<Key, Value, Compare>::size() const noexcept {
+  return count;
+}
+
+template <typename Key, typename Value, typename Compare>
+inline bool btree_map<Key, Value, Compare>::empty() const noexcept {
+  return count == 0;
+}
+
+template <typename Key, typename Value, typename Compare>
+inline const Value* btree_map<Key, Value, Compare>::find(const Key& key) const {
+  const node* at = root.get();
+  if (!at) {
+    return nullptr;
+  }
+  for (unsigned level = height; level > 0; --level) {
+    const auto* children = static_cast<const branch*>(at);
+    at = children
+             ->children()[detail::btree_count_not_greater(
+                 at->keys(), at->size - 1, key, compare)]
+             .get();
+  }
+  const auto* entries = static_cast<const leaf*>(at);
+  const size_t index =
+      detail::btree_count_less(entries->keys(), entries->size, key, compare);
+  if (index < entries->size && !compare(key, entries->keys()[index])) {
+    return &entries->values()[index];
+  }
+  return nullptr;
+}
+
+template <typename Key, typename Value, typename Compare>
+inline bool btree_map<Key, Value, Compare>::contains(const Key& key) const {
+  return find(key) != nullptr;
+}
+
+template <typename Key, typename Value, typename Compare>
+inline auto btree_map<Key, Value, Compare>::begin() const -> const_iterator {
+  const_iterator result;
+  const node* at = root.get();
+  if (!at) {
+    return result;
+  }
+  result.height = height;
+  for (unsigned depth = 0; depth < height; ++depth) {
+    result.branches[depth] = static_cast<const branch*>(at);
+    result.slots[depth] = 0;
+    at = result.branches[depth]->children()[0].get();
+  }
+  result.at = static_cast<const leaf*>(at);
+  if (result.at->size == 0) {
+    result.next_leaf();
+  }
+  return result;
+}
+
+template <typename Key, typename Value, typename Compare>
+inline auto btree_map<Key, Value, Compare>::end() const noexcept
+    -> const_iterator {
+  return const_iterator();
+}
+
+template <typename Key, typename Value, typename Compare>
+inline auto btree_map<Key, Value, Compare>::lower_bound(const Key& key) const
+    -> const_iterator {
+  const_iterator result;
+  const node* at = root.get();
+  if (!at) {
+    return result;
+  }
+  result.height = height;
+  for (unsigned depth = 0; depth < height; ++depth) {
+    result.branches[depth] = static_cast<const branch*>(at);
+    result.slots[depth] =
+        detail::btree_count_not_greater(at->keys(), at->size - 1, key, compare);
+    at = result.branches[depth]->children()[result.slots[depth]].get();
+  }
+  result.at = static_cast<const leaf*>(at);
+  result.index = detail::btree_count_less(at->keys(), at->size, key, compare);
+  if (result.index == result.at->size) {
+    result.next_leaf();
+  }
+  return result;
+}
+
+template <typename Key, typename Value, typename Compare>
+inline auto btree_map<Key, Value, Compare>::seek(const Key& key) -> cursor {
+  cursor result;
+  if (!root) {
+    return result;
+  }
+  result.where.template reset<root_spot<node>>(&root);
+  result.height = height;
+  for (unsigned depth = 0; depth < height; ++depth) {
+    const auto* children = static_cast<const branch*>(result.where.get());
+    result.slots[depth] = detail::btree_count_not_greater(
+        children->keys(), children->size - 1, key, compare);
+    result.descend(result.slots[depth]);
+  }
+  const leaf* at = result.current();
+  result.index = detail::btree_count_less(at->keys(), at->size, key, compare);
+  if (result.index == at->size) {
+    result.next_leaf();
+  }
+  return result;
+}
+
+template <typename Key, typename Value, typename Compare>
+inline bool btree_map<Key, Value, Compare>::insert(Key key, Value value) {
+  // Look first, so an existing key doesn't copy anything.
+  if (contains(key)) {
+    return false;
+  }
+  return insert_or_assign(std::move(key), std::move(value));
+}
+
+template <typename Key, typename Value, typename Compare>
+inline bool btree_map<Key, Value, Compare>::insert_or_assign(Key key,
+                                                             Value value) {
+  if (!root) {
+    root = make<leaf>();
+  }
+  bool added = false;
+  std::optional<Key> separator;
+  ptr<node> right =
+      insert_into(root, height, key, value, added, separator);
+  if (right) {
+    assert(height + 1 < detail::btree_max_height);
+    ptr<branch> grown = make<branch>();
+    branch* top = grown.write();
+    ptr<node> halves[2] = {std::move(root), std::move(right)};
+    detail::btree_insert(top->keys(), 0, 0, &*separator, 1);
+    detail::btree_insert(top->children(), 0, 0, halves, 2);
+    top->size = 2;
+    root = std::move(grown);
+    ++height;
+  }
+  count += added;
+  return added;
+}
+
+template <typename Key, typename Value, typename Compare>
+inline bool btree_map<Key, Value, Compare>::erase(const Key& key) {
+  // Look first, so a missing key doesn't copy anything.
+  if (!contains(key)) {
+    return false;
+  }
+  erase_from(root, height, key);
+  --count;
+  shrink();
+  return true;
+}
+
+template <typename Key, typename Value, typename Compare>
+inline size_t btree_map<Key, Value, Compare>::erase(const Key& from,
+                                                    const Key& to) {
+  if (!compare(from, to)) {
+    return 0;
+  }
+  const_iterator first = lower_bound(from);
+  if (first == end() || !compare(first.key(), to)) {
+    return 0;
+  }
+  const size_t removed = erase_range(root, height, from, to);
+  count -= removed;
+  shrink();
+  return removed;
+}
+
+template <typename Key, typename Value, typename Compare>
+inline void btree_map<Key, Value, Compare>::clear() noexcept {
+  count = 0;
+  height = 0;
+  root = nullptr;
+}
+
+// Walks both maps in key order. Whenever both iterators are at the start of
+// the same node, that whole subtree is shared and both skip past it, so the
+// walk only reads the nodes that were copied, and their neighbours up to
+// where the two trees line up again.
+template <typename Key, typename Value, typename Compare>
+template <typename Visitor>
+inline void btree_map<Key, Value, Compare>::diff(const btree_map& after,
+                                                 Visitor&& visitor) const {
+  const_iterator was = begin();
+  const_iterator now = after.begin();
+  const const_iterator end;
+  while (was != end && now != end) {
+    if (was.index == 0 && now.index == 0 && skip_shared(was, now)) {
+      continue;
+    }
+    if (compare(was.key(), now.key())) {
+      visitor.removed(was.key(), was.value());
+      ++was;
+    } else if (compare(now.key(), was.key())) {
+      visitor.added(now.key(), now.value());
+      ++now;
+    } else {
+      if (!detail::diff_same(was.value(), now.value())) {
+        visitor.changed(was.key(), was.value(), now.value());
+      }
+      ++was;
+      ++now;
+    }
+  }
+  for (; was != end; ++was) {
+    visitor.removed(was.key(), was.value());
+  }
+  for (; now != end; ++now) {
+    visitor.added(now.key(), now.value());
+  }
+}
+
+// Adds or assigns key below where, copying the shared nodes on the way
+// down. If where had to split, returns the new right half and sets
+// separator to its smallest key.
+template <typename Key, typename Value, typename Compare>
+inline auto btree_map<Key, Value, Compare>::insert_into(
+    ptr<node>& where, unsigned height, Key& key, Value& value, bool& added,
+    std::optional<Key>& separator) const -> ptr<node> {
+  constexpr size_t half = detail::btree_width / 2;
+
+  if (height == 0) {
+    leaf* entries = where.template write<leaf>();
+    size_t index =
+        detail::btree_count_less(entries->keys(), entries->size, key, compare);
+    if (index < entries->size && !compare(key, entries->keys()[index])) {
+      entries->values()[index] = std::move(value);
+      return nullptr;
+    }
+    added = true;
+
+    ptr<leaf> right;
+    leaf* target = entries;
+    if (entries->size == detail::btree_width) {
+      right = make<leaf>();
+      leaf* upper = right.write();
+      const size_t moved = detail::btree_width - half;
+      detail::btree_append(upper->keys(), 0, entries->keys() + half, moved);
+      detail::btree_append(upper->values(), 0, entries->values() + half, moved);
+      upper->size = moved;
+      detail::btree_erase(entries->keys(), entries->size, half, entries->size);
+      detail::btree_erase(entries->values(), entries->size, half,
+                          entries->size);
+      entries->size = half;
+      if (index > half) {
+        target = upper;
+        index -= half;
+      }
+    }
+    detail::btree_insert(target->keys(), target->size, index, &key, 1);
+    detail::btree_insert(target->values(), target->size, index, &value, 1);
+    ++target->size;
+    if (right) {
+      separator.emplace(right->keys()[0]);
+    }
+    return right;
+  }
+
+  branch* children = where.template write<branch>();
+  const size_t child = detail::btree_count_not_greater(
+      children->keys(), children->size - 1, key, compare);
+  std::optional<Key> childSeparator;
+  ptr<node> childRight = insert_into(children->children()[child], height - 1,
+                                     key, value, added, childSeparator);
+  if (!childRight) {
+    return nullptr;
+  }
+
+  // childRight goes in after child, with childSeparator before it.
+  ptr<branch> right;
+  branch* target = children;
+  size_t at = child;
+  if (children->size == detail::btree_width) {
+    right = make<branch>();
+    branch* upper = right.write();
+    const size_t moved = detail::btree_width - half;
+    const size_t keyCount = children->key_count();
+    separator.emplace(std::move(children->keys()[half - 1]));
+    detail::btree_append(upper->keys(), 0, children->keys() + half, moved - 1);
+    detail::btree_append(upper->children(), 0, children->children() + half,
+                         moved);
+    upper->size = moved;
+    detail::btree_erase(children->keys(), keyCount, half - 1, keyCount);
+    detail::btree_erase(children->children(), children->size, half,
+                        children->size);
+    children->size = half;
+    if (child >= half) {
+      target = upper;
+      at -= half;
+    }
+  }
+  detail::btree_insert(target->keys(), target->key_count(), at,
+                       &*childSeparator, 1);
+  detail::btree_insert(target->children(), target->size, at + 1, &childRight,
+                       1);
+  ++target->size;
+  return right;
+}
+
+// Removes key, which must be there, from below where.
+template <typename Key, typename Value, typename Compare>
+inline void btree_map<Key, Value, Compare>::erase_from(ptr<node>& where,
+                                                       unsigned height,
+                                                       const Key& key) const {
+  if (height == 0) {
+    leaf* entries = where.template write<leaf>();
+    const size_t index =
+        detail::btree_count_less(entries->keys(), entries->size, key, compare);
+    assert(index < entries->size);
+    detail::btree_erase(entries->keys(), entries->size, index, index + 1);
+    detail::btree_erase(entries->values(), entries->size, index, index + 1);
+    --entries->size;
+    return;
+  }
+
+  branch* children = where.template write<branch>();
+  const size_t child = detail::btree_count_not_greater(
+      children->keys(), children->size - 1, key, compare);
+  erase_from(children->children()[child], height - 1, key);
+  rebalance(children, child, height - 1);
+}
+
+// Removes [from, to) from below where, and returns how many entries that
+// was. Children entirely inside the range are dropped without being
+// visited beyond counting them.
+template <typename Key, typename Value, typename Compare>
+inline size_t btree_map<Key, Value, Compare>::erase_range(ptr<node>& where,
+                                                          unsigned height,
+                                                          const Key& from,
+                                                          const Key& to) const {
+  if (height == 0) {
+    const leaf* reading = where.template read<leaf>();
+    const size_t first =
+        detail::btree_count_less(reading->keys(), reading->size, from, compare);
+    const size_t last =
+        detail::btree_count_less(reading->keys(), reading->size, to, compare);
+    if (first == last) {
+      return 0;
+    }
+    leaf* entries = where.template write<leaf>();
+    detail::btree_erase(entries->keys(), entries->size, first, last);
+    detail::btree_erase(entries->values(), entries->size, first, last);
+    entries->size -= last - first;
+    return last - first;
+  }
+
+  branch* children = where.template write<branch>();
+  const size_t first = detail::btree_count_not_greater(
+      children->keys(), children->size - 1, from, compare);
+  const size_t last = detail::btree_count_less(
+      children->keys(), children->size - 1, to, compare);
+
+  size_t removed =
+      erase_range(children->children()[first], height - 1, from, to);
+  if (last > first) {
+    removed += erase_range(children->children()[last], height - 1, from, to);
+    for (size_t dropped = last - 1; dropped > first; --dropped) {
+      removed += count_below(children->children()[dropped].get(), height - 1);
+      remove_child(children, dropped);
+    }
+  }
+
+  // Now first and first + 1 are the two ends, and either may be empty or
+  // underfull.
+  for (size_t end = std::min(first + 2, children->size); end-- > first;) {
+    if (children->children()[end]->size == 0) {
+      remove_child(children, end);
+    }
+  }
+  if (first < children->size) {
+    rebalance(children, first, height - 1);
+  }
+  if (first + 1 < children->size) {
+    rebalance(children, first + 1, height - 1);
+  }
+  return removed;
+}
+
+// If parent's child is less than half full, merges it with a neighbour or,
+// if together they'd overflow, evens them out. An empty child is dropped
+// even when it has no neighbour, which can leave parent empty in turn for
+// its own parent to drop; a range erase can leave a branch with only one
+// child, and nothing empty may stay reachable under it.
+template <typename Key, typename Value, typename Compare>
+inline void btree_map<Key, Value, Compare>::rebalance(branch* parent,
+                                                      size_t child,
+                                                      unsigned childHeight) {
+  if (parent->children()[child]->size == 0) {
+    remove_child(parent, child);
+    return;
+  }
+  if (parent->size < 2 ||
+      parent->children()[child]->size >= detail::btree_min_fill) {
+    return;
+  }
+  const size_t left = child + 1 < parent->size ? child : child - 1;
+  ptr<node>& leftWhere = parent->children()[left];
+  ptr<node>& rightWhere = parent->children()[left + 1];
+  const size_t total = leftWhere->size + rightWhere->size;
+
+  if (childHeight == 0) {
+    leaf* lower = leftWhere.template write<leaf>();
+    leaf* upper = rightWhere.template write<leaf>();
+    if (total <= detail::btree_width) {
+      detail::btree_append(lower->keys(), lower->size, upper->keys(),
+                           upper->size);
+      detail::btree_append(lower->values(), lower->size, upper->values(),
+                           upper->size);
+      lower->size = total;
+      remove_child(parent, left + 1);
+      return;
+    }
+    const size_t keep = total / 2;
+    if (lower->size < keep) {
+      const size_t moved = keep - lower->size;
+      detail::btree_append(lower->keys(), lower->size, upper->keys(), moved);
+      detail::btree_append(lower->values(), lower->size, upper->values(),
+                           moved);
+      detail::btree_erase(upper->keys(), upper->size, 0, moved);
+      detail::btree_erase(upper->values(), upper->size, 0, moved);
+      upper->size -= moved;
+    } else {
+      const size_t moved = lower->size - keep;
+      detail::btree_insert(upper->keys(), upper->size, 0,
+                           lower->keys() + keep, moved);
+      detail::btree_insert(upper->values(), upper->size, 0,
+                           lower->values() + keep, moved);
+      detail::btree_erase(lower->keys(), lower->size, keep, lower->size);
+      detail::btree_erase(lower->values(), lower->size, keep, lower->size);
+      upper->size += moved;
+    }
+    lower->size = keep;
+    parent->keys()[left] = upper->keys()[0];
+    return;
+  }
+
+  // Branches rotate through the parent's separator, which goes between
+  // lower's last child and upper's first. Either side may have been left
+  // empty by a range erase, and then the separator has nothing to go
+  // between.
+  branch* lower = leftWhere.template write<branch>();
+  branch* upper = rightWhere.template write<branch>();
+  Key& middle = parent->keys()[left];
+  const size_t seam = lower->size;
+  if (total <= detail::btree_width) {
+    if (lower->size > 0 && upper->size > 0) {
+      detail::btree_append(lower->keys(), lower->size - 1, &middle, 1);
+      detail::btree_append(lower->keys(), lower->size, upper->keys(),
+                           upper->key_count());
+    } else {
+      detail::btree_append(lower->keys(), lower->key_count(), upper->keys(),
+                           upper->key_count());
+    }
+    detail::btree_append(lower->children(), lower->size, upper->children(),
+                         upper->size);
+    lower->size = total;
+    remove_child(parent, left + 1);
+    // The children either side of the seam had different parents, so
+    // either may be underfull, or a branch that a range erase left with a
+    // single child, and only now can they be merged.
+    if (seam > 0 && seam < total) {
+      rebalance(lower, seam, childHeight - 1);
+      rebalance(lower, seam - 1, childHeight - 1);
+    }
+    return;
+  }
+
+  // Too many to merge, so both sides have children: even them out, moving
+  // children across along with the keys between them.
+  const size_t keep = total / 2;
+  if (lower->size < keep) {
+    const size_t moved = keep - lower->size;
+    detail::btree_append(lower->keys(), lower->size - 1, &middle, 1);
+    detail::btree_append(lower->keys(), lower->size, upper->keys(), moved - 1);
+    middle = std::move(upper->keys()[moved - 1]);
+    detail::btree_erase(upper->keys(), upper->key_count(), 0, moved);
+    detail::btree_append(lower->children(), lower->size, upper->children(),
+                         moved);
+    detail::btree_erase(upper->children(), upper->size, 0, moved);
+    upper->size -= moved;
+  } else if (lower->size > keep) {
+    const size_t moved = lower->size - keep;
+    detail::btree_insert(upper->keys(), upper->size - 1, 0, &middle, 1);
+    detail::btree_insert(upper->keys(), upper->size, 0, lower->keys() + keep,
+                         moved - 1);
+    middle = std::move(lower->keys()[keep - 1]);
+    detail::btree_erase(lower->keys(), lower->size - 1, keep - 1,
+                        lower->size - 1);
+    detail::btree_insert(upper->children(), upper->size, 0,
+                         lower->children() + keep, moved);
+    detail::btree_erase(lower->children(), lower->size, keep, lower->size);
+    upper->size += moved;
+  }
+  lower->size = keep;
+}
+
+// Takes parent's child out, along with the separator that went with it.
+template <typename Key, typename Value, typename Compare>
+inline void btree_map<Key, Value, Compare>::remove_child(branch* parent,
+                                                         size_t child) {
+  const size_t key = child > 0 ? child - 1 : 0;
+  if (parent->size > 1) {
+    detail::btree_erase(parent->keys(), parent->key_count(), key, key + 1);
+  }
+  detail::btree_erase(parent->children(), parent->size, child, child + 1);
+  --parent->size;
+}
+
+template <typename Key, typename Value, typename Compare>
+inline size_t btree_map<Key, Value, Compare>::count_below(const node* from,
+                                                          unsigned height) {
+  if (height == 0) {
+    return from->size;
+  }
+  size_t result = 0;
+  const auto* children = static_cast<const branch*>(from);
+  for (size_t i = 0; i < children->size; ++i) {
+    result += count_below(children->children()[i].get(), height - 1);
+  }
+  return result;
+}
+
+// Both iterators are at the start of a leaf. Finds the tallest node that
+// both are at the start of, counting heights up from the leaves since the
+// trees may differ in height, and if it's the same node skips both past it.
+template <typename Key, typename Value, typename Compare>
+inline bool btree_map<Key, Value, Compare>::skip_shared(
+    const_iterator& was, const_iterator& now) noexcept {
+  unsigned wasTop = was.height;
+  while (wasTop > 0 && was.slots[wasTop - 1] == 0) {
+    --wasTop;
+  }
+  unsigned nowTop = now.height;
+  while (nowTop > 0 && now.slots[nowTop - 1] == 0) {
+    --nowTop;
+  }
+  for (unsigned above = std::min(was.height - wasTop, now.height - nowTop) + 1;
+       above-- > 0;) {
+    if (was.node_at(was.height - above) == now.node_at(now.height - above)) {
+      was.skip(was.height - above);
+      now.skip(now.height - above);
+      return true;
+    }
+  }
+  return false;
+}
+
+// Drops a root left with a single child, and the tree if it's empty.
+template <typename Key, typename Value, typename Compare>
+inline void btree_map<Key, Value, Compare>::shrink() noexcept {
+  if (count == 0) {
+    clear();
+    return;
+  }
+  while (height > 0 && root->size == 1) {
+    ptr<node> only = root.template read<branch>()->children()[0];
+    root = std::move(only);
+    --height;
+  }
+}
+
+template <typename Key, typename Value, typename Compare>
+inline const Key& btree_map<Key, Value, Compare>::const_iterator::key()
+    const noexcept {
+  return at->keys()[index];
+}
+
+template <typename Key, typename Value, typename Compare>
+inline const Value& btree_map<Key, Value, Compare>::const_iterator::value()
+    const noexcept {
+  return at->values()[index];
+}
+
+template <typename Key, typename Value, typename Compare>
+inline auto btree_map<Key, Value, Compare>::const_iterator::operator*()
+    const noexcept -> reference {
+  return reference(at->keys()[index], at->values()[index]);
+}
+
+template <typename Key, typename Value, typename Compare>
+inline auto btree_map<Key, Value, Compare>::const_iterator::operator++() noexcept
+    -> const_iterator& {
+  if (++index == at->size) {
+    next_leaf();
+  }
+  return *this;
+}
+
+template <typename Key, typename Value, typename Compare>
+inline auto btree_map<Key, Value, Compare>::const_iterator::operator++(
+    int) noexcept -> const_iterator {
+  const_iterator before = *this;
+  ++*this;
+  return before;
+}
+
+template <typename Key, typename Value, typename Compare>
+inline bool btree_map<Key, Value, Compare>::const_iterator::operator==(
+    const const_iterator& other) const noexcept {
+  return at == other.at && index == other.index;
+}
+
+template <typename Key, typename Value, typename Compare>
+inline bool btree_map<Key, Value, Compare>::const_iterator::operator!=(
+    const const_iterator& other) const noexcept {
+  return !(*this == other);
+}
+
+template <typename Key, typename Value, typename Compare>
+inline void
+btree_map<Key, Value, Compare>::const_iterator::next_leaf() noexcept {
+  skip(height);
+}
+
+// Moves past the node at depth, which is the leaf at height: climbs to the
+// nearest branch with a child to the right, and goes down that child's left
+// edge. Becomes end() past the last leaf.
+template <typename Key, typename Value, typename Compare>
+inline void
+btree_map<Key, Value, Compare>::const_iterator::skip(unsigned depth) noexcept {
+  while (depth > 0 && slots[depth - 1] + 1 >= branches[depth - 1]->size) {
+    --depth;
+  }
+  if (depth == 0) {
+    at = nullptr;
+    index = 0;
+    return;
+  }
+  const node* down = branches[depth - 1]->children()[++slots[depth - 1]].get();
+  for (; depth < height; ++depth) {
+    branches[depth] = static_cast<const branch*>(down);
+    slots[depth] = 0;
+    down = branches[depth]->children()[0].get();
+  }
+  at = static_cast<const leaf*>(down);
+  index = 0;
+}
+
+template <typename Key, typename Value, typename Compare>
+inline auto btree_map<Key, Value, Compare>::const_iterator::node_at(
+    unsigned depth) const noexcept -> const node* {
+  return depth < height ? static_cast<const node*>(branches[depth]) : at;
+}
+
+template <typename Key, typename Value, typename Compare>
+inline btree_map<Key, Value, Compare>::cursor::operator bool() const noexcept {
+  return where.size() > 0;
+}
+
+template <typename Key, typename Value, typename Compare>
+inline const Key& btree_map<Key, Value, Compare>::cursor::key() const noexcept {
+  return current()->keys()[index];
+}
+
+template <typename Key, typename Value, typename Compare>
+inline const Value& btree_map<Key, Value, Compare>::cursor::value()
+    const noexcept {
+  return current()->values()[index];
+}
+
+template <typename Key, typename Value, typename Compare>
+inline Value* btree_map<Key, Value, Compare>::cursor::write() noexcept {
+  assert(*this);
+  return &static_cast<leaf*>(where.write())->values()[index];
+}
+
+template <typename Key, typename Value, typename Compare>
+inline auto btree_map<Key, Value, Compare>::cursor::operator++() noexcept
+    -> cursor& {
+  if (++index == current()->size) {
+    next_leaf();
+  }
+  return *this;
+}
+
+template <typename Key, typename Value, typename Compare>
+inline auto btree_map<Key, Value, Compare>::cursor::current() const noexcept
+    -> const leaf* {
+  return static_cast<const leaf*>(where.get());
+}
+
+// As const_iterator::next_leaf(), popping and pushing the path instead.
+// Past the last leaf the path is cleared.
+template <typename Key, typename Value, typename Compare>
+inline void btree_map<Key, Value, Compare>::cursor::next_leaf() noexcept {
+  unsigned depth = height;
+  while (depth > 0) {
+    where.pop();
+    const auto* up = static_cast<const branch*>(where.get());
+    if (slots[depth - 1] + 1 < up->size) {
+      break;
+    }
+    --depth;
+  }
+  index = 0;
+  if (depth == 0) {
+    where.clear();
+    return;
+  }
+  descend(++slots[depth - 1]);
+  for (; depth < height; ++depth) {
+    slots[depth] = 0;
+    descend(0);
+  }
+}
+
+// Children are past the end of the base node type, so each step is a
+// lambda rather than an offset from it.
+template <typename Key, typename Value, typename Compare>
+inline void btree_map<Key, Value, Compare>::cursor::descend(
+    size_t slot) noexcept {
+  where.push([slot](const node& from) {
+    return &static_cast<const branch&>(from).children()[slot];
+  });
+}
+
+}  // namespace cow
@@ -1,55 +1,547 @@
 #pragma once
 
+#include "cow/ptr.h"
+#include "cow/pool.h"
+
 #include <atomic>
+#include <cstring>
+#include <memory>
 #include <typeinfo>
 #include <assert.h>
 
 namespace cow::detail {
+  class control_block;
+
+  // Local blocks (see cow::local_scope) are tracked by the thread's active
+  // scope so they can all be switched to atomic refcounting when published.
+  // Defined in local.cpp.
+  size_t register_local_block(control_block* block);
+  void unregister_local_block(control_block* block, size_t index) noexcept;
+  void check_local_block(const control_block* block, size_t index) noexcept;
+
+  inline thread_local bool t_localScopeActive = false;
+
+  // Biased blocks (see cow/biased.h) remember the thread that made them. The
+  // owner record and its queue of blocks waiting to be merged live in
+  // biased.cpp.
+  struct biased_owner;
+  using destroy_function = void (*)(control_block*) noexcept;
+
+  void init_biased_block(control_block* block, destroy_function retire) noexcept;
+  bool queue_biased_block(control_block* block) noexcept;
+
+  inline thread_local biased_owner* t_biasedOwner = nullptr;
+
+  // Dead blocks go on the thread's reclaim queue instead of being destroyed
+  // while a cow::deferred_scope is active. Defined in reclaim.cpp.
+  struct reclaim_queue;
+  void defer_block(reclaim_queue* queue, control_block* block, destroy_function destroy, size_t bytes) noexcept;
+
+  inline thread_local reclaim_queue* t_reclaimQueue = nullptr;
+
+  // Interned blocks (see cow/intern.h) have an entry in the intern table,
+  // which has to be dropped before the block is destroyed. Defined in
+  // intern.cpp.
+  void release_interned(control_block* block) noexcept;
+
+  // The current cow::edit_session's token, already shifted into place in the
+  // refcount word, or all ones (which no word can match) outside a session.
+  inline constexpr size_t no_edit_stamp = ~size_t(0);
+  inline thread_local size_t t_editStamp = no_edit_stamp;
+
+  // Sits just in front of a biased block, below its vtable pointer if it has
+  // one.
+  struct biased_prefix {
+    biased_owner* owner;
+    destroy_function retire;
+    std::atomic<size_t> biased;
+  };
+
   class control_block {
   public:
-    std::atomic<size_t> refCount{ 1 };
+    // The refcount word holds the count in its low bits and flags in its top
+    // bits. Local blocks also keep their index in the owning scope's table
+    // in the bits between; that needs a 64-bit word, so local scopes are
+    // a no-op on 32-bit targets.
+    static constexpr bool supports_local = sizeof(size_t) >= 8;
+    static constexpr size_t flag_bits = 12;
+    static constexpr size_t flag_shift = sizeof(size_t) * 8 - flag_bits;
+    static constexpr size_t count_bits = supports_local ? 28 : flag_shift;
+    static constexpr size_t count_mask = (size_t(1) << count_bits) - 1;
+    static constexpr size_t local_index_shift = count_bits;
+    static constexpr size_t local_index_mask = ((size_t(1) << flag_shift) - 1) & ~count_mask;
+    static constexpr size_t max_local_index = local_index_mask >> local_index_shift;
+
+    // Refcounted with plain loads and stores by the owning thread.
+    static constexpr size_t local_flag = size_t(1) << flag_shift;
+
+    // Has a biased_prefix. Until the owner's count has been merged in, the
+    // count bits hold the other threads' count offset by biased_zero, since
+    // it can dip below zero.
+    static constexpr size_t biased_flag = local_flag << 1;
+    static constexpr size_t merged_flag = local_flag << 2;
+    static constexpr size_t queued_flag = local_flag << 3;
+    static constexpr size_t biased_zero = size_t(1) << (count_bits - 1);
 
-    virtual ~control_block() {
-      assert(refCount.load(std::memory_order_relaxed) == 0);
+    // Token of the edit_session the block was made in. Taking a second
+    // reference clears it, so a stamped block has only ever had one.
+    static constexpr size_t edit_token_shift = flag_shift + 4;
+    static constexpr size_t edit_token_bits = 4;
+    static constexpr size_t edit_token_mask = ((size_t(1) << edit_token_bits) - 1) << edit_token_shift;
+
+    // The block is the intern table's canonical copy of its value, and is
+    // never written in place. The table's shard is kept in the bits a local
+    // block would use for its index.
+    static constexpr size_t interned_flag = local_flag << 8;
+    static constexpr size_t interned_shard_shift = local_index_shift;
+
+    // The block lives in a mapped snapshot (see cow/snapshot.h), which is
+    // read-only and outlives every ptr into it. Its word is never written:
+    // taking and dropping references skip it, and it's never unique.
+    static constexpr size_t immortal_flag = local_flag << 9;
+
+    // Flags that a clone made by write() keeps.
+    static constexpr size_t inherited_flags = biased_flag;
+
+    static constexpr size_t word_flags(block_flags flags) noexcept {
+      return (flags & block_flags::biased) != block_flags::none ? biased_flag : 0;
     }
 
-    virtual control_block* clone() const noexcept = 0;
+    // How far in front of the allocation's object the prefix region reaches.
+    // The control block itself may sit one vtable pointer into the object.
+    static constexpr size_t prefix_reach = sizeof(biased_prefix) + sizeof(void*);
+
+    static constexpr size_t prefix_size(size_t word, size_t align) noexcept {
+      return (word & biased_flag) ? (prefix_reach + align - 1) & ~(align - 1) : 0;
+    }
+
+    std::atomic<size_t> refCount{ 1 };
 
     inline void incRef() noexcept {
+      auto word = refCount.load(std::memory_order_relaxed);
+      if (word & (local_flag | biased_flag | immortal_flag)) {
+        if (word & immortal_flag) {
+          return;
+        }
+        if (word & local_flag) {
+          checkLocal(word);
+          refCount.store((word + 1) & ~edit_token_mask, std::memory_order_relaxed);
+          return;
+        }
+        if (!(word & merged_flag) && prefix()->owner == t_biasedOwner) {
+          auto& biased = prefix()->biased;
+          // When GCC can see a block was allocated without a prefix, as for
+          // one too big for a pool, it warns about this branch even though
+          // the flag rules it out (GCC bug 104475).
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wstringop-overflow"
+#endif
+          biased.store(biased.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+          if (word & edit_token_mask) {
+            refCount.fetch_and(~edit_token_mask, std::memory_order_relaxed);
+          }
+          return;
+        }
+      }
       auto postInc = refCount.fetch_add(1, std::memory_order_acquire);
-      assert(postInc != 0);
+      assert((postInc & count_mask) != 0);
+      if (postInc & edit_token_mask) {
+        refCount.fetch_and(~edit_token_mask, std::memory_order_relaxed);
+      }
     }
 
-    inline void decRef() noexcept {
-      auto postDec = refCount.fetch_sub(1, std::memory_order_acquire);
-      assert((postDec + 1) != 0);
-      if (postDec == 0) {
-        delete this;
+    // Takes a reference unless the count has already dropped to zero. Only
+    // for blocks refcounted with plain atomics, neither local nor biased.
+    inline bool tryIncRef() noexcept {
+      auto word = refCount.load(std::memory_order_relaxed);
+      assert(!(word & (local_flag | biased_flag)));
+      do {
+        if ((word & count_mask) == 0) {
+          return false;
+        }
+      } while (!refCount.compare_exchange_weak(word, word + 1, std::memory_order_acquire, std::memory_order_relaxed));
+      return true;
+    }
+
+    // Drops a reference, and returns true if it was the last one. The caller
+    // knows the concrete block type and is responsible for destroying it.
+    inline bool releaseRef() noexcept {
+      auto word = refCount.load(std::memory_order_relaxed);
+      if (word & (local_flag | biased_flag | immortal_flag)) {
+        if (word & immortal_flag) {
+          return false;
+        }
+        if (word & local_flag) {
+          checkLocal(word);
+          assert((word & count_mask) != 0);
+          refCount.store(word - 1, std::memory_order_relaxed);
+          return (word & count_mask) == 1;
+        }
+        if (!(word & merged_flag)) {
+          return releaseBiased();
+        }
       }
+      // A queued block is destroyed by whoever processes the queue.
+      auto preDec = refCount.fetch_sub(1, std::memory_order_acq_rel);
+      assert((preDec & count_mask) != 0);
+      return (preDec & (count_mask | queued_flag)) == 1;
     }
 
-    virtual const std::type_info& type_info() const noexcept = 0;
+    inline size_t use_count(std::memory_order order = std::memory_order_relaxed) const noexcept {
+      auto word = refCount.load(order);
+      if ((word & (biased_flag | merged_flag)) == biased_flag) {
+        // Racy unless called by the owner, like any use_count().
+        auto count = ptrdiff_t((word & count_mask) + prefix()->biased.load(std::memory_order_relaxed)) -
+                     ptrdiff_t(biased_zero);
+        return count > 0 ? size_t(count) : 0;
+      }
+      return word & count_mask;
+    }
+
+    // Whether the caller's reference is the only one, so write() can modify
+    // the object in place. Only the owner can see a biased block's whole
+    // count before it's merged, so anyone else assumes it's shared. An
+    // interned block is always treated as shared, since the table can hand
+    // out another reference to it at any time, and so is an immortal one.
+    inline bool is_unique() const noexcept {
+      auto word = refCount.load(std::memory_order_acquire);
+      if ((word & (biased_flag | merged_flag)) == biased_flag) {
+        return prefix()->owner == t_biasedOwner &&
+               (word & count_mask) + prefix()->biased.load(std::memory_order_relaxed) == biased_zero + 1;
+      }
+      return (word & (count_mask | interned_flag | immortal_flag)) == 1;
+    }
+
+    // Whether the block was made in the thread's current edit_session and
+    // has never been shared, so write() can skip the uniqueness check. Only
+    // the thread holding the one reference can be asking.
+    inline bool is_edit_stamped() const noexcept {
+      return (refCount.load(std::memory_order_relaxed) & edit_token_mask) == t_editStamp;
+    }
+
+    inline bool is_local() const noexcept {
+      return (refCount.load(std::memory_order_relaxed) & local_flag) != 0;
+    }
+
+    inline biased_prefix* prefix() const noexcept {
+      return reinterpret_cast<biased_prefix*>(
+        const_cast<char*>(reinterpret_cast<const char*>(this)) - prefix_reach);
+    }
+
+    // Folds the owner's count into the shared count. Called by the owner, by
+    // whoever drains its queue, or by a releasing thread once the owner has
+    // exited. Returns true if the block is now dead and the caller has to
+    // destroy it.
+    bool mergeBiased(bool fromQueue) noexcept {
+      auto word = refCount.load(std::memory_order_relaxed);
+      size_t next;
+      do {
+        next = fromQueue ? word & ~queued_flag : word;
+        if (!(word & merged_flag)) {
+          size_t count = (word & count_mask) + prefix()->biased.load(std::memory_order_relaxed) - biased_zero;
+          assert(count <= count_mask);
+          next = (next & ~count_mask) | count | merged_flag;
+        }
+      } while (!refCount.compare_exchange_weak(word, next, std::memory_order_acq_rel, std::memory_order_relaxed));
+      return (next & (count_mask | queued_flag)) == 0;
+    }
 
   protected:
-    control_block() = default;
+    control_block() {
+      size_t word = 1;
+      if (t_editStamp != no_edit_stamp) {
+        word |= t_editStamp;
+      }
+      if constexpr (supports_local) {
+        if (t_localScopeActive) {
+          size_t index = register_local_block(this);
+          if (index <= max_local_index) {
+            word |= local_flag | (index << local_index_shift);
+          }
+        }
+      }
+      refCount.store(word, std::memory_order_relaxed);
+    }
+
+    ~control_block() {
+      auto word = refCount.load(std::memory_order_relaxed);
+      assert((word & count_mask) == 0);
+      if (word & local_flag) {
+        unregister_local_block(this, (word & local_index_mask) >> local_index_shift);
+      }
+    }
+
+  private:
+    inline void checkLocal([[maybe_unused]] size_t word) const noexcept {
+#ifndef NDEBUG
+      check_local_block(this, (word & local_index_mask) >> local_index_shift);
+#endif
+    }
+
+    bool releaseBiased() noexcept {
+      biased_prefix* const p = prefix();
+      if (p->owner == t_biasedOwner) {
+        auto biased = p->biased.load(std::memory_order_relaxed);
+        assert(biased != 0);
+        p->biased.store(biased - 1, std::memory_order_relaxed);
+        return biased == 1 && mergeBiased(false);
+      }
+
+      // If the shared count goes negative the owner still holds references
+      // it hasn't merged, and only it can tell when they're gone. The first
+      // thread to see that hands the block to the owner's queue.
+      auto word = refCount.load(std::memory_order_relaxed);
+      size_t next;
+      do {
+        next = word - 1;
+        if (!(word & (merged_flag | queued_flag)) && (next & count_mask) < biased_zero) {
+          next |= queued_flag;
+        }
+      } while (!refCount.compare_exchange_weak(word, next, std::memory_order_acq_rel, std::memory_order_relaxed));
+
+      if (word & merged_flag) {
+        return (word & (count_mask | queued_flag)) == 1;
+      }
+      if ((next & ~word) & queued_flag) {
+        return queue_biased_block(this);
+      }
+      return false;
+    }
+  };
+
+  // Runs the destructor and hands the memory, prefix included, back to its
+  // pool.
+  template<typename BlockType>
+  void destroy_block(BlockType* block) noexcept {
+    const size_t word = block->refCount.load(std::memory_order_relaxed);
+    const size_t prefixSize = control_block::prefix_size(word, alignof(BlockType));
+    char* const base = reinterpret_cast<char*>(block) - prefixSize;
+    block->~BlockType();
+    deallocate_block(base, prefixSize + sizeof(BlockType), alignof(BlockType));
+  }
+
+  // Gets a block back from the control_block* handed to a destroy_function.
+  // Cast as a reference: a pointer downcast that moves the address, as it
+  // does past a polymorphic block's vtable pointer, brings a null check
+  // with it, and GCC warns about the loads on the null path it can't rule
+  // out (GCC bug 104475).
+  template<typename BlockType>
+  BlockType* block_from(control_block* header) noexcept {
+    return &static_cast<BlockType&>(*header);
+  }
+
+  // Called once a block is dead. Destroys it now, or queues it if the thread
+  // is deferring reclamation.
+  template<typename BlockType>
+  void retire_block(BlockType* block) noexcept {
+    const size_t word = block->refCount.load(std::memory_order_relaxed);
+    if (word & control_block::interned_flag) {
+      release_interned(block);
+    }
+    if (reclaim_queue* const queue = t_reclaimQueue) {
+      const size_t bytes = control_block::prefix_size(word, alignof(BlockType)) + sizeof(BlockType);
+      defer_block(queue, block,
+                  [](control_block* b) noexcept { destroy_block(block_from<BlockType>(b)); }, bytes);
+      return;
+    }
+    destroy_block(block);
+  }
+
+  // The pool a clone of block goes in: the original's, or the default pool
+  // for an immortal block, which isn't in one.
+  inline pool_state* clone_pool(const void* block, size_t word, size_t size, size_t align) noexcept {
+    if (word & control_block::immortal_flag) {
+      return state_of(default_pool());
+    }
+    return pool_of(block, size, align);
+  }
+
+  // Allocates and constructs a block, with room in front of it for whatever
+  // the flags call for.
+  template<typename BlockType, typename... BlockConstructorArgTypes>
+  BlockType* create_block(pool_state* pool, size_t flags, BlockConstructorArgTypes&&... blockConstructorArgs) {
+    if (t_localScopeActive) {
+      flags &= ~control_block::biased_flag;
+    }
+    const size_t prefixSize = control_block::prefix_size(flags, alignof(BlockType));
+    void* const base = allocate_block(pool, prefixSize + sizeof(BlockType), alignof(BlockType));
+    BlockType* block;
+    try {
+      block = ::new (static_cast<char*>(base) + prefixSize) BlockType(std::forward<BlockConstructorArgTypes>(blockConstructorArgs)...);
+    } catch (...) {
+      deallocate_block(base, prefixSize + sizeof(BlockType), alignof(BlockType));
+      throw;
+    }
+    if (flags & control_block::biased_flag) {
+      control_block* const header = block;
+      assert(reinterpret_cast<char*>(header) - reinterpret_cast<char*>(block) <= ptrdiff_t(sizeof(void*)));
+      init_biased_block(header, [](control_block* b) noexcept { retire_block(block_from<BlockType>(b)); });
+    }
+    return block;
+  }
+
+  // Blocks for polymorphic objects. A ptr<Base> may point into a block that
+  // was made for a Derived, so cloning and destruction go through the vtable.
+  class polymorphic_control_block : public control_block {
+  public:
+    virtual ~polymorphic_control_block() = default;
+
+    virtual polymorphic_control_block* clone() const noexcept = 0;
+
+    virtual const std::type_info& type_info() const noexcept = 0;
+
+    virtual void retire() noexcept = 0;
+
+    inline void decRef() noexcept {
+      if (releaseRef()) {
+        retire();
+      }
+    }
   };
 
   template<typename ObjectType>
-  class control_block_with_object : public control_block {
+  class control_block_with_object<ObjectType, false> : public polymorphic_control_block {
+    // A ptr<Base> finds the object at the same offset whatever the block
+    // was made for, so padding can't differ between them.
+    static_assert(!isolate_refcount<ObjectType>,
+                  "isolate_refcount is only for non-polymorphic types");
+
   public:
     template<typename... ObjectContructorArgTypes>
     control_block_with_object(ObjectContructorArgTypes&&... objectConstructorArgs) :
-      control_block(),
+      polymorphic_control_block(),
       object(std::forward<ObjectContructorArgTypes>(objectConstructorArgs)...) {}
 
+    // Clones go in the same pool as the original, and keep its flags.
+    control_block_with_object* clone() const noexcept override {
+      const auto word = refCount.load(std::memory_order_relaxed);
+      const size_t size = prefix_size(word, alignof(control_block_with_object)) + sizeof(*this);
+      return create_block<control_block_with_object>(
+        clone_pool(this, word, size, alignof(control_block_with_object)), word & inherited_flags, object);
+    }
+
+    const std::type_info& type_info() const noexcept override {
+      return typeid(ObjectType);
+    }
+
+    void retire() noexcept override {
+      retire_block(this);
+    }
+
+    ObjectType object;
+  };
+
+  // Constructs a block's object from the result of a factory, so a prvalue
+  // result is built in place.
+  struct from_result_tag {};
+
+  // Non-polymorphic objects can keep values derived from them in their
+  // block, cleared whenever the object may change (see cow/memo.h). A type
+  // opts in by naming its functions in a cow_memos alias; memo_block is
+  // defined in cow/detail/memo.h, which declaring one pulls in.
+  template<typename ObjectType, typename Slots>
+  class memo_block;
+
+  template<typename ObjectType>
+  concept has_memos = uses_static_control_block<ObjectType> &&
+                      requires { typename ObjectType::cow_memos; };
+
+  template<typename ObjectType>
+  struct block_base {
+    using type = control_block;
+  };
+
+  template<has_memos ObjectType>
+  struct block_base<ObjectType> {
+    using type = memo_block<ObjectType, typename ObjectType::cow_memos>;
+  };
+
+  // Blocks for non-polymorphic objects. Nothing can point into one of these
+  // except a ptr of exactly this type, so there's no vtable: clone() and
+  // destruction are resolved at compile time, trivially copyable objects
+  // are cloned with a memcpy, and type_info() is the static type.
+  template<typename ObjectType>
+  class control_block_with_object<ObjectType, true> final : public block_base<ObjectType>::type {
+    using base_block = typename block_base<ObjectType>::type;
+    struct clone_tag {};
+
+  public:
+    template<typename... ObjectContructorArgTypes>
+    control_block_with_object(ObjectContructorArgTypes&&... objectConstructorArgs) :
+      base_block() {
+      ::new ((void*)std::addressof(object)) ObjectType(std::forward<ObjectContructorArgTypes>(objectConstructorArgs)...);
+    }
+
+    // Only reachable through clone(), since nobody else can name clone_tag.
+    control_block_with_object(clone_tag, const control_block_with_object& from) noexcept :
+      base_block() {
+      if constexpr (std::is_trivially_copyable_v<ObjectType>) {
+        std::memcpy((void*)std::addressof(object), std::addressof(from.object), sizeof(ObjectType));
+      } else {
+        ::new ((void*)std::addressof(object)) ObjectType(from.object);
+      }
+    }
+
+    template<typename FactoryType>
+    control_block_with_object(from_result_tag, FactoryType&& factory) :
+      base_block() {
+      ::new ((void*)std::addressof(object)) ObjectType(std::forward<FactoryType>(factory)());
+    }
+
+    ~control_block_with_object() {
+      object.~ObjectType();
+    }
+
     control_block_with_object* clone() const noexcept {
-      return new control_block_with_object(object);
+      const auto word = this->refCount.load(std::memory_order_relaxed);
+      const size_t size = control_block::prefix_size(word, alignof(control_block_with_object)) + sizeof(*this);
+      return create_block<control_block_with_object>(
+        clone_pool(this, word, size, alignof(control_block_with_object)), word & control_block::inherited_flags, clone_tag{}, *this);
+    }
+
+    // Like clone(), but the new object is factory()'s result.
+    template<typename FactoryType>
+    control_block_with_object* rebuild(FactoryType&& factory) const {
+      const auto word = this->refCount.load(std::memory_order_relaxed);
+      const size_t size = control_block::prefix_size(word, alignof(control_block_with_object)) + sizeof(*this);
+      return create_block<control_block_with_object>(
+        clone_pool(this, word, size, alignof(control_block_with_object)), word & control_block::inherited_flags,
+        from_result_tag{}, std::forward<FactoryType>(factory));
     }
 
     const std::type_info& type_info() const noexcept {
       return typeid(ObjectType);
     }
 
-    ObjectType object;
+    inline void decRef() noexcept {
+      if (this->releaseRef()) {
+        retire_block(this);
+      }
+    }
+
+    static constexpr size_t object_alignment =
+      isolate_refcount<ObjectType> && alignof(ObjectType) < cache_line_size ? cache_line_size : alignof(ObjectType);
+
+    union {
+      alignas(object_alignment) ObjectType object;
+    };
   };
+
+  // Where a block's object starts, so a ptr can find its block. offsetof
+  // is only guaranteed for standard-layout types, which blocks aren't, but
+  // GCC, Clang and MSVC all compute it for classes without virtual bases.
+  // GCC and Clang warn anyway, so this is the one place it's used.
+#if defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Winvalid-offsetof"
+#endif
+  template<typename ObjectType>
+  inline constexpr size_t object_offset = offsetof(control_block_with_object<ObjectType>, object);
+#if defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
 }
@@ -0,0 +1,710 @@
+#pragma once
+
+#include "cow/deque.h"
+
+#include <cassert>
+#include <memory>
+#include <new>
+#include <utility>
+
+namespace cow {
+
+namespace detail {
+
+// Branches and leaves share a polymorphic base so a digit or a branch can
+// hold either; the spine depth says which. size counts elements.
+template <typename T>
+struct deque_item {
+  explicit deque_item(size_t size) noexcept : size(size) {}
+  virtual ~deque_item() = default;
+
+  size_t size;
+};
+
+template <typename T>
+struct deque_branch final : deque_item<T> {
+  deque_branch() noexcept : deque_item<T>(0) {}
+
+  size_t count{0};
+  ptr<deque_item<T>> children[3];
+};
+
+// Up to deque_chunk_size elements, stored from first. A leaf started by a
+// push at the front fills from the end of its storage, and one started at
+// the back fills from the start, so neither ever has to shift.
+template <typename T>
+class deque_leaf final : public deque_item<T> {
+ public:
+  explicit deque_leaf(size_t first) noexcept : deque_item<T>(0), first(first) {}
+
+  deque_leaf(const deque_leaf& other) : deque_item<T>(0), first(other.first) {
+    try {
+      for (; this->size < other.size; ++this->size) {
+        ::new (static_cast<void*>(data() + this->size)) T(other.data()[this->size]);
+      }
+    } catch (...) {
+      std::destroy_n(data(), this->size);
+      throw;
+    }
+  }
+
+  deque_leaf& operator=(const deque_leaf&) = delete;
+
+  ~deque_leaf() { std::destroy_n(data(), this->size); }
+
+  const T* data() const noexcept {
+    return std::launder(reinterpret_cast<const T*>(storage)) + first;
+  }
+
+  T* data() noexcept { return std::launder(reinterpret_cast<T*>(storage)) + first; }
+
+  bool has_room_front() const noexcept { return first > 0; }
+  bool has_room_back() const noexcept { return first + this->size < deque_chunk_size; }
+
+  template <typename... ArgTypes>
+  T& emplace_back(ArgTypes&&... args) {
+    assert(has_room_back());
+    T* placed = ::new (static_cast<void*>(data() + this->size))
+        T(std::forward<ArgTypes>(args)...);
+    ++this->size;
+    return *placed;
+  }
+
+  template <typename... ArgTypes>
+  T& emplace_front(ArgTypes&&... args) {
+    assert(has_room_front());
+    T* placed = ::new (static_cast<void*>(data() - 1)) T(std::forward<ArgTypes>(args)...);
+    --first;
+    ++this->size;
+    return *placed;
+  }
+
+  void pop_back() noexcept {
+    assert(this->size > 0);
+    data()[--this->size].~T();
+  }
+
+  void pop_front() noexcept {
+    assert(this->size > 0);
+    data()->~T();
+    ++first;
+    --this->size;
+  }
+
+ private:
+  size_t first;
+  alignas(T) std::byte storage[sizeof(T) * deque_chunk_size];
+};
+
+// One level of the finger tree. A null spine is empty. A spine with one
+// item has it in front[0] and nothing else; otherwise both digits hold one
+// to four items, front[0] first and back[backCount - 1] last, and middle
+// holds branches of this level's items.
+template <typename T>
+struct deque_spine {
+  size_t size{0};
+  size_t frontCount{0};
+  size_t backCount{0};
+  ptr<deque_item<T>> front[4];
+  ptr<deque_spine> middle;
+  ptr<deque_item<T>> back[4];
+};
+
+}  // namespace detail
+
+template <typename T>
+inline deque<T>::deque(std::initializer_list<T> values)
+    : deque(from_range(values)) {}
+
+template <typename T>
+inline deque<T>::deque(ptr<spine> from) noexcept : root(std::move(from)) {}
+
+template <typename T>
+template <typename Range>
+inline deque<T> deque<T>::from_range(Range&& values) {
+  deque result;
+  for (auto&& value : values) {
+    result.emplace_back(std::forward<decltype(value)>(value));
+  }
+  return result;
+}
+
+template <typename T>
+inline size_t deque<T>::size() const noexcept {
+  return size_of(root);
+}
+
+template <typename T>
+inline bool deque<T>::empty() const noexcept {
+  return !root;
+}
+
+template <typename T>
+inline const T& deque<T>::operator[](size_t index) const noexcept {
+  assert(index < size());
+  const spine* at = root.get();
+  unsigned level = 0;
+  const item* found = nullptr;
+  while (!found) {
+    for (size_t i = 0; i < at->frontCount && !found; ++i) {
+      if (index < at->front[i]->size) {
+        found = at->front[i].get();
+      } else {
+        index -= at->front[i]->size;
+      }
+    }
+    if (found) {
+      break;
+    }
+    if (at->middle) {
+      if (index < at->middle->size) {
+        at = at->middle.get();
+        ++level;
+        continue;
+      }
+      index -= at->middle->size;
+    }
+    for (size_t i = 0; i < at->backCount && !found; ++i) {
+      if (index < at->back[i]->size) {
+        found = at->back[i].get();
+      } else {
+        index -= at->back[i]->size;
+      }
+    }
+    assert(found);
+  }
+  for (; level > 0; --level) {
+    const branch& from = static_cast<const branch&>(*found);
+    size_t i = 0;
+    while (index >= from.children[i]->size) {
+      index -= from.children[i++]->size;
+    }
+    found = from.children[i].get();
+  }
+  return static_cast<const leaf&>(*found).data()[index];
+}
+
+template <typename T>
+inline const T& deque<T>::front() const noexcept {
+  assert(root);
+  return static_cast<const leaf&>(*root->front[0]).data()[0];
+}
+
+template <typename T>
+inline const T& deque<T>::back() const noexcept {
+  assert(root);
+  const ptr<item>& last = last_leaf(*root);
+  return static_cast<const leaf&>(*last).data()[last->size - 1];
+}
+
+// The same walk as operator[], but through ptr::write() at each step.
+template <typename T>
+inline T& deque<T>::write(size_t index) {
+  assert(index < size());
+  spine* at = root.write();
+  unsigned level = 0;
+  ptr<item>* found = nullptr;
+  while (!found) {
+    for (size_t i = 0; i < at->frontCount && !found; ++i) {
+      if (index < at->front[i]->size) {
+        found = &at->front[i];
+      } else {
+        index -= at->front[i]->size;
+      }
+    }
+    if (found) {
+      break;
+    }
+    if (at->middle) {
+      if (index < at->middle->size) {
+        at = at->middle.write();
+        ++level;
+        continue;
+      }
+      index -= at->middle->size;
+    }
+    for (size_t i = 0; i < at->backCount && !found; ++i) {
+      if (index < at->back[i]->size) {
+        found = &at->back[i];
+      } else {
+        index -= at->back[i]->size;
+      }
+    }
+    assert(found);
+  }
+  for (; level > 0; --level) {
+    branch* from = found->template write<branch>();
+    size_t i = 0;
+    while (index >= from->children[i]->size) {
+      index -= from->children[i++]->size;
+    }
+    found = &from->children[i];
+  }
+  return found->template write<leaf>()->data()[index];
+}
+
+template <typename T>
+inline void deque<T>::push_back(T value) {
+  emplace_back(std::move(value));
+}
+
+template <typename T>
+template <typename... ArgTypes>
+inline T& deque<T>::emplace_back(ArgTypes&&... args) {
+  if (root && static_cast<const leaf&>(*last_leaf(*root)).has_room_back()) {
+    spine* top = root.write();
+    T& placed = last_leaf(*top).template write<leaf>()->emplace_back(
+        std::forward<ArgTypes>(args)...);
+    ++top->size;
+    return placed;
+  }
+  ptr<leaf> fresh = make<leaf>(0);
+  T& placed = fresh.write()->emplace_back(std::forward<ArgTypes>(args)...);
+  push_back(root, std::move(fresh));
+  return placed;
+}
+
+template <typename T>
+inline void deque<T>::push_front(T value) {
+  emplace_front(std::move(value));
+}
+
+template <typename T>
+template <typename... ArgTypes>
+inline T& deque<T>::emplace_front(ArgTypes&&... args) {
+  if (root && static_cast<const leaf&>(*first_leaf(*root)).has_room_front()) {
+    spine* top = root.write();
+    T& placed = first_leaf(*top).template write<leaf>()->emplace_front(
+        std::forward<ArgTypes>(args)...);
+    ++top->size;
+    return placed;
+  }
+  ptr<leaf> fresh = make<leaf>(detail::deque_chunk_size);
+  T& placed = fresh.write()->emplace_front(std::forward<ArgTypes>(args)...);
+  push_front(root, std::move(fresh));
+  return placed;
+}
+
+template <typename T>
+inline void deque<T>::pop_back() {
+  assert(root);
+  if (last_leaf(*root)->size == 1) {
+    pop_back(root);
+    return;
+  }
+  spine* top = root.write();
+  --top->size;
+  last_leaf(*top).template write<leaf>()->pop_back();
+}
+
+template <typename T>
+inline void deque<T>::pop_front() {
+  assert(root);
+  if (first_leaf(*root)->size == 1) {
+    pop_front(root);
+    return;
+  }
+  spine* top = root.write();
+  --top->size;
+  first_leaf(*top).template write<leaf>()->pop_front();
+}
+
+template <typename T>
+inline void deque<T>::clear() noexcept {
+  root = nullptr;
+}
+
+template <typename T>
+inline void deque<T>::append(const deque& other) {
+  // Held first, in case other is this.
+  const ptr<spine> right = other.root;
+  root = concat(std::move(root), item_run(), right);
+}
+
+// The tree splits around the leaf holding element at, and that leaf is cut
+// in two if at falls inside it.
+template <typename T>
+inline std::pair<deque<T>, deque<T>> deque<T>::split(size_t at) const {
+  assert(at <= size());
+  if (at == size()) {
+    return {*this, deque()};
+  }
+  split_parts parts = split_tree(root, at);
+  const size_t offset = at - size_of(parts.before);
+  if (offset > 0) {
+    const leaf& cut = static_cast<const leaf&>(*parts.at);
+    ptr<leaf> head = make<leaf>(0);
+    ptr<leaf> tail = make<leaf>(0);
+    leaf* filling = head.write();
+    for (size_t i = 0; i < cut.size; ++i) {
+      if (i == offset) {
+        filling = tail.write();
+      }
+      filling->emplace_back(cut.data()[i]);
+    }
+    push_back(parts.before, std::move(head));
+    parts.at = std::move(tail);
+  }
+  push_front(parts.after, std::move(parts.at));
+  return {deque(std::move(parts.before)), deque(std::move(parts.after))};
+}
+
+template <typename T>
+template <typename ChunkFunc>
+inline void deque<T>::for_each_chunk(ChunkFunc&& func) const {
+  if (root) {
+    visit(root.get(), 0, func);
+  }
+}
+
+template <typename T>
+template <typename ChunkFunc>
+inline void deque<T>::visit(const spine* from, unsigned level, ChunkFunc& func) {
+  for (size_t i = 0; i < from->frontCount; ++i) {
+    visit(from->front[i].get(), level, func);
+  }
+  if (from->middle) {
+    visit(from->middle.get(), level + 1, func);
+  }
+  for (size_t i = 0; i < from->backCount; ++i) {
+    visit(from->back[i].get(), level, func);
+  }
+}
+
+template <typename T>
+template <typename ChunkFunc>
+inline void deque<T>::visit(const item* from, unsigned level, ChunkFunc& func) {
+  if (level == 0) {
+    const leaf& values = static_cast<const leaf&>(*from);
+    func(values.data(), values.size);
+    return;
+  }
+  const branch& children = static_cast<const branch&>(*from);
+  for (size_t i = 0; i < children.count; ++i) {
+    visit(children.children[i].get(), level - 1, func);
+  }
+}
+
+template <typename T>
+template <typename Spine>
+inline auto& deque<T>::first_leaf(Spine& from) noexcept {
+  return from.front[0];
+}
+
+template <typename T>
+template <typename Spine>
+inline auto& deque<T>::last_leaf(Spine& from) noexcept {
+  return from.backCount ? from.back[from.backCount - 1] : from.front[0];
+}
+
+template <typename T>
+inline size_t deque<T>::size_of(const ptr<spine>& tree) noexcept {
+  return tree ? tree->size : 0;
+}
+
+template <typename T>
+inline auto deque<T>::make_branch(const ptr<item>* children, size_t count)
+    -> ptr<item> {
+  assert(count == 2 || count == 3);
+  ptr<branch> result = make<branch>();
+  branch* filling = result.write();
+  for (size_t i = 0; i < count; ++i) {
+    filling->size += children[i]->size;
+    filling->children[i] = children[i];
+  }
+  filling->count = count;
+  return result;
+}
+
+// A full front digit keeps its first item and the new one, and the other
+// three go down a level as a branch. That's what makes pushes amortized
+// O(1): a level only overflows into the next every third push.
+template <typename T>
+inline void deque<T>::push_front(ptr<spine>& tree, ptr<item> x) {
+  if (!tree) {
+    tree = from_items(&x, 1);
+    return;
+  }
+  spine* at = tree.write();
+  at->size += x->size;
+  if (at->backCount == 0) {
+    at->back[0] = std::move(at->front[0]);
+    at->backCount = 1;
+    at->front[0] = std::move(x);
+    return;
+  }
+  if (at->frontCount == 4) {
+    push_front(at->middle, make_branch(at->front + 1, 3));
+    at->frontCount = 1;
+  }
+  for (size_t i = at->frontCount; i > 0; --i) {
+    at->front[i] = std::move(at->front[i - 1]);
+  }
+  for (size_t i = at->frontCount + 1; i < 4; ++i) {
+    at->front[i] = nullptr;
+  }
+  at->front[0] = std::move(x);
+  ++at->frontCount;
+}
+
+template <typename T>
+inline void deque<T>::push_back(ptr<spine>& tree, ptr<item> x) {
+  if (!tree) {
+    tree = from_items(&x, 1);
+    return;
+  }
+  spine* at = tree.write();
+  at->size += x->size;
+  if (at->backCount == 4) {
+    push_back(at->middle, make_branch(at->back, 3));
+    at->back[0] = std::move(at->back[3]);
+    at->back[1] = nullptr;
+    at->back[2] = nullptr;
+    at->backCount = 1;
+  }
+  at->back[at->backCount++] = std::move(x);
+}
+
+// An emptied front digit is refilled with the children of the middle's
+// first branch, or the first item of the back digit if there's no middle.
+template <typename T>
+inline auto deque<T>::pop_front(ptr<spine>& tree) -> ptr<item> {
+  spine* at = tree.write();
+  ptr<item> x = std::move(at->front[0]);
+  if (at->backCount == 0) {
+    tree = nullptr;
+    return x;
+  }
+  at->size -= x->size;
+  for (size_t i = 1; i < at->frontCount; ++i) {
+    at->front[i - 1] = std::move(at->front[i]);
+  }
+  if (--at->frontCount > 0) {
+    return x;
+  }
+  if (at->middle) {
+    ptr<item> first = pop_front(at->middle);
+    const branch& children = static_cast<const branch&>(*first);
+    for (size_t i = 0; i < children.count; ++i) {
+      at->front[i] = children.children[i];
+    }
+    at->frontCount = children.count;
+  } else {
+    at->front[0] = std::move(at->back[0]);
+    for (size_t i = 1; i < at->backCount; ++i) {
+      at->back[i - 1] = std::move(at->back[i]);
+    }
+    at->frontCount = 1;
+    --at->backCount;
+  }
+  return x;
+}
+
+template <typename T>
+inline auto deque<T>::pop_back(ptr<spine>& tree) -> ptr<item> {
+  spine* at = tree.write();
+  if (at->backCount == 0) {
+    ptr<item> x = std::move(at->front[0]);
+    tree = nullptr;
+    return x;
+  }
+  ptr<item> x = std::move(at->back[--at->backCount]);
+  at->size -= x->size;
+  if (at->backCount > 0) {
+    return x;
+  }
+  if (at->middle) {
+    ptr<item> last = pop_back(at->middle);
+    const branch& children = static_cast<const branch&>(*last);
+    for (size_t i = 0; i < children.count; ++i) {
+      at->back[i] = children.children[i];
+    }
+    at->backCount = children.count;
+  } else if (at->frontCount > 1) {
+    at->back[0] = std::move(at->front[--at->frontCount]);
+    at->backCount = 1;
+  }
+  return x;
+}
+
+template <typename T>
+inline auto deque<T>::from_items(const ptr<item>* items, size_t count)
+    -> ptr<spine> {
+  if (count == 0) {
+    return nullptr;
+  }
+  ptr<spine> result = make<spine>();
+  spine* filling = result.write();
+  filling->size = items[0]->size;
+  filling->front[0] = items[0];
+  filling->frontCount = 1;
+  for (size_t i = 1; i < count; ++i) {
+    filling->size += items[i]->size;
+    filling->back[filling->backCount++] = items[i];
+  }
+  return result;
+}
+
+// Digits of one to four items each, around a middle of any size.
+template <typename T>
+inline auto deque<T>::make_deep(const ptr<item>* front, size_t frontCount,
+                                ptr<spine> middle, const ptr<item>* back,
+                                size_t backCount) -> ptr<spine> {
+  assert(frontCount >= 1 && frontCount <= 4 && backCount >= 1 && backCount <= 4);
+  ptr<spine> result = make<spine>();
+  spine* filling = result.write();
+  filling->size = size_of(middle);
+  for (size_t i = 0; i < frontCount; ++i) {
+    filling->size += front[i]->size;
+    filling->front[i] = front[i];
+  }
+  for (size_t i = 0; i < backCount; ++i) {
+    filling->size += back[i]->size;
+    filling->back[i] = back[i];
+  }
+  filling->frontCount = frontCount;
+  filling->backCount = backCount;
+  filling->middle = std::move(middle);
+  return result;
+}
+
+// As make_deep(), but the front digit may be empty, in which case it's
+// refilled from the middle or the back.
+template <typename T>
+inline auto deque<T>::deep_left(const ptr<item>* front, size_t frontCount,
+                                ptr<spine> middle, const ptr<item>* back,
+                                size_t backCount) -> ptr<spine> {
+  if (frontCount > 0) {
+    return make_deep(front, frontCount, std::move(middle), back, backCount);
+  }
+  if (!middle) {
+    return from_items(back, backCount);
+  }
+  ptr<item> first = pop_front(middle);
+  const branch& children = static_cast<const branch&>(*first);
+  return make_deep(children.children, children.count, std::move(middle), back,
+                   backCount);
+}
+
+template <typename T>
+inline auto deque<T>::deep_right(const ptr<item>* front, size_t frontCount,
+                                 ptr<spine> middle, const ptr<item>* back,
+                                 size_t backCount) -> ptr<spine> {
+  if (backCount > 0) {
+    return make_deep(front, frontCount, std::move(middle), back, backCount);
+  }
+  if (!middle) {
+    return from_items(front, frontCount);
+  }
+  ptr<item> last = pop_back(middle);
+  const branch& children = static_cast<const branch&>(*last);
+  return make_deep(front, frontCount, std::move(middle), children.children,
+                   children.count);
+}
+
+// Joins left, then the items in middle, then right. Where both sides are
+// deep, left's back digit, middle and right's front digit are regrouped
+// into branches and joined one level down, so the work is O(log n).
+template <typename T>
+inline auto deque<T>::concat(ptr<spine> left, const item_run& middle,
+                             const ptr<spine>& right) -> ptr<spine> {
+  if (!left || !right || left->backCount == 0 || right->backCount == 0) {
+    if (left && (!right || right->backCount == 0)) {
+      for (size_t i = 0; i < middle.count; ++i) {
+        push_back(left, middle.items[i]);
+      }
+      if (right) {
+        push_back(left, right->front[0]);
+      }
+      return left;
+    }
+    ptr<spine> result = right;
+    for (size_t i = middle.count; i-- > 0;) {
+      push_front(result, middle.items[i]);
+    }
+    if (left) {
+      push_front(result, left->front[0]);
+    }
+    return result;
+  }
+
+  item_run joined;
+  for (size_t i = 0; i < left->backCount; ++i) {
+    joined.items[joined.count++] = left->back[i];
+  }
+  for (size_t i = 0; i < middle.count; ++i) {
+    joined.items[joined.count++] = middle.items[i];
+  }
+  for (size_t i = 0; i < right->frontCount; ++i) {
+    joined.items[joined.count++] = right->front[i];
+  }
+  // Threes, with twos only to avoid leaving a one.
+  item_run branches;
+  for (size_t i = 0; i < joined.count;) {
+    const size_t remaining = joined.count - i;
+    const size_t take = remaining == 2 || remaining == 4 ? 2 : 3;
+    branches.items[branches.count++] = make_branch(joined.items + i, take);
+    i += take;
+  }
+
+  size_t total = left->size + right->size;
+  for (size_t i = 0; i < middle.count; ++i) {
+    total += middle.items[i]->size;
+  }
+  spine* at = left.write();
+  at->middle = concat(std::move(at->middle), branches, right->middle);
+  for (size_t i = 0; i < 4; ++i) {
+    at->back[i] = right->back[i];
+  }
+  at->backCount = right->backCount;
+  at->size = total;
+  return left;
+}
+
+// Finds the item holding element index, which must be in the tree, and
+// returns the items before and after it as trees of the same level.
+template <typename T>
+inline auto deque<T>::split_tree(const ptr<spine>& tree, size_t index)
+    -> split_parts {
+  const spine& from = *tree;
+  if (from.backCount == 0) {
+    return {nullptr, from.front[0], nullptr};
+  }
+  for (size_t i = 0; i < from.frontCount; ++i) {
+    if (index < from.front[i]->size) {
+      return {from_items(from.front, i), from.front[i],
+              deep_left(from.front + i + 1, from.frontCount - i - 1, from.middle,
+                        from.back, from.backCount)};
+    }
+    index -= from.front[i]->size;
+  }
+  if (from.middle) {
+    if (index < from.middle->size) {
+      split_parts inner = split_tree(from.middle, index);
+      index -= size_of(inner.before);
+      const branch& children = static_cast<const branch&>(*inner.at);
+      for (size_t i = 0;; ++i) {
+        if (index < children.children[i]->size) {
+          return {deep_right(from.front, from.frontCount, std::move(inner.before),
+                             children.children, i),
+                  children.children[i],
+                  deep_left(children.children + i + 1, children.count - i - 1,
+                            std::move(inner.after), from.back, from.backCount)};
+        }
+        index -= children.children[i]->size;
+      }
+    }
+    index -= from.middle->size;
+  }
+  for (size_t i = 0;; ++i) {
+    assert(i < from.backCount);
+    if (index < from.back[i]->size) {
+      return {deep_right(from.front, from.frontCount, from.middle, from.back, i),
+              from.back[i],
+              from_items(from.back + i + 1, from.backCount - i - 1)};
+    }
+    index -= from.back[i]->size;
+  }
+}
+
+}  // namespace cow
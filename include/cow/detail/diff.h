@@ -0,0 +1,46 @@
+#pragma once
+
+#include "cow/diff.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace cow {
+
+template <typename T, typename Visitor>
+inline void diff(const ptr<T>& before, const ptr<T>& after, Visitor&& visitor) {
+  if (before == after) {
+    return;
+  }
+  if (!before) {
+    visitor.added(after);
+    return;
+  }
+  if (!after) {
+    visitor.removed(before);
+    return;
+  }
+  visitor.changed(before, after);
+  if constexpr (detail::has_diff_children<T>) {
+    std::vector<const ptr<T>*> was;
+    std::vector<const ptr<T>*> now;
+    cow_for_each_child(*before, [&](const ptr<T>& child) { was.push_back(&child); });
+    cow_for_each_child(*after, [&](const ptr<T>& child) { now.push_back(&child); });
+    const ptr<T> none;
+    for (size_t i = 0; i < std::max(was.size(), now.size()); ++i) {
+      diff(i < was.size() ? *was[i] : none, i < now.size() ? *now[i] : none,
+           visitor);
+    }
+  }
+}
+
+template <typename Container, typename Visitor>
+  requires requires(const Container& from, Visitor& visitor) {
+    from.diff(from, visitor);
+  }
+inline void diff(const Container& before, const Container& after,
+                 Visitor&& visitor) {
+  before.diff(after, visitor);
+}
+
+}  // namespace cow
@@ -0,0 +1,786 @@
+#pragma once
+
+#include "cow/hash_map.h"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <new>
+
+namespace cow {
+
+namespace detail {
+
+// A node's entries and children share one buffer of slots in the node,
+// so a node, and each copy write() makes of it, is a single block with
+// nothing else to allocate. Entries fill the slots from the front and
+// children from the back, and each takes one of the node's 32 hash slots,
+// so they never meet. Most nodes are sparse, so the buffer comes in a few
+// sizes, from 2 to hash_map_width slots, each a final hash_map_node_of
+// that puts its buffer at the same offset. A full node is moved into the
+// next size up when it needs another slot, and back down once it's using
+// no more than a quarter of them.
+//
+// Below hash_map_hash_bits, entries()[i] is the entry for the i-th set bit
+// of dataMap and children()[i] the child for the i-th set bit of nodeMap. A
+// collision node has no maps, and its entries are in no particular order.
+// When they don't fit, the rest go in another collision node, its only
+// child, so only the last node in the chain is ever short.
+template <typename Key, typename Value>
+class hash_map_node {
+ public:
+  using value_type = std::pair<Key, Value>;
+  using child_type = ptr<hash_map_node>;
+
+  virtual ~hash_map_node() = default;
+
+  hash_map_node& operator=(const hash_map_node&) = delete;
+
+  size_t entry_count() const noexcept { return entryCount; }
+  size_t child_count() const noexcept { return childCount; }
+  size_t slot_count() const noexcept { return entryCount + childCount; }
+  size_t capacity() const noexcept { return slotCapacity; }
+
+  const value_type* entries() const noexcept {
+    return std::launder(reinterpret_cast<const value_type*>(storage()));
+  }
+
+  value_type* entries() noexcept {
+    return std::launder(reinterpret_cast<value_type*>(storage()));
+  }
+
+  const child_type* children() const noexcept {
+    return std::launder(reinterpret_cast<const child_type*>(storage_end())) - childCount;
+  }
+
+  child_type* children() noexcept {
+    return std::launder(reinterpret_cast<child_type*>(storage_end())) - childCount;
+  }
+
+  void insert_entry(size_t index, value_type&& entry) {
+    assert(index <= entryCount && slot_count() < slotCapacity);
+    value_type* const items = entries();
+    if (index == entryCount) {
+      ::new (static_cast<void*>(items + entryCount)) value_type(std::move(entry));
+      ++entryCount;
+      return;
+    }
+    ::new (static_cast<void*>(items + entryCount)) value_type(std::move(items[entryCount - 1]));
+    ++entryCount;
+    std::move_backward(items + index, items + entryCount - 2, items + entryCount - 1);
+    items[index] = std::move(entry);
+  }
+
+  void erase_entry(size_t index) noexcept {
+    assert(index < entryCount);
+    value_type* const items = entries();
+    std::move(items + index + 1, items + entryCount, items + index);
+    items[--entryCount].~value_type();
+  }
+
+  // Children grow down, so the ones before index move down a slot.
+  void insert_child(size_t index, child_type&& child) noexcept {
+    assert(index <= childCount && slot_count() < slotCapacity);
+    child_type* const from = children();
+    if (index == 0) {
+      ::new (static_cast<void*>(from - 1)) child_type(std::move(child));
+    } else {
+      ::new (static_cast<void*>(from - 1)) child_type(std::move(from[0]));
+      std::move(from + 1, from + index, from);
+      from[index - 1] = std::move(child);
+    }
+    ++childCount;
+  }
+
+  void erase_child(size_t index) noexcept {
+    assert(index < childCount);
+    child_type* const from = children();
+    std::move_backward(from, from + index, from + index + 1);
+    from[0].~child_type();
+    --childCount;
+  }
+
+  uint32_t dataMap{0};
+  uint32_t nodeMap{0};
+
+ protected:
+  // A slot holds an entry or a child, and either can go in any slot.
+  static constexpr size_t slot_align = std::max(alignof(value_type), alignof(child_type));
+  static constexpr size_t slot_size =
+      (std::max(sizeof(value_type), sizeof(child_type)) + slot_align - 1) / slot_align * slot_align;
+
+  // Where every size's buffer starts, which hash_map_node_of checks.
+  static constexpr size_t storage_offset() noexcept {
+    return (sizeof(hash_map_node) + slot_align - 1) / slot_align * slot_align;
+  }
+
+  explicit hash_map_node(size_t capacity) noexcept : slotCapacity(uint8_t(capacity)) {}
+
+  // The buffer is copied or moved in by the node that has it.
+  hash_map_node(const hash_map_node& other) noexcept
+      : dataMap(other.dataMap), nodeMap(other.nodeMap), slotCapacity(other.slotCapacity) {}
+
+  void copy_slots(const hash_map_node& other) {
+    assert(other.slot_count() <= slotCapacity);
+    std::uninitialized_copy_n(other.children(), other.childCount, children() - other.childCount);
+    childCount = other.childCount;
+    try {
+      for (; entryCount < other.entryCount; ++entryCount) {
+        ::new (static_cast<void*>(entries() + entryCount)) value_type(other.entries()[entryCount]);
+      }
+    } catch (...) {
+      destroy_slots();
+      throw;
+    }
+  }
+
+  // Leaves other's slots moved from, for it to destroy.
+  void move_slots(hash_map_node& other) {
+    assert(other.slot_count() <= slotCapacity);
+    dataMap = other.dataMap;
+    nodeMap = other.nodeMap;
+    std::uninitialized_move_n(other.children(), other.childCount, children() - other.childCount);
+    childCount = other.childCount;
+    try {
+      for (; entryCount < other.entryCount; ++entryCount) {
+        ::new (static_cast<void*>(entries() + entryCount))
+            value_type(std::move(other.entries()[entryCount]));
+      }
+    } catch (...) {
+      destroy_slots();
+      throw;
+    }
+  }
+
+  void destroy_slots() noexcept {
+    std::destroy_n(entries(), entryCount);
+    std::destroy_n(children(), childCount);
+    entryCount = 0;
+    childCount = 0;
+  }
+
+ private:
+  const std::byte* storage() const noexcept {
+    return reinterpret_cast<const std::byte*>(this) + storage_offset();
+  }
+
+  std::byte* storage() noexcept { return reinterpret_cast<std::byte*>(this) + storage_offset(); }
+
+  const std::byte* storage_end() const noexcept { return storage() + slot_size * slotCapacity; }
+  std::byte* storage_end() noexcept { return storage() + slot_size * slotCapacity; }
+
+  uint8_t entryCount{0};
+  uint8_t childCount{0};
+  uint8_t slotCapacity;
+};
+
+template <typename Key, typename Value, size_t Capacity>
+class hash_map_node_of final : public hash_map_node<Key, Value> {
+  using base = hash_map_node<Key, Value>;
+
+ public:
+  hash_map_node_of() noexcept : base(Capacity) { check_layout(); }
+
+  hash_map_node_of(const hash_map_node_of& other) : base(other) { this->copy_slots(other); }
+
+  // Takes the contents of a node of another size.
+  explicit hash_map_node_of(base&& from) : base(Capacity) {
+    check_layout();
+    this->move_slots(from);
+  }
+
+  ~hash_map_node_of() { this->destroy_slots(); }
+
+ private:
+  static constexpr void check_layout() noexcept {
+    static_assert(sizeof(hash_map_node_of) == base::storage_offset() + sizeof(storage),
+                  "every size of node has to keep its slots where hash_map_node looks");
+  }
+
+  alignas(base::slot_align) std::byte storage[base::slot_size * Capacity];
+};
+
+// A node of the smallest size with room for slots, built from args.
+template <typename Key, typename Value, size_t Capacity = 2, typename... Args>
+inline ptr<hash_map_node<Key, Value>> make_hash_map_node(size_t slots, Args&&... args) {
+  if constexpr (Capacity < hash_map_width) {
+    if (slots > Capacity) {
+      return make_hash_map_node<Key, Value, Capacity * 2>(slots, std::forward<Args>(args)...);
+    }
+  }
+  return make<hash_map_node_of<Key, Value, Capacity>>(std::forward<Args>(args)...);
+}
+
+inline uint32_t hash_map_bit(size_t hash, unsigned shift) noexcept {
+  return uint32_t(1) << ((hash >> shift) & ((1u << hash_map_bits) - 1));
+}
+
+inline size_t hash_map_index(uint32_t map, uint32_t bit) noexcept {
+  return size_t(std::popcount(map & (bit - 1)));
+}
+
+}  // namespace detail
+
+template <typename Key, typename Value, typename Hash, typename KeyEqual>
+inline hash_map<Key, Value, Hash, KeyEqual>::hash_map(const Hash& hash,
+                                                      const KeyEqual& equal)
+    : hashFunction(hash), keyEqual(equal) {}
+
+template <typename Key, typename Value, typename Hash, typename KeyEqual>
+inline hash_map<Key, Value, Hash, KeyEqual>::hash_map(
+    std::initializer_list<value_type> values, const Hash& hash,
+    const KeyEqual& equal)
+    : hashFunction(hash), keyEqual(equal) {
+  for (const value_type& value : values) {
+    insert_or_assign(value.first, value.second);
+  }
+}
+
+template <typename Key, typename Value, typename Hash, typename KeyEqual>
+inline Hash hash_map<Key, Value, Hash, KeyEqual>::hash_function() const {
+  return hashFunction;
+}
+
+template <typename Key, typename Value, typename Hash, typename KeyEqual>
+inline KeyEqual hash_map<Key, Value, Hash, KeyEqual>::key_eq() const {
+  return keyEqual;
+}
+
+template <typename Key, typename Value, typename Hash, typename KeyEqual>
+inline size_t hash_map<Key, Value, Hash, KeyEqual>::size() const noexcept {
+  return count;
+}
+
+template <typename Key, typename Value, typename Hash, typename KeyEqual>
+inline bool hash_map<Key, Value, Hash, KeyEqual>::empty() const noexcept {
+  return count == 0;
+}
+
+template <typename Key, typename Value, typename Hash, typename KeyEqual>
+inline const Value* hash_map<Key, Value, Hash, KeyEqual>::find(
+    const Key& key) const {
+  const size_t hash = hash_of(key);
+  const node* at = root.get();
+  for (unsigned shift = 0; at; shift += detail::hash_map_bits) {
+    if (shift >= detail::hash_map_hash_bits) {
+      for (; at; at = at->child_count() ? at->children()[0].get() : nullptr) {
+        for (size_t i = 0; i < at->entry_count(); ++i) {
+          if (keyEqual(at->entries()[i].first, key)) {
+            return &at->entries()[i].second;
+          }
+        }
+      }
+      return nullptr;
+    }
+
+    const uint32_t bit = detail::hash_map_bit(hash, shift);
+    if (at->dataMap & bit) {
+      const value_type& entry =
+          at->entries()[detail::hash_map_index(at->dataMap, bit)];
+      return keyEqual(entry.first, key) ? &entry.second : nullptr;
+    }
+    if (!(at->nodeMap & bit)) {
+      return nullptr;
+    }
+    at = at->children()[detail::hash_map_index(at->nodeMap, bit)].get();
+  }
+  return nullptr;
+}
+
+template <typename Key, typename Value, typename Hash, typename KeyEqual>
+inline bool hash_map<Key, Value, Hash, KeyEqual>::contains(
+    const Key& key) const {
+  return find(key) != nullptr;
+}
+
+template <typename Key, typename Value, typename Hash, typename KeyEqual>
+inline Value* hash_map<Key, Value, Hash, KeyEqual>::write(const Key& key) {
+  // Look first, so a missing key doesn't copy anything.
+  if (!find(key)) {
+    return nullptr;
+  }
+  const size_t hash = hash_of(key);
+  ptr<node>* where = &root;
+  for (unsigned shift = 0;; shift += detail::hash_map_bits) {
+    node* at = where->write();
+    if (shift >= detail::hash_map_hash_bits) {
+      for (size_t i = 0; i < at->entry_count(); ++i) {
+        if (keyEqual(at->entries()[i].first, key)) {
+          return &at->entries()[i].second;
+        }
+      }
+      // Further down the collision chain.
+      assert(at->child_count() == 1);
+      where = &at->children()[0];
+      continue;
+    }
+
+    const uint32_t bit = detail::hash_map_bit(hash, shift);
+    if (at->dataMap & bit) {
+      return &at->entries()[detail::hash_map_index(at->dataMap, bit)].second;
+    }
+    where = &at->children()[detail::hash_map_index(at->nodeMap, bit)];
+  }
+}
+
+template <typename Key, typename Value, typename Hash, typename KeyEqual>
+inline bool hash_map<Key, Value, Hash, KeyEqual>::insert(Key key,
+                                                         Value value) {
+  if (contains(key)) {
+    return false;
+  }
+  const size_t hash = hash_of(key);
+  put(root, 0, hash, value_type(std::move(key), std::move(value)), false);
+  ++count;
+  return true;
+}
+
+template <typename Key, typename Value, typename Hash, typename KeyEqual>
+inline bool hash_map<Key, Value, Hash, KeyEqual>::insert_or_assign(
+    Key key, Value value) {
+  const size_t hash = hash_of(key);
+  const bool added =
+      put(root, 0, hash, value_type(std::move(key), std::move(value)), true);
+  count += added;
+  return added;
+}
+
+template <typename Key, typename Value, typename Hash, typename KeyEqual>
+inline bool hash_map<Key, Value, Hash, KeyEqual>::erase(const Key& key) {
+  // Look first, so a missing key doesn't copy anything.
+  if (!contains(key)) {
+    return false;
+  }
+  remove(root, 0, hash_of(key), key);
+  if (--count == 0) {
+    root = nullptr;
+  }
+  return true;
+}
+
+template <typename Key, typename Value, typename Hash, typename KeyEqual>
+inline void hash_map<Key, Value, Hash, KeyEqual>::clear() noexcept {
+  count = 0;
+  root = nullptr;
+}
+
+template <typename Key, typename Value, typename Hash, typename KeyEqual>
+inline auto hash_map<Key, Value, Hash, KeyEqual>::begin() const noexcept
+    -> const_iterator {
+  return const_iterator(root.get());
+}
+
+template <typename Key, typename Value, typename Hash, typename KeyEqual>
+inline auto hash_map<Key, Value, Hash, KeyEqual>::end() const noexcept
+    -> const_iterator {
+  return const_iterator();
+}
+
+template <typename Key, typename Value, typename Hash, typename KeyEqual>
+template <typename Visitor>
+inline void hash_map<Key, Value, Hash, KeyEqual>::diff(const hash_map& after,
+                                                       Visitor&& visitor) const {
+  diff_nodes(root.get(), after.root.get(), 0, visitor);
+}
+
+template <typename Key, typename Value, typename Hash, typename KeyEqual>
+inline size_t hash_map<Key, Value, Hash, KeyEqual>::hash_of(
+    const Key& key) const {
+  return size_t(hashFunction(key));
+}
+
+// Adds entry below where, copying the nodes on the way down that are
+// shared. Returns whether it was added, rather than replacing (if assign)
+// or leaving an existing entry with the same key.
+template <typename Key, typename Value, typename Hash, typename KeyEqual>
+inline bool hash_map<Key, Value, Hash, KeyEqual>::put(ptr<node>& where,
+                                                      unsigned shift,
+                                                      size_t hash,
+                                                      value_type&& entry,
+                                                      bool assign) {
+  if (!where) {
+    where = detail::make_hash_map_node<Key, Value>(1);
+  }
+  node* at = where.write();
+
+  if (shift >= detail::hash_map_hash_bits) {
+    for (size_t i = 0; i < at->entry_count(); ++i) {
+      value_type& existing = at->entries()[i];
+      if (keyEqual(existing.first, entry.first)) {
+        if (assign) {
+          existing.second = std::move(entry.second);
+        }
+        return false;
+      }
+    }
+    if (at->child_count() > 0) {
+      return put(at->children()[0], shift, hash, std::move(entry), assign);
+    }
+    // Keep a slot free for the next node in the chain.
+    if (at->entry_count() + 1 < detail::hash_map_width) {
+      at = make_room(where);
+      at->insert_entry(at->entry_count(), std::move(entry));
+    } else {
+      ptr<node> next = detail::make_hash_map_node<Key, Value>(1);
+      next.write()->insert_entry(0, std::move(entry));
+      at->insert_child(0, std::move(next));
+    }
+    return true;
+  }
+
+  const uint32_t bit = detail::hash_map_bit(hash, shift);
+  if (at->nodeMap & bit) {
+    return put(at->children()[detail::hash_map_index(at->nodeMap, bit)],
+               shift + detail::hash_map_bits, hash, std::move(entry), assign);
+  }
+
+  const size_t index = detail::hash_map_index(at->dataMap, bit);
+  if (!(at->dataMap & bit)) {
+    at = make_room(where);
+    at->insert_entry(index, std::move(entry));
+    at->dataMap |= bit;
+    return true;
+  }
+
+  value_type& existing = at->entries()[index];
+  if (keyEqual(existing.first, entry.first)) {
+    if (assign) {
+      existing.second = std::move(entry.second);
+    }
+    return false;
+  }
+
+  // Two keys in one slot: both move down into a new child, which takes the
+  // slot the existing entry gives up.
+  const size_t existingHash = hash_of(existing.first);
+  ptr<node> child =
+      make_pair_node(shift + detail::hash_map_bits, std::move(existing),
+                     existingHash, std::move(entry), hash);
+  at->erase_entry(index);
+  at->dataMap &= ~bit;
+  at->insert_child(detail::hash_map_index(at->nodeMap, bit), std::move(child));
+  at->nodeMap |= bit;
+  return true;
+}
+
+template <typename Key, typename Value, typename Hash, typename KeyEqual>
+inline auto hash_map<Key, Value, Hash, KeyEqual>::make_pair_node(
+    unsigned shift, value_type&& first, size_t firstHash,
+    value_type&& second, size_t secondHash) -> ptr<node> {
+  ptr<node> result = detail::make_hash_map_node<Key, Value>(2);
+  node* at = result.write();
+  if (shift >= detail::hash_map_hash_bits) {
+    at->insert_entry(0, std::move(first));
+    at->insert_entry(1, std::move(second));
+    return result;
+  }
+
+  const uint32_t firstBit = detail::hash_map_bit(firstHash, shift);
+  const uint32_t secondBit = detail::hash_map_bit(secondHash, shift);
+  if (firstBit == secondBit) {
+    at->insert_child(0, make_pair_node(shift + detail::hash_map_bits, std::move(first),
+                                       firstHash, std::move(second), secondHash));
+    at->nodeMap = firstBit;
+  } else {
+    at->insert_entry(0, std::move(firstBit < secondBit ? first : second));
+    at->insert_entry(1, std::move(firstBit < secondBit ? second : first));
+    at->dataMap = firstBit | secondBit;
+  }
+  return result;
+}
+
+// Removes key, which must be there, from below where. A child left with a
+// single entry and no children of its own is folded into its parent.
+template <typename Key, typename Value, typename Hash, typename KeyEqual>
+inline void hash_map<Key, Value, Hash, KeyEqual>::remove(ptr<node>& where,
+                                                         unsigned shift,
+                                                         size_t hash,
+                                                         const Key& key) {
+  node* at = where.write();
+
+  if (shift >= detail::hash_map_hash_bits) {
+    size_t i = 0;
+    while (i < at->entry_count() && !keyEqual(at->entries()[i].first, key)) {
+      ++i;
+    }
+    if (i == at->entry_count()) {
+      assert(at->child_count() == 1);
+      remove(at->children()[0], shift, hash, key);
+    } else if (at->child_count() > 0) {
+      at->entries()[i] = take_last(at->children()[0]);
+    } else {
+      if (i + 1 != at->entry_count()) {
+        at->entries()[i] = std::move(at->entries()[at->entry_count() - 1]);
+      }
+      at->erase_entry(at->entry_count() - 1);
+    }
+    if (at->child_count() > 0 && at->children()[0]->entry_count() == 0) {
+      at->erase_child(0);
+    }
+    shrink(where);
+    return;
+  }
+
+  const uint32_t bit = detail::hash_map_bit(hash, shift);
+  if (at->dataMap & bit) {
+    at->erase_entry(detail::hash_map_index(at->dataMap, bit));
+    at->dataMap &= ~bit;
+    shrink(where);
+    return;
+  }
+
+  const size_t childIndex = detail::hash_map_index(at->nodeMap, bit);
+  ptr<node>& child = at->children()[childIndex];
+  remove(child, shift + detail::hash_map_bits, hash, key);
+
+  // remove() left the child unique, so its last entry can be moved out.
+  // It takes the slot the child gives up.
+  if (child->child_count() == 0 && child->entry_count() == 1) {
+    value_type last = std::move(child.write()->entries()[0]);
+    at->erase_child(childIndex);
+    at->nodeMap &= ~bit;
+    at->insert_entry(detail::hash_map_index(at->dataMap, bit), std::move(last));
+    at->dataMap |= bit;
+  }
+}
+
+// Moves out the last entry of the collision chain starting at where,
+// dropping the chain's last node if that empties it.
+template <typename Key, typename Value, typename Hash, typename KeyEqual>
+inline auto hash_map<Key, Value, Hash, KeyEqual>::take_last(ptr<node>& where)
+    -> value_type {
+  node* at = where.write();
+  if (at->child_count() > 0) {
+    value_type last = take_last(at->children()[0]);
+    if (at->children()[0]->entry_count() == 0) {
+      at->erase_child(0);
+    }
+    return last;
+  }
+  value_type last = std::move(at->entries()[at->entry_count() - 1]);
+  at->erase_entry(at->entry_count() - 1);
+  shrink(where);
+  return last;
+}
+
+// Gives where, which must already be unique, room for one more slot,
+// moving it into the next size up if it's full.
+template <typename Key, typename Value, typename Hash, typename KeyEqual>
+inline auto hash_map<Key, Value, Hash, KeyEqual>::make_room(ptr<node>& where)
+    -> node* {
+  node* at = where.write();
+  if (at->slot_count() < at->capacity()) {
+    return at;
+  }
+  where = detail::make_hash_map_node<Key, Value>(at->slot_count() + 1,
+                                                 std::move(*at));
+  return where.write();
+}
+
+// Moves where, which must already be unique, into a smaller size once
+// it's using no more than a quarter of its slots, so a node that's been
+// emptied doesn't keep its room.
+template <typename Key, typename Value, typename Hash, typename KeyEqual>
+inline void hash_map<Key, Value, Hash, KeyEqual>::shrink(ptr<node>& where) {
+  node* at = where.write();
+  if (at->slot_count() * 4 <= at->capacity()) {
+    where = detail::make_hash_map_node<Key, Value>(at->slot_count(),
+                                                   std::move(*at));
+  }
+}
+
+// Both nodes are at the same shift, so each hash slot is compared with the
+// same slot on the other side: an entry, a child, or nothing.
+template <typename Key, typename Value, typename Hash, typename KeyEqual>
+template <typename Visitor>
+inline void hash_map<Key, Value, Hash, KeyEqual>::diff_nodes(const node* before,
+                                                             const node* after,
+                                                             unsigned shift,
+                                                             Visitor& visitor) const {
+  if (before == after) {
+    return;
+  }
+  if (!before || !after) {
+    for (const_iterator it(before ? before : after), end; it != end; ++it) {
+      if (before) {
+        visitor.removed(it->first, it->second);
+      } else {
+        visitor.added(it->first, it->second);
+      }
+    }
+    return;
+  }
+
+  if (shift >= detail::hash_map_hash_bits) {
+    auto find_in = [this](const node* from, const Key& key) -> const value_type* {
+      for (const_iterator it(from), end; it != end; ++it) {
+        if (keyEqual(it->first, key)) {
+          return &*it;
+        }
+      }
+      return nullptr;
+    };
+    for (const_iterator was(before), end; was != end; ++was) {
+      const value_type* now = find_in(after, was->first);
+      if (!now) {
+        visitor.removed(was->first, was->second);
+      } else if (!detail::diff_same(was->second, now->second)) {
+        visitor.changed(was->first, was->second, now->second);
+      }
+    }
+    for (const_iterator now(after), end; now != end; ++now) {
+      if (!find_in(before, now->first)) {
+        visitor.added(now->first, now->second);
+      }
+    }
+    return;
+  }
+
+  uint32_t slots = before->dataMap | before->nodeMap | after->dataMap | after->nodeMap;
+  while (slots) {
+    const uint32_t bit = slots & (0u - slots);
+    slots &= slots - 1;
+    const value_type* was =
+        before->dataMap & bit
+            ? &before->entries()[detail::hash_map_index(before->dataMap, bit)]
+            : nullptr;
+    const value_type* now =
+        after->dataMap & bit
+            ? &after->entries()[detail::hash_map_index(after->dataMap, bit)]
+            : nullptr;
+    const node* wasBelow =
+        before->nodeMap & bit
+            ? before->children()[detail::hash_map_index(before->nodeMap, bit)].get()
+            : nullptr;
+    const node* nowBelow =
+        after->nodeMap & bit
+            ? after->children()[detail::hash_map_index(after->nodeMap, bit)].get()
+            : nullptr;
+    if (was && now) {
+      if (!keyEqual(was->first, now->first)) {
+        visitor.removed(was->first, was->second);
+        visitor.added(now->first, now->second);
+      } else if (!detail::diff_same(was->second, now->second)) {
+        visitor.changed(was->first, was->second, now->second);
+      }
+    } else if (was) {
+      diff_entry(*was, nowBelow, true, visitor);
+    } else if (now) {
+      diff_entry(*now, wasBelow, false, visitor);
+    } else {
+      diff_nodes(wasBelow, nowBelow, shift + detail::hash_map_bits, visitor);
+    }
+  }
+}
+
+// An entry on one side against a subtree (or nothing) in the same slot on
+// the other, which is where an insert pushed it down or an erase pulled it
+// up from.
+template <typename Key, typename Value, typename Hash, typename KeyEqual>
+template <typename Visitor>
+inline void hash_map<Key, Value, Hash, KeyEqual>::diff_entry(
+    const value_type& entry, const node* subtree, bool entryIsBefore,
+    Visitor& visitor) const {
+  bool found = false;
+  for (const_iterator it(subtree), end; it != end; ++it) {
+    if (!found && keyEqual(it->first, entry.first)) {
+      found = true;
+      const Value& was = entryIsBefore ? entry.second : it->second;
+      const Value& now = entryIsBefore ? it->second : entry.second;
+      if (!detail::diff_same(was, now)) {
+        visitor.changed(entry.first, was, now);
+      }
+    } else if (entryIsBefore) {
+      visitor.added(it->first, it->second);
+    } else {
+      visitor.removed(it->first, it->second);
+    }
+  }
+  if (!found) {
+    if (entryIsBefore) {
+      visitor.removed(entry.first, entry.second);
+    } else {
+      visitor.added(entry.first, entry.second);
+    }
+  }
+}
+
+template <typename Key, typename Value, typename Hash, typename KeyEqual>
+inline hash_map<Key, Value, Hash, KeyEqual>::const_iterator::const_iterator(
+    const node* root) noexcept
+    : current(root) {
+  if (root) {
+    stack[depth++] = frame{root, 0};
+    settle();
+  }
+}
+
+// Moves on from an exhausted node's entries to the next node, depth first,
+// that has any. A node is dropped from the stack once its last child is
+// taken, so a long collision chain doesn't need a frame per node.
+template <typename Key, typename Value, typename Hash, typename KeyEqual>
+inline void
+hash_map<Key, Value, Hash, KeyEqual>::const_iterator::settle() noexcept {
+  while (entry >= current->entry_count()) {
+    while (depth > 0 &&
+           stack[depth - 1].child >= stack[depth - 1].at->child_count()) {
+      --depth;
+    }
+    if (depth == 0) {
+      current = nullptr;
+      entry = 0;
+      return;
+    }
+    frame& top = stack[depth - 1];
+    current = top.at->children()[top.child++].get();
+    if (top.child == top.at->child_count()) {
+      --depth;
+    }
+    stack[depth++] = frame{current, 0};
+    entry = 0;
+  }
+}
+
+template <typename Key, typename Value, typename Hash, typename KeyEqual>
+inline auto hash_map<Key, Value, Hash, KeyEqual>::const_iterator::operator*()
+    const noexcept -> reference {
+  return current->entries()[entry];
+}
+
+template <typename Key, typename Value, typename Hash, typename KeyEqual>
+inline auto hash_map<Key, Value, Hash, KeyEqual>::const_iterator::operator->()
+    const noexcept -> pointer {
+  return &current->entries()[entry];
+}
+
+template <typename Key, typename Value, typename Hash, typename KeyEqual>
+inline auto hash_map<Key, Value, Hash, KeyEqual>::const_iterator::operator++()
+    noexcept -> const_iterator& {
+  ++entry;
+  settle();
+  return *this;
+}
+
+template <typename Key, typename Value, typename Hash, typename KeyEqual>
+inline auto hash_map<Key, Value, Hash, KeyEqual>::const_iterator::operator++(
+    int) noexcept -> const_iterator {
+  const_iterator before = *this;
+  ++*this;
+  return before;
+}
+
+template <typename Key, typename Value, typename Hash, typename KeyEqual>
+inline bool hash_map<Key, Value, Hash, KeyEqual>::const_iterator::operator==(
+    const const_iterator& other) const noexcept {
+  return current == other.current && entry == other.entry;
+}
+
+template <typename Key, typename Value, typename Hash, typename KeyEqual>
+inline bool hash_map<Key, Value, Hash, KeyEqual>::const_iterator::operator!=(
+    const const_iterator& other) const noexcept {
+  return !(*this == other);
+}
+
+}  // namespace cow
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "cow/intern.h"
+
+#include <assert.h>
+#include <type_traits>
+#include <utility>
+
+namespace cow {
+
+namespace detail {
+using intern_equal_function = bool (*)(const control_block*, const control_block*);
+
+// Returns the table's block for a value equal to candidate's, with a
+// reference taken for the caller, or puts candidate in the table and
+// returns it. Entries are only compared when their equal functions match,
+// so each type gets its own. Defined in intern.cpp.
+control_block* intern_block(control_block* candidate, size_t hash,
+                            intern_equal_function equal, size_t bytes);
+
+template <typename T>
+bool intern_equal(const control_block* a, const control_block* b) {
+  using block = control_block_with_object<T>;
+  return static_cast<const block*>(a)->object == static_cast<const block*>(b)->object;
+}
+}  // namespace detail
+
+template <typename T, typename Hash>
+inline ptr<T> intern(ptr<T> value, const Hash& hash) {
+  static_assert(detail::uses_static_control_block<T>,
+                "only non-polymorphic types can be interned");
+  assert(!detail::t_localScopeActive);
+  if (!value || is_interned(value)) {
+    return value;
+  }
+  const size_t word = detail::ptr_access::control(value)->refCount.load(std::memory_order_relaxed);
+  if (word & (detail::control_block::local_flag | detail::control_block::biased_flag |
+              detail::control_block::immortal_flag)) {
+    value = make<T>(*value);
+  }
+
+  using block = detail::control_block_with_object<T>;
+  detail::control_block* const candidate = detail::ptr_access::control(value);
+  detail::control_block* const found =
+      detail::intern_block(candidate, hash(*value), &detail::intern_equal<T>, sizeof(block));
+  if (found == candidate) {
+    return value;
+  }
+  return detail::ptr_access::adopt(&static_cast<block*>(found)->object);
+}
+
+template <typename T>
+inline bool is_interned(const ptr<T>& value) noexcept {
+  return value && (detail::ptr_access::control(value)->refCount.load(std::memory_order_relaxed) &
+                   detail::control_block::interned_flag);
+}
+
+}  // namespace cow
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "cow/local.h"
+
+namespace cow {
+
+template <typename ObjectType>
+inline ptr<ObjectType> local_scope::publish(ptr<ObjectType> root) noexcept {
+  assert(!root || !detail::ptr_access::control(root)->is_local() ||
+         owns(detail::ptr_access::control(root)));
+  publish();
+  return root;
+}
+
+}  // namespace cow
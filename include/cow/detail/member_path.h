@@ -0,0 +1,80 @@
+#pragma once
+
+#include "cow/member_path.h"
+
+#include <type_traits>
+
+namespace cow {
+
+namespace detail {
+
+template <auto Member>
+struct member_chain<Member> {
+  using root_type = typename ptr_member_traits<decltype(Member)>::from_type;
+  using object_type = typename ptr_member_traits<decltype(Member)>::to_type;
+
+  static const ptr<object_type>* find(const root_type& from) noexcept {
+    return &(from.*Member);
+  }
+
+  static ptr<object_type>* write(root_type& from) noexcept {
+    return &(from.*Member);
+  }
+};
+
+template <auto Member, auto... Rest>
+struct member_chain<Member, Rest...> {
+  using next_type = typename ptr_member_traits<decltype(Member)>::to_type;
+  using rest = member_chain<Rest...>;
+  using root_type = typename ptr_member_traits<decltype(Member)>::from_type;
+  using object_type = typename rest::object_type;
+
+  static_assert(std::is_same_v<next_type, typename rest::root_type>,
+                "each member must belong to the object type of the step before");
+
+  static const ptr<object_type>* find(const root_type& from) noexcept {
+    const ptr<next_type>& next = from.*Member;
+    return next ? rest::find(*next) : nullptr;
+  }
+
+  static ptr<object_type>* write(root_type& from) noexcept {
+    next_type* next = (from.*Member).write();
+    return next ? rest::write(*next) : nullptr;
+  }
+};
+
+}  // namespace detail
+
+template <auto... Members>
+inline member_path<Members...>::member_path(ptr<root_type>* rootWhere) noexcept
+    : spot<object_type>(rootWhere && *rootWhere ? chain::find(**rootWhere)
+                                                : nullptr),
+      root(rootWhere) {}
+
+template <auto... Members>
+inline member_path<Members...>::member_path(member_path&& other) noexcept
+    : spot<object_type>(std::move(other)), root(other.root) {
+  other.root = nullptr;
+}
+
+template <auto... Members>
+inline member_path<Members...>& member_path<Members...>::operator=(
+    member_path&& other) noexcept {
+  if (this != &other) {
+    spot<object_type>::operator=(std::move(other));
+    root = other.root;
+    other.root = nullptr;
+  }
+  return *this;
+}
+
+template <auto... Members>
+inline typename member_path<Members...>::object_type*
+member_path<Members...>::write() noexcept {
+  root_type* from = root ? root->write() : nullptr;
+  ptr<object_type>* where = from ? chain::write(*from) : nullptr;
+  this->here = where;
+  return where ? where->write() : nullptr;
+}
+
+}  // namespace cow
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "cow/memo.h"
+
+#include <assert.h>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace cow {
+
+namespace detail {
+
+// One cached value. The first thread to finish computing it claims the
+// slot; anyone who gets there while it's being filled just keeps their own
+// result.
+template <typename Value>
+class memo_cell {
+ public:
+  memo_cell() noexcept {}
+  ~memo_cell() { clear(); }
+
+  memo_cell(const memo_cell&) = delete;
+  memo_cell& operator=(const memo_cell&) = delete;
+
+  template <typename Compute>
+  Value get(Compute&& compute) const {
+    if (state.load(std::memory_order_acquire) == ready) {
+      return value;
+    }
+    Value result = std::forward<Compute>(compute)();
+    unsigned char expected = empty;
+    if (state.compare_exchange_strong(expected, filling, std::memory_order_relaxed)) {
+      try {
+        ::new ((void*)std::addressof(value)) Value(result);
+      } catch (...) {
+        state.store(empty, std::memory_order_relaxed);
+        throw;
+      }
+      state.store(ready, std::memory_order_release);
+    }
+    return result;
+  }
+
+  // Only while nobody else can see the block.
+  void clear() noexcept {
+    if (state.load(std::memory_order_relaxed) == ready) {
+      value.~Value();
+    }
+    state.store(empty, std::memory_order_relaxed);
+  }
+
+ private:
+  static constexpr unsigned char empty = 0;
+  static constexpr unsigned char filling = 1;
+  static constexpr unsigned char ready = 2;
+
+  mutable std::atomic<unsigned char> state{empty};
+  union {
+    mutable Value value;
+  };
+};
+
+template <typename Function, typename... Functions>
+inline constexpr size_t memo_index = [] {
+  constexpr bool matches[] = {std::is_same_v<Function, Functions>...};
+  for (size_t i = 0; i < sizeof...(Functions); ++i) {
+    if (matches[i]) {
+      return i;
+    }
+  }
+  return sizeof...(Functions);
+}();
+
+template <typename ObjectType, typename... Functions>
+class memo_block<ObjectType, memo_slots<Functions...>> : public control_block {
+ public:
+  template <typename Function>
+  const auto& cell() const noexcept {
+    constexpr size_t index = memo_index<Function, Functions...>;
+    static_assert(index < sizeof...(Functions), "Function isn't listed in the type's cow_memos");
+    return std::get<index>(cells);
+  }
+
+  void clear_memos() noexcept {
+    std::apply([](auto&... each) { (each.clear(), ...); }, cells);
+  }
+
+ private:
+  std::tuple<memo_cell<std::invoke_result_t<const Functions&, const ObjectType&>>...> cells;
+};
+
+}  // namespace detail
+
+template <typename Function, typename T>
+inline auto memo(const ptr<T>& node) {
+  static_assert(detail::has_memos<T>,
+                "memo() needs a non-polymorphic type with a cow_memos alias");
+  assert(node);
+  return detail::ptr_access::control(node)->template cell<Function>().get(
+      [&] { return Function{}(*node); });
+}
+
+}  // namespace cow
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "cow/merge3.h"
+
+#include <utility>
+#include <vector>
+
+namespace cow {
+
+namespace detail {
+
+// A copy of node with its children nulled, leaving only its own fields.
+template <typename T>
+inline T merge_own_fields(const T& node) {
+  T result = node;
+  cow_for_each_child(result, [](ptr<T>& child) { child = nullptr; });
+  return result;
+}
+
+}  // namespace detail
+
+template <typename T, typename Resolver>
+inline ptr<T> merge3(const ptr<T>& base, const ptr<T>& ours,
+                     const ptr<T>& theirs, Resolver&& resolver) {
+  if (ours == theirs || theirs == base) {
+    return ours;
+  }
+  if (ours == base) {
+    return theirs;
+  }
+  if constexpr (std::equality_comparable<T>) {
+    if (ours && theirs && *ours == *theirs) {
+      return ours;
+    }
+  }
+  if constexpr (detail::has_merge_children<T> && std::equality_comparable<T>) {
+    if (base && ours && theirs) {
+      std::vector<const ptr<T>*> was;
+      std::vector<const ptr<T>*> mine;
+      std::vector<const ptr<T>*> other;
+      cow_for_each_child(*base, [&](const ptr<T>& child) { was.push_back(&child); });
+      cow_for_each_child(*ours, [&](const ptr<T>& child) { mine.push_back(&child); });
+      cow_for_each_child(*theirs, [&](const ptr<T>& child) { other.push_back(&child); });
+
+      // Whichever side left the node's own fields alone takes the other's.
+      const T* fields = nullptr;
+      if (was.size() == mine.size() && was.size() == other.size()) {
+        const T baseFields = detail::merge_own_fields(*base);
+        const T ourFields = detail::merge_own_fields(*ours);
+        const T theirFields = detail::merge_own_fields(*theirs);
+        if (theirFields == baseFields || theirFields == ourFields) {
+          fields = ours.get();
+        } else if (ourFields == baseFields) {
+          fields = theirs.get();
+        }
+      }
+
+      if (fields) {
+        std::vector<ptr<T>> children;
+        children.reserve(was.size());
+        bool keepsOurs = fields == ours.get();
+        bool keepsTheirs = fields == theirs.get();
+        for (size_t i = 0; i < was.size(); ++i) {
+          children.push_back(merge3(*was[i], *mine[i], *other[i], resolver));
+          keepsOurs = keepsOurs && children.back() == *mine[i];
+          keepsTheirs = keepsTheirs && children.back() == *other[i];
+        }
+        if (keepsOurs) {
+          return ours;
+        }
+        if (keepsTheirs) {
+          return theirs;
+        }
+        ptr<T> result = fields == ours.get() ? ours : theirs;
+        size_t i = 0;
+        cow_for_each_child(*result.write(),
+                           [&](ptr<T>& child) { child = std::move(children[i++]); });
+        return result;
+      }
+    }
+  }
+  return resolver(base, ours, theirs);
+}
+
+template <typename Map, typename Resolver>
+  requires detail::keyed_mergeable<Map>
+inline Map merge3(const Map& base, const Map& ours, const Map& theirs,
+                  Resolver&& resolver) {
+  using Key = typename Map::key_type;
+  using Value = typename Map::mapped_type;
+
+  // Settles each key theirs changed against what ours has for it.
+  struct applier {
+    const Map& ours;
+    Map& result;
+    Resolver& resolver;
+
+    void added(const Key& key, const Value& now) { settle(key, nullptr, &now); }
+    void removed(const Key& key, const Value& was) { settle(key, &was, nullptr); }
+    void changed(const Key& key, const Value& was, const Value& now) {
+      settle(key, &was, &now);
+    }
+
+    void settle(const Key& key, const Value* was, const Value* now) {
+      const Value* mine = ours.find(key);
+      const bool oursKept = was ? mine && detail::diff_same(*mine, *was) : !mine;
+      if (oursKept) {
+        apply(key, now);
+        return;
+      }
+      const bool sameEdit = now ? mine && detail::diff_same(*mine, *now) : !mine;
+      if (sameEdit) {
+        return;
+      }
+      std::optional<Value> resolved = resolver(key, was, mine, now);
+      apply(key, resolved ? &*resolved : nullptr);
+    }
+
+    void apply(const Key& key, const Value* value) {
+      if (value) {
+        result.insert_or_assign(key, *value);
+      } else {
+        result.erase(key);
+      }
+    }
+  };
+
+  Map result = ours;
+  diff(base, theirs, applier{ours, result, resolver});
+  return result;
+}
+
+}  // namespace cow
@@ -0,0 +1,146 @@
+#pragma once
+
+#include "cow/offset_path.h"
+
+#include <algorithm>
+
+namespace cow {
+
+template <typename ObjectType>
+inline offset_path<ObjectType>::offset_path() noexcept
+    : spot<ObjectType>(nullptr) {}
+
+template <typename ObjectType>
+inline offset_path<ObjectType>::offset_path(ptr<ObjectType>* rootWhere) noexcept
+    : spot<ObjectType>(nullptr) {
+  reset(rootWhere);
+}
+
+template <typename ObjectType>
+inline offset_path<ObjectType>::offset_path(offset_path&& other) noexcept
+    : spot<ObjectType>(nullptr) {
+  take(std::move(other));
+}
+
+template <typename ObjectType>
+inline offset_path<ObjectType>& offset_path<ObjectType>::operator=(
+    offset_path&& other) noexcept {
+  if (this != &other) {
+    take(std::move(other));
+  }
+  return *this;
+}
+
+template <typename ObjectType>
+inline size_t offset_path<ObjectType>::size() const noexcept {
+  return count;
+}
+
+template <typename ObjectType>
+inline ObjectType* offset_path<ObjectType>::write() noexcept {
+  if (count == 0) {
+    return nullptr;
+  }
+
+  // Start at the deepest level already written; its own ptr still gets
+  // checked, but nothing above it does.
+  size_t depth = written > 0 ? written - 1 : 0;
+  auto* where = const_cast<ptr<ObjectType>*>(levels[depth].where);
+  for (;;) {
+    ObjectType* object = where->write();
+    if (++depth == count || object == nullptr) {
+      written = depth;
+      this->here = where;
+      return object;
+    }
+    where = reinterpret_cast<ptr<ObjectType>*>(
+        reinterpret_cast<char*>(object) + levels[depth].offset);
+    levels[depth].where = where;
+  }
+}
+
+template <typename ObjectType>
+inline offset_path<ObjectType>& offset_path<ObjectType>::pop(
+    size_t countToRemove) noexcept {
+  return resize(countToRemove < count ? count - countToRemove : 0);
+}
+
+template <typename ObjectType>
+inline offset_path<ObjectType>& offset_path<ObjectType>::resize(
+    size_t newSize) noexcept {
+  if (newSize < count) {
+    count = newSize;
+    written = std::min(written, count);
+    this->here = count > 0 ? levels[count - 1].where : nullptr;
+  }
+  return *this;
+}
+
+template <typename ObjectType>
+inline offset_path<ObjectType>& offset_path<ObjectType>::push(
+    const ptr<ObjectType>* pointerInBackObject) {
+  assert(count > 0 && this->here && *this->here);
+  const ObjectType* back = this->here->get();
+  const size_t offset = reinterpret_cast<const char*>(pointerInBackObject) -
+                        reinterpret_cast<const char*>(back);
+  assert(offset < sizeof(ObjectType) &&
+         (offset & (alignof(ptr<ObjectType>) - 1)) == 0);
+
+  if (count == capacity) {
+    auto grown = std::make_unique_for_overwrite<level[]>(capacity * 2);
+    std::copy(levels, levels + count, grown.get());
+    heapLevels = std::move(grown);
+    levels = heapLevels.get();
+    capacity *= 2;
+  }
+  levels[count++] = level{offset, pointerInBackObject};
+  this->here = pointerInBackObject;
+  return *this;
+}
+
+template <typename ObjectType>
+inline const ptr<ObjectType>* offset_path<ObjectType>::location(
+    size_t index) const noexcept {
+  assert(index < count);
+  return levels[index].where;
+}
+
+template <typename ObjectType>
+inline offset_path<ObjectType>& offset_path<ObjectType>::clear() noexcept {
+  return resize(0);
+}
+
+template <typename ObjectType>
+inline offset_path<ObjectType>& offset_path<ObjectType>::reset(
+    ptr<ObjectType>* rootWhere) noexcept {
+  levels[0] = level{0, rootWhere};
+  count = 1;
+  written = 0;
+  this->here = rootWhere;
+  return *this;
+}
+
+template <typename ObjectType>
+inline void offset_path<ObjectType>::take(offset_path&& other) noexcept {
+  if (other.heapLevels) {
+    heapLevels = std::move(other.heapLevels);
+    levels = heapLevels.get();
+    capacity = other.capacity;
+  } else {
+    std::copy(other.levels, other.levels + other.count, inlineLevels);
+    heapLevels.reset();
+    levels = inlineLevels;
+    capacity = offset_path_inline_levels;
+  }
+  count = other.count;
+  written = other.written;
+  this->here = other.here;
+
+  other.levels = other.inlineLevels;
+  other.capacity = offset_path_inline_levels;
+  other.count = 0;
+  other.written = 0;
+  other.here = nullptr;
+}
+
+}  // namespace cow
@@ -2,6 +2,10 @@
 
 #include "cow/path.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <new>
+
 namespace cow {
 
 template <typename ObjectType, typename... StepLambdaType>
@@ -12,31 +16,53 @@ path<ObjectType> make_path(ptr<ObjectType>* root,
   return result;
 }
 
+template <typename ObjectType>
+inline path<ObjectType>::path() noexcept : spot<ObjectType>(nullptr) {}
+
+template <typename ObjectType>
+inline path<ObjectType>::~path() {
+  truncate(0);
+}
+
+template <typename ObjectType>
+inline path<ObjectType>::path(path&& other) noexcept
+    : spot<ObjectType>(nullptr) {
+  take(std::move(other));
+}
+
+template <typename ObjectType>
+inline path<ObjectType>& path<ObjectType>::operator=(path&& other) noexcept {
+  if (this != &other) {
+    truncate(0);
+    take(std::move(other));
+  }
+  return *this;
+}
+
 template <typename ObjectType>
 template <typename RootSpotType, typename... ArgTypes>
 inline path<ObjectType> path<ObjectType>::create_root(ArgTypes&&... args) {
   path<ObjectType> result;
-  result.spots.emplace_back(new RootSpotType(std::forward<ArgTypes>(args)...));
-  result.here = spots.back()->here;
+  result.template place<RootSpotType>(std::forward<ArgTypes>(args)...);
   return result;
 }
 
 template <typename ObjectType>
 inline path<ObjectType>::path(ptr<ObjectType>* rootWhere)
-    : spot<ObjectType>(rootWhere) {
-  spots.emplace_back(new root_spot<ObjectType>(rootWhere));
+    : spot<ObjectType>(nullptr) {
+  place<root_spot<ObjectType>>(rootWhere);
 }
 
 template <typename ObjectType>
 inline size_t path<ObjectType>::size() const noexcept {
-  return spots.size();
+  return spotCount;
 }
 
 template <typename ObjectType>
 inline ObjectType* path<ObjectType>::write() noexcept {
   ObjectType* result = nullptr;
-  if (!spots.empty()) {
-    spot<ObjectType>* back = spots.back().get();
+  if (spotCount > 0) {
+    spot<ObjectType>* back = at(spotCount - 1).where;
     result = back->write();
     this->here = back->here;
   }
@@ -45,22 +71,14 @@ inline ObjectType* path<ObjectType>::write() noexcept {
 
 template <typename ObjectType>
 inline path<ObjectType>& path<ObjectType>::pop(size_t count) noexcept {
-  size_t oldSize = spots.size();
-  if (count < oldSize) {
-    spots.resize(spots.size() - count);
-    this->here = spots.back()->here;
-  } else {
-    spots.clear();
-    this->here = nullptr;
-  }
+  truncate(count < spotCount ? spotCount - count : 0);
   return *this;
 }
 
 template <typename ObjectType>
 inline path<ObjectType>& path<ObjectType>::resize(size_t newSize) noexcept {
-  if (newSize < spots.size()) {
-    spots.resize(newSize);
-    this->here = newSize > 0 ? spots.back()->here : nullptr;
+  if (newSize < spotCount) {
+    truncate(newSize);
   }
   return *this;
 }
@@ -74,15 +92,15 @@ inline path<ObjectType>& path<ObjectType>::push(
 template <typename ObjectType>
 inline const spot<ObjectType>& path<ObjectType>::back(
     size_t count) const noexcept {
-  assert(count < spots.size());
-  return **(spots.end() - count - 1);
+  assert(count < spotCount);
+  return *at(spotCount - count - 1).where;
 }
 
 template <typename ObjectType>
 inline const spot<ObjectType>& path<ObjectType>::front(
     size_t count) const noexcept {
-  assert(count < spots.size());
-  return **(spots.begin() + count);
+  assert(count < spotCount);
+  return *at(count).where;
 }
 
 template <typename ObjectType>
@@ -99,8 +117,7 @@ inline spot<ObjectType>& path<ObjectType>::front(size_t count) noexcept {
 
 template <typename ObjectType>
 inline path<ObjectType>& path<ObjectType>::clear() noexcept {
-  spots.clear();
-  this->here = nullptr;
+  truncate(0);
   return *this;
 }
 
@@ -114,22 +131,151 @@ inline path<ObjectType>& path<ObjectType>::push(StepFunc&& stepFunc) noexcept {
 template <typename ObjectType>
 template <typename SpotType, typename... ArgTypes>
 inline path<ObjectType>& path<ObjectType>::emplace(ArgTypes&&... args) {
-  assert(!spots.empty());
-  SpotType* newSpot =
-      new SpotType(*spots.back(), std::forward<ArgTypes>(args)...);
-  this->here = newSpot->here;
-  spots.emplace_back(newSpot);
+  assert(spotCount > 0);
+  place<SpotType>(*at(spotCount - 1).where, std::forward<ArgTypes>(args)...);
   return *this;
 }
 
 template <typename ObjectType>
 template <typename RootSpot, typename... ArgTypes>
 inline path<ObjectType>& path<ObjectType>::reset(ArgTypes&&... args) {
-  spots.clear();
-  auto newRoot = new RootSpot(std::forward<ArgTypes>(args)...);
-  this->here = newRoot->here;
-  spots.emplace_back(newRoot);
+  truncate(0);
+  place<RootSpot>(std::forward<ArgTypes>(args)...);
   return *this;
 }
 
-}  // namespace cow
\ No newline at end of file
+template <typename ObjectType>
+template <typename SpotType>
+inline spot<ObjectType>* path<ObjectType>::relocate(
+    spot<ObjectType>* from, void* to, spot<ObjectType>* newFrom) noexcept {
+  auto* moved = static_cast<SpotType*>(from);
+  if (to) {
+    auto* old = moved;
+    moved = ::new (to) SpotType(std::move(*old));
+    old->~SpotType();
+  }
+  if constexpr (std::is_base_of_v<next_spot<ObjectType, ObjectType>, SpotType>) {
+    static_cast<next_spot<ObjectType, ObjectType>*>(moved)->fromSpot = newFrom;
+  }
+  return moved;
+}
+
+template <typename ObjectType>
+template <typename SpotType, typename... ArgTypes>
+inline SpotType* path<ObjectType>::place(ArgTypes&&... args) {
+  static_assert(alignof(SpotType) <= alignof(std::max_align_t),
+                "spots are relocated between inline buffers on move");
+  const arena_mark mark = top;
+  if (spotCount >= path_inline_spots) {
+    moreEntries.emplace_back();
+  }
+  SpotType* placed;
+  try {
+    placed = ::new (allocate(sizeof(SpotType), alignof(SpotType)))
+        SpotType(std::forward<ArgTypes>(args)...);
+  } catch (...) {
+    top = mark;
+    if (spotCount >= path_inline_spots) {
+      moreEntries.pop_back();
+    }
+    throw;
+  }
+  at(spotCount++) = entry{placed, &relocate<SpotType>, mark};
+  this->here = placed->here;
+  return placed;
+}
+
+template <typename ObjectType>
+inline void* path<ObjectType>::allocate(size_t size, size_t align) {
+  for (;;) {
+    std::byte* const base =
+        top.chunk == 0 ? inlineBytes : chunks[top.chunk - 1].bytes.get();
+    const size_t capacity =
+        top.chunk == 0 ? path_inline_bytes : chunks[top.chunk - 1].size;
+    const auto address = reinterpret_cast<uintptr_t>(base + top.used);
+    const size_t offset =
+        top.used + (((address + align - 1) & ~uintptr_t(align - 1)) - address);
+    if (offset + size <= capacity) {
+      top.used = offset + size;
+      return base + offset;
+    }
+
+    // Chunks double in size, and are kept after a rewind for the next
+    // descent.
+    ++top.chunk;
+    top.used = 0;
+    if (top.chunk > chunks.size()) {
+      const size_t chunkSize =
+          std::max(path_inline_bytes << top.chunk, size + align);
+      chunks.push_back(
+          {std::make_unique_for_overwrite<std::byte[]>(chunkSize), chunkSize});
+    } else if (chunks[top.chunk - 1].size < size + align) {
+      chunks[top.chunk - 1] = {
+          std::make_unique_for_overwrite<std::byte[]>(size + align),
+          size + align};
+    }
+  }
+}
+
+template <typename ObjectType>
+inline void path<ObjectType>::truncate(size_t newSize) noexcept {
+  while (spotCount > newSize) {
+    entry& back = at(--spotCount);
+    top = back.mark;
+    back.where->~spot<ObjectType>();
+    back.where = nullptr;
+  }
+  if (moreEntries.size() > std::max(spotCount, path_inline_spots) - path_inline_spots) {
+    moreEntries.resize(std::max(spotCount, path_inline_spots) - path_inline_spots);
+  }
+  this->here = spotCount > 0 ? at(spotCount - 1).where->here : nullptr;
+}
+
+// Heap chunks change hands as they are; spots in the inline buffer move to
+// the same offset in ours. Then every spot is pointed at its new predecessor.
+template <typename ObjectType>
+inline void path<ObjectType>::take(path&& other) noexcept {
+  chunks = std::move(other.chunks);
+  moreEntries = std::move(other.moreEntries);
+  top = other.top;
+  spotCount = other.spotCount;
+  std::copy(other.inlineEntries,
+            other.inlineEntries + std::min(spotCount, path_inline_spots),
+            inlineEntries);
+
+  spot<ObjectType>* previous = nullptr;
+  for (size_t i = 0; i < spotCount; ++i) {
+    entry& moved = at(i);
+    auto* const address = reinterpret_cast<std::byte*>(moved.where);
+    void* to = nullptr;
+    if (address >= other.inlineBytes &&
+        address < other.inlineBytes + path_inline_bytes) {
+      to = inlineBytes + (address - other.inlineBytes);
+    }
+    moved.where = moved.relocate(moved.where, to, previous);
+    previous = moved.where;
+  }
+  this->here = other.here;
+
+  other.chunks.clear();
+  other.moreEntries.clear();
+  other.top = arena_mark{};
+  other.spotCount = 0;
+  other.here = nullptr;
+}
+
+template <typename ObjectType>
+inline typename path<ObjectType>::entry& path<ObjectType>::at(
+    size_t index) noexcept {
+  return index < path_inline_spots ? inlineEntries[index]
+                                   : moreEntries[index - path_inline_spots];
+}
+
+template <typename ObjectType>
+inline const typename path<ObjectType>::entry& path<ObjectType>::at(
+    size_t index) const noexcept {
+  return index < path_inline_spots ? inlineEntries[index]
+                                   : moreEntries[index - path_inline_spots];
+}
+
+}  // namespace cow
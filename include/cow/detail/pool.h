@@ -0,0 +1,130 @@
+#pragma once
+
+#include "cow/pool.h"
+
+#include <assert.h>
+#include <cstdint>
+#include <new>
+
+namespace cow::detail {
+
+inline constexpr size_t pool_granularity = 16;
+inline constexpr size_t pool_max_block_size = 512;
+inline constexpr size_t pool_max_align = 64;
+inline constexpr size_t pool_class_count = pool_max_block_size / pool_granularity;
+inline constexpr size_t pool_slab_size = size_t(64) * 1024;
+
+// Thread caches refill and drain in batches of this many blocks, and hold
+// at most twice that per size class.
+inline constexpr unsigned pool_batch_size = 32;
+inline constexpr unsigned pool_cache_limit = pool_batch_size * 2;
+
+struct pool_free_block {
+  pool_free_block* next;
+};
+
+// Every slab is aligned to pool_slab_size, so any block can find the header
+// (and from there its owning pool) by masking its own address.
+struct alignas(pool_max_align) pool_slab {
+  pool_state* owner;
+  pool_slab* nextSlab;
+};
+
+struct thread_cache {
+  std::shared_ptr<pool_state> pool;
+  pool_free_block* lists[pool_class_count]{};
+  unsigned counts[pool_class_count]{};
+};
+
+inline thread_local thread_cache* t_lastCache = nullptr;
+
+// Slow paths, in pool.cpp. find_thread_cache() returns nullptr once the
+// calling thread has started tearing down its thread_locals.
+thread_cache* find_thread_cache(pool_state* pool);
+void* refill_thread_cache(thread_cache& cache, size_t sizeClass);
+void drain_thread_cache(thread_cache& cache, size_t sizeClass) noexcept;
+void* allocate_shared(pool_state* pool, size_t sizeClass);
+void deallocate_shared(pool_state* pool, void* block, size_t sizeClass) noexcept;
+
+constexpr size_t pool_rounded_size(size_t size, size_t align) noexcept {
+  const size_t step = align > pool_granularity ? align : pool_granularity;
+  return (size + step - 1) & ~(step - 1);
+}
+
+constexpr bool is_pooled(size_t size, size_t align) noexcept {
+  return align <= pool_max_align &&
+         pool_rounded_size(size, align) <= pool_max_block_size;
+}
+
+// Blocks in a size class sit at multiples of the class size from a 64-byte
+// aligned base, so rounding the size up to the alignment is enough to keep
+// every block in that class aligned.
+constexpr size_t pool_size_class(size_t size, size_t align) noexcept {
+  return pool_rounded_size(size, align) / pool_granularity - 1;
+}
+
+inline thread_cache* current_thread_cache(pool_state* pool) {
+  thread_cache* cache = t_lastCache;
+  if (cache && cache->pool.get() == pool) {
+    return cache;
+  }
+  return find_thread_cache(pool);
+}
+
+inline pool_slab* slab_of(const void* block) noexcept {
+  return reinterpret_cast<pool_slab*>(reinterpret_cast<uintptr_t>(block) &
+                                      ~uintptr_t(pool_slab_size - 1));
+}
+
+inline void* allocate_block(pool_state* pool, size_t size, size_t align) {
+  if (!is_pooled(size, align)) {
+    return ::operator new(size, std::align_val_t(align));
+  }
+
+  const size_t sizeClass = pool_size_class(size, align);
+  thread_cache* cache = current_thread_cache(pool);
+  if (!cache) {
+    return allocate_shared(pool, sizeClass);
+  }
+
+  pool_free_block* block = cache->lists[sizeClass];
+  if (!block) {
+    return refill_thread_cache(*cache, sizeClass);
+  }
+  cache->lists[sizeClass] = block->next;
+  --cache->counts[sizeClass];
+  return block;
+}
+
+inline void deallocate_block(void* block, size_t size, size_t align) noexcept {
+  if (!is_pooled(size, align)) {
+    ::operator delete(block, size, std::align_val_t(align));
+    return;
+  }
+
+  const size_t sizeClass = pool_size_class(size, align);
+  pool_state* const pool = slab_of(block)->owner;
+  thread_cache* cache = current_thread_cache(pool);
+  if (!cache) {
+    deallocate_shared(pool, block, sizeClass);
+    return;
+  }
+
+  auto* freeBlock = static_cast<pool_free_block*>(block);
+  freeBlock->next = cache->lists[sizeClass];
+  cache->lists[sizeClass] = freeBlock;
+  if (++cache->counts[sizeClass] > pool_cache_limit) {
+    drain_thread_cache(*cache, sizeClass);
+  }
+}
+
+// The pool a block came from, so clones can be allocated alongside it.
+// Blocks too big to be pooled report the default pool.
+inline pool_state* pool_of(const void* block, size_t size, size_t align) noexcept {
+  if (!is_pooled(size, align)) {
+    return state_of(default_pool());
+  }
+  return slab_of(block)->owner;
+}
+
+}  // namespace cow::detail
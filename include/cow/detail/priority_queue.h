@@ -0,0 +1,173 @@
+#pragma once
+
+#include "cow/priority_queue.h"
+
+#include <cassert>
+
+namespace cow {
+
+namespace detail {
+
+// Child chains and sibling chains can both be as long as the heap is big,
+// so nodes aren't freed recursively. Taking the two links as the left and
+// right of a binary tree, the tree is rotated right until the node at the
+// top has no left, and then that node is dropped. Anything shared is just
+// released, since it can't be freed here.
+template <typename T>
+inline priority_queue_node<T>::~priority_queue_node() {
+  for (ptr<priority_queue_node>* link : {&firstChild, &nextSibling}) {
+    ptr<priority_queue_node> at = std::move(*link);
+    while (at && at.use_count() == 1) {
+      priority_queue_node* top = at.write();
+      if (!top->firstChild) {
+        ptr<priority_queue_node> next = std::move(top->nextSibling);
+        at = std::move(next);
+      } else if (top->firstChild.use_count() != 1) {
+        top->firstChild = nullptr;
+      } else {
+        ptr<priority_queue_node> left = std::move(top->firstChild);
+        priority_queue_node* rotated = left.write();
+        top->firstChild = std::move(rotated->nextSibling);
+        rotated->nextSibling = std::move(at);
+        at = std::move(left);
+      }
+    }
+  }
+}
+
+}  // namespace detail
+
+template <typename T, typename Compare>
+inline priority_queue<T, Compare>::priority_queue(const Compare& compare)
+    : compare(compare) {}
+
+template <typename T, typename Compare>
+template <typename Range>
+inline priority_queue<T, Compare> priority_queue<T, Compare>::from_range(
+    Range&& values, const Compare& compare) {
+  priority_queue result(compare);
+  std::vector<ptr<node>> heaps;
+  for (auto&& value : values) {
+    heaps.push_back(
+        make<node>(std::in_place, std::forward<decltype(value)>(value)));
+  }
+  result.count = heaps.size();
+  while (heaps.size() > 1) {
+    size_t kept = 0;
+    for (size_t i = 0; i < heaps.size(); i += 2) {
+      heaps[kept++] = i + 1 < heaps.size()
+                          ? result.meld(std::move(heaps[i]), std::move(heaps[i + 1]))
+                          : std::move(heaps[i]);
+    }
+    heaps.resize(kept);
+  }
+  if (!heaps.empty()) {
+    result.root = std::move(heaps.front());
+  }
+  return result;
+}
+
+template <typename T, typename Compare>
+inline Compare priority_queue<T, Compare>::value_comp() const {
+  return compare;
+}
+
+template <typename T, typename Compare>
+inline size_t priority_queue<T, Compare>::size() const noexcept {
+  return count;
+}
+
+template <typename T, typename Compare>
+inline bool priority_queue<T, Compare>::empty() const noexcept {
+  return count == 0;
+}
+
+template <typename T, typename Compare>
+inline const T& priority_queue<T, Compare>::top() const noexcept {
+  assert(root);
+  return root->value;
+}
+
+template <typename T, typename Compare>
+inline void priority_queue<T, Compare>::push(T value) {
+  emplace(std::move(value));
+}
+
+template <typename T, typename Compare>
+template <typename... ArgTypes>
+inline void priority_queue<T, Compare>::emplace(ArgTypes&&... args) {
+  root = meld(std::move(root),
+              make<node>(std::in_place, std::forward<ArgTypes>(args)...));
+  ++count;
+}
+
+// Two-pass pairing: meld the old top's children in pairs from the left,
+// then meld the pairs together from the right.
+template <typename T, typename Compare>
+inline void priority_queue<T, Compare>::pop() {
+  assert(root);
+  ptr<node> children = root->firstChild;
+  root = nullptr;
+  --count;
+
+  std::vector<ptr<node>> pairs;
+  while (children) {
+    ptr<node> first = std::move(children);
+    children = detach(first);
+    if (!children) {
+      pairs.push_back(std::move(first));
+      break;
+    }
+    ptr<node> second = std::move(children);
+    children = detach(second);
+    pairs.push_back(meld(std::move(first), std::move(second)));
+  }
+  for (size_t i = pairs.size(); i-- > 0;) {
+    root = meld(std::move(pairs[i]), std::move(root));
+  }
+}
+
+template <typename T, typename Compare>
+inline void priority_queue<T, Compare>::merge(const priority_queue& other) {
+  root = meld(std::move(root), other.root);
+  count += other.count;
+}
+
+template <typename T, typename Compare>
+inline void priority_queue<T, Compare>::clear() noexcept {
+  count = 0;
+  root = nullptr;
+}
+
+// Melds two heaps, neither of which has siblings: the lesser top becomes
+// the first child of the greater.
+template <typename T, typename Compare>
+inline auto priority_queue<T, Compare>::meld(ptr<node> a, ptr<node> b) const
+    -> ptr<node> {
+  if (!a) {
+    return b;
+  }
+  if (!b) {
+    return a;
+  }
+  if (compare(a->value, b->value)) {
+    std::swap(a, b);
+  }
+  node* winner = a.write();
+  node* loser = b.write();
+  loser->nextSibling = std::move(winner->firstChild);
+  winner->firstChild = std::move(b);
+  return a;
+}
+
+// Unlinks from's next sibling and returns it. from is only written, and
+// copied if shared, when it has one.
+template <typename T, typename Compare>
+inline auto priority_queue<T, Compare>::detach(ptr<node>& from) -> ptr<node> {
+  if (!from->nextSibling) {
+    return nullptr;
+  }
+  return std::move(from.write()->nextSibling);
+}
+
+}  // namespace cow
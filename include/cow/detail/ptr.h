@@ -4,14 +4,48 @@
 #include "cow/detail/control_block.h"
 
 #include <assert.h>
+#include <utility>
 
 namespace cow {
+  namespace detail {
+    // Back door for the rest of the library to get at a ptr's control block.
+    struct ptr_access {
+      template<typename ObjectType>
+      static auto* control(const ptr<ObjectType>& p) noexcept {
+        return p.control();
+      }
+
+      // Wraps an object whose block already holds a reference for the new ptr.
+      template<typename ObjectType>
+      static ptr<ObjectType> adopt(ObjectType* object) noexcept {
+        return ptr<ObjectType>(object);
+      }
+
+      // A ref to an object that something else is keeping alive.
+      template<typename ObjectType>
+      static ref<ObjectType> borrow(ObjectType* object) noexcept {
+        return ref<ObjectType>(object);
+      }
+
+      // Empties p without dropping its reference, which the caller now owns.
+      template<typename ObjectType>
+      static ObjectType* release(ptr<ObjectType>& p) noexcept {
+        return std::exchange(p.object, nullptr);
+      }
+
+      // The control block of an object whose reference isn't in a ptr.
+      template<typename ObjectType>
+      static auto* control_of(ObjectType* object) noexcept {
+        return reinterpret_cast<detail::control_block_with_object<ObjectType>*>(
+          reinterpret_cast<char*>(object) - detail::object_offset<ObjectType>);
+      }
+    };
+  }
+
   template<typename ObjectType>
-  inline detail::control_block_with_object<ObjectType>* ptr<ObjectType>::control() const noexcept {
+  inline auto* ptr<ObjectType>::control() const noexcept {
     assert(object);
-    return reinterpret_cast<detail::control_block_with_object<ObjectType>*>(
-      reinterpret_cast<char*>(object) -
-      offsetof(detail::control_block_with_object<ObjectType>, object));
+    return detail::ptr_access::control_of(object);
   }
 
   template<typename ObjectType>
@@ -32,7 +66,8 @@ namespace cow {
   template <typename ObjectType>
   template <
       typename DerivedType,
-      std::enable_if_t<std::is_convertible_v<DerivedType*, ObjectType*>, int>>
+      std::enable_if_t<std::is_convertible_v<DerivedType*, ObjectType*> &&
+                             detail::is_same_block_layout<DerivedType, ObjectType>, int>>
   inline ptr<ObjectType>::ptr(const ptr<DerivedType>& other) noexcept
       : object(other.object) {
     assert((void*)object == (void*)other.object); // control blocks must match
@@ -44,7 +79,8 @@ namespace cow {
   template <typename ObjectType>
   template <
       typename DerivedType,
-      std::enable_if_t<std::is_convertible_v<DerivedType*, ObjectType*>, int>>
+      std::enable_if_t<std::is_convertible_v<DerivedType*, ObjectType*> &&
+                             detail::is_same_block_layout<DerivedType, ObjectType>, int>>
   inline ptr<ObjectType>::ptr(ptr<DerivedType>&& other) noexcept : object(other.object) {
     assert((void*)object == (void*)other.object); // control blocks must match
     other.object = nullptr;
@@ -77,7 +113,8 @@ namespace cow {
   template <typename ObjectType>
   template <
       typename DerivedType,
-      std::enable_if_t<std::is_convertible_v<DerivedType*, ObjectType*>, int>>
+      std::enable_if_t<std::is_convertible_v<DerivedType*, ObjectType*> &&
+                             detail::is_same_block_layout<DerivedType, ObjectType>, int>>
   inline ptr<ObjectType>& ptr<ObjectType>::operator=(
       const ptr<DerivedType>& other) noexcept {
     if (other.object) {
@@ -92,7 +129,8 @@ namespace cow {
 
   template <typename ObjectType>
   template <typename DerivedType,
-            std::enable_if_t<std::is_convertible_v<DerivedType*, ObjectType*>, int>>
+            std::enable_if_t<std::is_convertible_v<DerivedType*, ObjectType*> &&
+                             detail::is_same_block_layout<DerivedType, ObjectType>, int>>
   inline ptr<ObjectType>& ptr<ObjectType>::operator=(ptr<DerivedType>&& other) noexcept {
     if (object) {
       control()->decRef();
@@ -167,16 +205,68 @@ namespace cow {
   inline ObjectType* ptr<ObjectType>::write() noexcept {
     if (object) {
       auto* c = control();
-      if (c->refCount.load(std::memory_order_acquire) > 1) {
-        auto* clone = c->clone();
-        assert(clone && clone->refCount.load(std::memory_order_relaxed) == 1);
-        c->decRef();
-        object = &clone->object;
+      if (!c->is_edit_stamped() && !c->is_unique()) {
+        if constexpr (detail::uses_static_control_block<ObjectType>) {
+          auto* clone = c->clone();
+          assert(clone && clone->use_count() == 1);
+          c->decRef();
+          object = &clone->object;
+        } else {
+          // The block may hold a derived object, so clone through the base
+          // class and find the copy's object at the same offset.
+          detail::polymorphic_control_block* from = c;
+          auto* clone = from->clone();
+          assert(clone && clone->use_count() == 1);
+          from->decRef();
+          object = reinterpret_cast<ObjectType*>(
+            reinterpret_cast<char*>(clone) + detail::object_offset<ObjectType>);
+        }
+      } else if constexpr (detail::has_memos<ObjectType>) {
+        c->clear_memos();
+      }
+    }
+    return object;
+  }
+
+  template <typename ObjectType>
+  template <typename UpdateFunc>
+  inline ObjectType* ptr<ObjectType>::update(UpdateFunc&& func) {
+    static_assert(detail::uses_static_control_block<ObjectType>,
+                  "update() builds an object of the static type; use write() for polymorphic objects");
+    assert(object);
+    auto* c = control();
+    if (c->is_edit_stamped() || c->is_unique()) {
+      if constexpr (detail::has_memos<ObjectType>) {
+        c->clear_memos();
       }
+      *object = std::forward<UpdateFunc>(func)(std::as_const(*object));
+    } else {
+      auto* fresh = c->rebuild([&]() -> decltype(auto) {
+        return std::forward<UpdateFunc>(func)(std::as_const(*object));
+      });
+      c->decRef();
+      object = &fresh->object;
     }
     return object;
   }
 
+  template <typename ObjectType>
+  template <typename UpdateFunc>
+  inline ObjectType* ptr<ObjectType>::update_move(UpdateFunc&& func) {
+    static_assert(detail::uses_static_control_block<ObjectType>,
+                  "update_move() builds an object of the static type; use write() for polymorphic objects");
+    assert(object);
+    auto* c = control();
+    if (c->is_edit_stamped() || c->is_unique()) {
+      if constexpr (detail::has_memos<ObjectType>) {
+        c->clear_memos();
+      }
+      *object = std::forward<UpdateFunc>(func)(std::move(*object));
+      return object;
+    }
+    return update(std::forward<UpdateFunc>(func));
+  }
+
   template <typename ObjectType>
   template <typename StaticCastType>
   inline const StaticCastType* ptr<ObjectType>::read() const noexcept {
@@ -212,6 +302,8 @@ namespace cow {
   template <typename ObjectType>
   template <typename StaticCastType>
   inline ptr<StaticCastType> ptr<ObjectType>::cast() const noexcept {
+    static_assert(detail::is_same_block_layout<ObjectType, StaticCastType>,
+                  "non-polymorphic objects can only be referenced by a ptr of their exact type");
     if constexpr (std::is_polymorphic_v<StaticCastType>) {
       assert((void*)dynamic_cast<StaticCastType*>(object) == (void*)object);
     }
@@ -223,6 +315,8 @@ namespace cow {
   template <typename ObjectType>
   template <typename StaticCastType>
   inline ptr<StaticCastType> ptr<ObjectType>::move_cast() noexcept {
+    static_assert(detail::is_same_block_layout<ObjectType, StaticCastType>,
+                  "non-polymorphic objects can only be referenced by a ptr of their exact type");
     if constexpr (std::is_polymorphic_v<StaticCastType>) {
       assert((void*)dynamic_cast<StaticCastType*>(object) == (void*)object);
     }
@@ -258,12 +352,20 @@ namespace cow {
 
   template <typename ObjectType>
   inline size_t ptr<ObjectType>::use_count() const noexcept {
-    return object ? control()->refCount.load(std::memory_order_relaxed) : 0;
+    return object ? control()->use_count() : 0;
   }
 
   template <typename ObjectType>
   inline const std::type_info& ptr<ObjectType>::type_info() const noexcept {
-    return object ? control()->type_info() : typeid(nullptr);
+    if (!object) {
+      return typeid(nullptr);
+    }
+    if constexpr (detail::uses_static_control_block<ObjectType>) {
+      return control()->type_info();
+    } else {
+      const detail::polymorphic_control_block* from = control();
+      return from->type_info();
+    }
   }
 
   template <typename ObjectType>
@@ -272,9 +374,20 @@ namespace cow {
 
   template<typename ObjectType, typename... ObjectContructorArgTypes>
   inline ptr<ObjectType> make(ObjectContructorArgTypes&&... objectConstructorArgs) {
-    auto* const control_block = new detail::control_block_with_object<ObjectType>(std::forward<ObjectContructorArgTypes>(objectConstructorArgs)...);
-    ObjectType* object = &control_block->object;
-    return ptr<ObjectType>(object);
+    return allocate_make<ObjectType>(default_pool(), std::forward<ObjectContructorArgTypes>(objectConstructorArgs)...);
+  }
+
+  template<typename ObjectType, typename... ObjectContructorArgTypes>
+  inline ptr<ObjectType> allocate_make(block_pool& pool, ObjectContructorArgTypes&&... objectConstructorArgs) {
+    return allocate_make<ObjectType>(pool, block_flags::none, std::forward<ObjectContructorArgTypes>(objectConstructorArgs)...);
+  }
+
+  template<typename ObjectType, typename... ObjectContructorArgTypes>
+  inline ptr<ObjectType> allocate_make(block_pool& pool, block_flags flags, ObjectContructorArgTypes&&... objectConstructorArgs) {
+    auto* const control_block = detail::create_block<detail::control_block_with_object<ObjectType>>(
+      detail::state_of(pool), detail::control_block::word_flags(flags),
+      std::forward<ObjectContructorArgTypes>(objectConstructorArgs)...);
+    return detail::ptr_access::adopt(&control_block->object);
   }
 
   template<typename ObjectType1, typename ObjectType2>
@@ -304,22 +417,22 @@ namespace cow {
 
   template <typename DestType, typename SourceType>
   ptr<DestType> static_pointer_cast(const ptr<SourceType>& src) {
-    return src.cast<DestType>();
+    return src.template cast<DestType>();
   }
   
   template <typename DestType, typename SourceType>
   ptr<DestType> static_pointer_cast(ptr<SourceType>&& src) {
-    return src.move_cast<DestType>();
+    return src.template move_cast<DestType>();
   }
   
   template <typename DestType, typename SourceType>
   ptr<DestType> dynamic_pointer_cast(const ptr<SourceType>& src) {
-    return src.dynamic<DestType>();
+    return src.template dynamic<DestType>();
   }
   
   template <typename DestType, typename SourceType>
   ptr<DestType> dynamic_pointer_cast(ptr<SourceType>&& src) {
-    return src.move_dynamic<DestType>();
+    return src.template move_dynamic<DestType>();
   }
   }
 
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "cow/ref.h"
+
+#include <assert.h>
+
+namespace cow {
+
+template <typename ObjectType>
+inline ref<ObjectType>::ref(std::nullptr_t) noexcept : object(nullptr) {}
+
+template <typename ObjectType>
+inline ref<ObjectType>::ref(const ptr<ObjectType>& owner) noexcept
+    : object(const_cast<ObjectType*>(owner.get())) {}
+
+template <typename ObjectType>
+template <typename DerivedType,
+          std::enable_if_t<std::is_convertible_v<DerivedType*, ObjectType*> &&
+                               detail::is_same_block_layout<DerivedType, ObjectType>,
+                           int>>
+inline ref<ObjectType>::ref(const ref<DerivedType>& other) noexcept : object(other.object) {
+  assert((void*)object == (void*)other.object);  // control blocks must match
+}
+
+template <typename ObjectType>
+template <typename DerivedType,
+          std::enable_if_t<std::is_convertible_v<DerivedType*, ObjectType*> &&
+                               detail::is_same_block_layout<DerivedType, ObjectType>,
+                           int>>
+inline ref<ObjectType>::ref(const ptr<DerivedType>& owner) noexcept
+    : ref(ref<DerivedType>(owner)) {}
+
+template <typename ObjectType>
+inline ref<ObjectType>::ref(ObjectType* objectPtr) noexcept : object(objectPtr) {}
+
+template <typename ObjectType>
+inline ref<ObjectType>::operator bool() const noexcept {
+  return object != nullptr;
+}
+
+template <typename ObjectType>
+inline const ObjectType& ref<ObjectType>::operator*() const noexcept {
+  assert(object);
+  return *object;
+}
+
+template <typename ObjectType>
+inline const ObjectType* ref<ObjectType>::operator->() const noexcept {
+  assert(object);
+  return object;
+}
+
+template <typename ObjectType>
+inline const ObjectType* ref<ObjectType>::get() const noexcept {
+  return object;
+}
+
+template <typename ObjectType>
+inline ptr<ObjectType> ref<ObjectType>::own() const noexcept {
+  if (!object) {
+    return nullptr;
+  }
+  detail::ptr_access::control_of(object)->incRef();
+  return detail::ptr_access::adopt(object);
+}
+
+template <typename ObjectType>
+inline size_t ref<ObjectType>::use_count() const noexcept {
+  return object ? detail::ptr_access::control_of(object)->use_count() : 0;
+}
+
+template <typename ObjectType1, typename ObjectType2>
+inline bool operator==(const ref<ObjectType1>& ref1, const ref<ObjectType2>& ref2) noexcept {
+  return ref1.get() == ref2.get();
+}
+
+template <typename ObjectType1, typename ObjectType2>
+inline bool operator==(const ref<ObjectType1>& ref1, const ptr<ObjectType2>& ptr2) noexcept {
+  return ref1.get() == ptr2.get();
+}
+
+template <typename ObjectType>
+inline bool operator==(const ref<ObjectType>& ref1, std::nullptr_t) noexcept {
+  return ref1.get() == nullptr;
+}
+
+}  // namespace cow
@@ -0,0 +1,191 @@
+#pragma once
+
+#include "cow/snapshot.h"
+
+#include <assert.h>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <typeinfo>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace cow {
+
+namespace detail {
+template <typename T>
+concept has_snapshot_children = requires(const T& node) {
+  cow_for_each_child(node, [](const ptr<T>&) {});
+};
+
+// Writes a snapshot file front to back: the roots, then the blocks in the
+// order they were numbered, then the table of pointers to fix up if the
+// file can't be mapped where it was meant to be, then the header over the
+// start. It's written beside path and renamed over it by finish(), or
+// removed if the writer goes away before then. Defined in snapshot.cpp.
+class snapshot_writer {
+ public:
+  snapshot_writer(const std::string& path, const snapshot_layout& layout, size_t rootCount,
+                  size_t blockCount);
+  ~snapshot_writer();
+
+  snapshot_writer(const snapshot_writer&) = delete;
+  snapshot_writer& operator=(const snapshot_writer&) = delete;
+
+  // Where the object of the index-th block will be once the file is mapped.
+  uintptr_t object_address(size_t index) const noexcept;
+
+  // Takes an object_address(), or 0 for a null root.
+  void write_root(uintptr_t object);
+
+  // image is a copy of the block with its children's addresses filled in,
+  // and slots the offsets in it of the children that aren't null.
+  void write_block(const void* image, const std::vector<size_t>& slots);
+
+  void finish();
+
+ private:
+  void write(const void* bytes, size_t size);
+  void pad_to(uint64_t offset);
+
+  std::FILE* file;
+  std::string path;
+  snapshot_layout layout;
+  uintptr_t base;
+  size_t rootCount;
+  size_t blockCount;
+  uint64_t rootsOffset;
+  uint64_t blocksOffset;
+  uint64_t position{0};
+  size_t rootsWritten{0};
+  size_t blocksWritten{0};
+  std::vector<uint64_t> relocations;
+};
+
+// Maps a snapshot file written for layout. Defined in snapshot.cpp.
+snapshot_mapping map_snapshot(const std::string& path, const snapshot_layout& layout);
+void unmap_snapshot(const snapshot_mapping& mapping) noexcept;
+
+uint64_t snapshot_type_hash(const char* name) noexcept;
+
+template <typename T>
+snapshot_layout snapshot_layout_of() noexcept {
+  using block = control_block_with_object<T>;
+  return {snapshot_type_hash(typeid(T).name()), sizeof(block), alignof(block), object_offset<T>};
+}
+}  // namespace detail
+
+template <typename T>
+inline void save_snapshot(const std::string& path, std::span<const ptr<T>> roots) {
+  static_assert(detail::uses_static_control_block<T>,
+                "only non-polymorphic types can be saved in a snapshot");
+  static_assert(!detail::has_memos<T>, "types with memos can't be saved in a snapshot");
+  static_assert(detail::has_snapshot_children<T>,
+                "a snapshot finds a node's children with cow_for_each_child()");
+  static_assert(sizeof(ptr<T>) == sizeof(uintptr_t) &&
+                sizeof(std::atomic<size_t>) == sizeof(size_t));
+
+  using block = detail::control_block_with_object<T>;
+
+  // Number each distinct node the first time it's reached, so parents come
+  // before their children and shared nodes are only numbered once.
+  std::unordered_map<const T*, size_t> indexOf;
+  std::vector<const T*> nodes;
+  std::vector<const T*> pending;
+  const auto reach = [&](const ptr<T>& node) {
+    if (node && indexOf.emplace(node.get(), nodes.size()).second) {
+      nodes.push_back(node.get());
+      pending.push_back(node.get());
+    }
+  };
+  for (const ptr<T>& root : roots) {
+    reach(root);
+  }
+  while (!pending.empty()) {
+    const T* const node = pending.back();
+    pending.pop_back();
+    cow_for_each_child(*node, reach);
+  }
+
+  const detail::snapshot_layout layout = detail::snapshot_layout_of<T>();
+  detail::snapshot_writer out(path, layout, roots.size(), nodes.size());
+  for (const ptr<T>& root : roots) {
+    out.write_root(root ? out.object_address(indexOf.find(root.get())->second) : 0);
+  }
+
+  const size_t word = detail::control_block::immortal_flag | 1;
+  std::vector<unsigned char> image(sizeof(block));
+  std::vector<size_t> slots;
+  for (const T* const node : nodes) {
+    const block* const from = detail::ptr_access::control_of(const_cast<T*>(node));
+    std::memcpy(image.data(), static_cast<const void*>(from), sizeof(block));
+    const size_t wordOffset = size_t(reinterpret_cast<const char*>(&from->refCount) -
+                                     reinterpret_cast<const char*>(from));
+    std::memcpy(image.data() + wordOffset, &word, sizeof(word));
+
+    slots.clear();
+    cow_for_each_child(*node, [&](const ptr<T>& child) {
+      const size_t at = layout.objectOffset + size_t(reinterpret_cast<const char*>(&child) -
+                                                     reinterpret_cast<const char*>(node));
+      assert(at + sizeof(uintptr_t) <= sizeof(block));  // children must be inside the node
+      const uintptr_t address = child ? out.object_address(indexOf.find(child.get())->second) : 0;
+      std::memcpy(image.data() + at, &address, sizeof(address));
+      if (child) {
+        slots.push_back(at);
+      }
+    });
+    out.write_block(image.data(), slots);
+  }
+  out.finish();
+}
+
+template <typename T>
+inline void save_snapshot(const std::string& path, const ptr<T>& root) {
+  save_snapshot(path, std::span<const ptr<T>>(&root, 1));
+}
+
+template <typename T>
+inline snapshot<T>::snapshot(const std::string& path)
+    : mapping(detail::map_snapshot(path, detail::snapshot_layout_of<T>())) {}
+
+template <typename T>
+inline snapshot<T>::~snapshot() {
+  detail::unmap_snapshot(mapping);
+}
+
+template <typename T>
+inline snapshot<T>::snapshot(snapshot&& other) noexcept
+    : mapping(std::exchange(other.mapping, detail::snapshot_mapping{})) {}
+
+template <typename T>
+inline snapshot<T>& snapshot<T>::operator=(snapshot&& other) noexcept {
+  if (this != &other) {
+    detail::unmap_snapshot(mapping);
+    mapping = std::exchange(other.mapping, detail::snapshot_mapping{});
+  }
+  return *this;
+}
+
+template <typename T>
+inline std::span<const ptr<T>> snapshot<T>::roots() const noexcept {
+  return {static_cast<const ptr<T>*>(mapping.roots), mapping.rootCount};
+}
+
+template <typename T>
+inline const ptr<T>& snapshot<T>::root(size_t index) const noexcept {
+  assert(index < mapping.rootCount);
+  return roots()[index];
+}
+
+template <typename T>
+inline size_t snapshot<T>::node_count() const noexcept {
+  return mapping.nodeCount;
+}
+
+template <typename T>
+inline bool snapshot<T>::relocated() const noexcept {
+  return mapping.relocated;
+}
+
+}  // namespace cow
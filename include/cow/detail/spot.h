@@ -64,6 +64,11 @@ inline size_t spot<ObjectType>::use_count() const noexcept {
   return here ? here->use_count() : 0;
 }
 
+template <typename ObjectType>
+inline ref<ObjectType> spot<ObjectType>::borrow() const noexcept {
+  return here ? ref<ObjectType>(*here) : nullptr;
+}
+
 template <typename FromObjectType>
 template <typename StepFunc>
 auto spot<FromObjectType>::step(StepFunc&& func) noexcept {
@@ -88,7 +93,7 @@ offset_spot<FromObjectType, ToObjectType> spot<FromObjectType>::step(
 //
 
 template <typename ObjectType>
-inline root_spot<ObjectType>::root_spot() noexcept : spot(nullptr) {}
+inline root_spot<ObjectType>::root_spot() noexcept : spot<ObjectType>(nullptr) {}
 
 template <typename ObjectType>
 inline root_spot<ObjectType>::root_spot(ptr<ObjectType>* where) noexcept
@@ -97,9 +102,10 @@ inline root_spot<ObjectType>::root_spot(ptr<ObjectType>* where) noexcept
 template <typename ObjectType>
 inline root_spot<ObjectType>& root_spot<ObjectType>::operator=(
     root_spot&& other) noexcept {
-  if (this != other) {
+  if (this != &other) {
     spot<ObjectType>::operator=(std::move(other));
   }
+  return *this;
 }
 
 template <typename ObjectType>
@@ -184,7 +190,7 @@ inline lambda_spot<FromObjectType, ToObjectType, StepFunc>&
 lambda_spot<FromObjectType, ToObjectType, StepFunc>::operator=(
     lambda_spot&& other) noexcept {
   if (this != &other) {
-    next_spot::operator=(std::move(other));
+    next_spot<FromObjectType, ToObjectType>::operator=(std::move(other));
     stepFunc = std::move(other.stepFunc);
   }
   return *this;
@@ -227,10 +233,11 @@ template <typename FromObjectType, typename ToObjectType>
 inline offset_spot<FromObjectType, ToObjectType>&
 offset_spot<FromObjectType, ToObjectType>::operator=(
     offset_spot&& other) noexcept {
-  if (this != other) {
-    next_spot::operator=(std::move(other));
+  if (this != &other) {
+    next_spot<FromObjectType, ToObjectType>::operator=(std::move(other));
     offset = other.offset;
   }
+  return *this;
 }
 
 }  // namespace cow
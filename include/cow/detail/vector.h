@@ -0,0 +1,537 @@
+#pragma once
+
+#include "cow/vector.h"
+
+#include <algorithm>
+#include <cassert>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace cow {
+
+namespace detail {
+
+// The children of a branch are all chunks if it's on the bottom level of
+// the trie, and all branches otherwise. It keeps them in a union, and
+// remembers which side is live so copies and destruction only touch that
+// one. Neither kind of node needs a vtable.
+template <typename T>
+class vector_branch {
+ public:
+  explicit vector_branch(bool overChunks) noexcept : overChunks(overChunks) {
+    if (overChunks) {
+      std::uninitialized_default_construct_n(chunkSlots, vector_width);
+    } else {
+      std::uninitialized_default_construct_n(branchSlots, vector_width);
+    }
+  }
+
+  vector_branch(const vector_branch& other) noexcept : overChunks(other.overChunks) {
+    if (overChunks) {
+      std::uninitialized_copy_n(other.chunkSlots, vector_width, chunkSlots);
+    } else {
+      std::uninitialized_copy_n(other.branchSlots, vector_width, branchSlots);
+    }
+  }
+
+  vector_branch& operator=(const vector_branch&) = delete;
+
+  ~vector_branch() {
+    if (overChunks) {
+      std::destroy_n(chunkSlots, vector_width);
+    } else {
+      std::destroy_n(branchSlots, vector_width);
+    }
+  }
+
+  const ptr<vector_branch>* branches() const noexcept {
+    assert(!overChunks);
+    return branchSlots;
+  }
+
+  ptr<vector_branch>* branches() noexcept {
+    assert(!overChunks);
+    return branchSlots;
+  }
+
+  const ptr<vector_chunk<T>>* chunks() const noexcept {
+    assert(overChunks);
+    return chunkSlots;
+  }
+
+  ptr<vector_chunk<T>>* chunks() noexcept {
+    assert(overChunks);
+    return chunkSlots;
+  }
+
+ private:
+  bool overChunks;
+  union {
+    ptr<vector_branch> branchSlots[vector_width];
+    ptr<vector_chunk<T>> chunkSlots[vector_width];
+  };
+};
+
+// Up to vector_width elements, constructed in order.
+template <typename T>
+class vector_chunk {
+ public:
+  vector_chunk() noexcept = default;
+
+  vector_chunk(const vector_chunk& other) {
+    try {
+      for (; filled < other.filled; ++filled) {
+        ::new (static_cast<void*>(storage + filled * sizeof(T)))
+            T(other.data()[filled]);
+      }
+    } catch (...) {
+      std::destroy_n(data(), filled);
+      throw;
+    }
+  }
+
+  vector_chunk& operator=(const vector_chunk&) = delete;
+
+  ~vector_chunk() { std::destroy_n(data(), filled); }
+
+  size_t size() const noexcept { return filled; }
+
+  const T* data() const noexcept {
+    return std::launder(reinterpret_cast<const T*>(storage));
+  }
+
+  T* data() noexcept { return std::launder(reinterpret_cast<T*>(storage)); }
+
+  template <typename... ArgTypes>
+  T& emplace_back(ArgTypes&&... args) {
+    assert(filled < vector_width);
+    T* placed = ::new (static_cast<void*>(storage + filled * sizeof(T)))
+        T(std::forward<ArgTypes>(args)...);
+    ++filled;
+    return *placed;
+  }
+
+  void pop_back() noexcept {
+    assert(filled > 0);
+    data()[--filled].~T();
+  }
+
+ private:
+  size_t filled{0};
+  alignas(T) std::byte storage[sizeof(T) * vector_width];
+};
+
+}  // namespace detail
+
+template <typename T>
+inline vector<T>::vector(std::initializer_list<T> values)
+    : vector(from_range(values)) {}
+
+template <typename T>
+template <typename Range>
+inline vector<T> vector<T>::from_range(Range&& values) {
+  vector result;
+  std::vector<ptr<chunk>> chunks;
+  ptr<chunk> filling;
+  chunk* fill = nullptr;
+  for (auto&& value : values) {
+    if (!fill || fill->size() == detail::vector_width) {
+      if (fill) {
+        chunks.push_back(std::move(filling));
+      }
+      filling = make<chunk>();
+      fill = filling.write();
+    }
+    fill->emplace_back(std::forward<decltype(value)>(value));
+    ++result.count;
+  }
+  result.tail = std::move(filling);
+
+  // Every chunk but the tail is full, so each level is just the one below
+  // cut into groups of vector_width.
+  if (!chunks.empty()) {
+    std::vector<ptr<branch>> level = group(chunks);
+    while (level.size() > 1) {
+      level = group(level);
+      result.shift += detail::vector_bits;
+    }
+    result.root = std::move(level.front());
+  }
+  return result;
+}
+
+// Puts children under new branches, vector_width at a time.
+template <typename T>
+template <typename Child>
+inline auto vector<T>::group(std::vector<ptr<Child>>& children)
+    -> std::vector<ptr<branch>> {
+  constexpr bool overChunks = std::is_same_v<Child, chunk>;
+  std::vector<ptr<branch>> parents;
+  parents.reserve((children.size() + detail::vector_mask) / detail::vector_width);
+  for (size_t i = 0; i < children.size(); i += detail::vector_width) {
+    ptr<branch> parent = make<branch>(overChunks);
+    ptr<Child>* slots;
+    if constexpr (overChunks) {
+      slots = parent.write()->chunks();
+    } else {
+      slots = parent.write()->branches();
+    }
+    for (size_t j = 0; j < detail::vector_width && i + j < children.size(); ++j) {
+      slots[j] = std::move(children[i + j]);
+    }
+    parents.push_back(std::move(parent));
+  }
+  return parents;
+}
+
+template <typename T>
+inline size_t vector<T>::size() const noexcept {
+  return count;
+}
+
+template <typename T>
+inline bool vector<T>::empty() const noexcept {
+  return count == 0;
+}
+
+template <typename T>
+inline const T& vector<T>::operator[](size_t index) const noexcept {
+  assert(index < count);
+  return chunk_for(index)->data()[index & detail::vector_mask];
+}
+
+template <typename T>
+inline const T& vector<T>::front() const noexcept {
+  return (*this)[0];
+}
+
+template <typename T>
+inline const T& vector<T>::back() const noexcept {
+  assert(count > 0);
+  return tail->data()[tail->size() - 1];
+}
+
+template <typename T>
+inline T& vector<T>::write(size_t index) {
+  assert(index < count);
+  if (index >= tail_offset()) {
+    return tail.write()->data()[index & detail::vector_mask];
+  }
+  ptr<branch>* where = &root;
+  for (unsigned level = shift; level > detail::vector_bits;
+       level -= detail::vector_bits) {
+    where = &where->write()->branches()[(index >> level) & detail::vector_mask];
+  }
+  ptr<chunk>& leaf =
+      where->write()->chunks()[(index >> detail::vector_bits) & detail::vector_mask];
+  return leaf.write()->data()[index & detail::vector_mask];
+}
+
+template <typename T>
+inline void vector<T>::set(size_t index, T value) {
+  write(index) = std::move(value);
+}
+
+template <typename T>
+inline void vector<T>::push_back(T value) {
+  emplace_back(std::move(value));
+}
+
+template <typename T>
+template <typename... ArgTypes>
+inline T& vector<T>::emplace_back(ArgTypes&&... args) {
+  if (count > 0 && tail->size() < detail::vector_width) {
+    T& placed = tail.write()->emplace_back(std::forward<ArgTypes>(args)...);
+    ++count;
+    return placed;
+  }
+
+  // The element goes in a fresh chunk first, so a throwing constructor
+  // leaves the vector as it was.
+  ptr<chunk> fresh = make<chunk>();
+  T& placed = fresh.write()->emplace_back(std::forward<ArgTypes>(args)...);
+  if (count > 0) {
+    push_tail();
+  }
+  tail = std::move(fresh);
+  ++count;
+  return placed;
+}
+
+template <typename T>
+inline void vector<T>::pop_back() {
+  assert(count > 0);
+  if (tail->size() > 1) {
+    tail.write()->pop_back();
+    --count;
+    return;
+  }
+  if (count == 1) {
+    clear();
+    return;
+  }
+
+  // The trie's last chunk becomes the tail.
+  const size_t leafIndex = count - 1 - detail::vector_width;
+  const branch* at = root.get();
+  for (unsigned level = shift; level > detail::vector_bits;
+       level -= detail::vector_bits) {
+    at = at->branches()[(leafIndex >> level) & detail::vector_mask].get();
+  }
+  tail = at->chunks()[(leafIndex >> detail::vector_bits) & detail::vector_mask];
+  --count;
+
+  if (pop_leaf(root, shift, leafIndex)) {
+    root = nullptr;
+  } else if (shift > detail::vector_bits && !root->branches()[1]) {
+    ptr<branch> only = root->branches()[0];
+    root = std::move(only);
+    shift -= detail::vector_bits;
+  }
+}
+
+template <typename T>
+inline void vector<T>::clear() noexcept {
+  count = 0;
+  shift = detail::vector_bits;
+  root = nullptr;
+  tail = nullptr;
+}
+
+template <typename T>
+template <typename ChunkFunc>
+inline void vector<T>::for_each_chunk(ChunkFunc&& func) const {
+  if (root) {
+    visit(root.get(), shift, func);
+  }
+  if (tail) {
+    func(tail->data(), tail->size());
+  }
+}
+
+template <typename T>
+inline typename vector<T>::const_iterator vector<T>::begin() const noexcept {
+  return const_iterator(this, 0);
+}
+
+template <typename T>
+inline typename vector<T>::const_iterator vector<T>::end() const noexcept {
+  return const_iterator(this, count);
+}
+
+// Elements before this are in the trie, and the rest in the tail. The tail
+// is never empty unless the vector is, so a full tail stays out of the
+// trie until the next push.
+template <typename T>
+inline size_t vector<T>::tail_offset() const noexcept {
+  return count == 0 ? 0 : (count - 1) & ~detail::vector_mask;
+}
+
+template <typename T>
+inline auto vector<T>::chunk_for(size_t index) const noexcept -> const chunk* {
+  if (index >= tail_offset()) {
+    return tail.get();
+  }
+  const branch* at = root.get();
+  for (unsigned level = shift; level > detail::vector_bits;
+       level -= detail::vector_bits) {
+    at = at->branches()[(index >> level) & detail::vector_mask].get();
+  }
+  return at->chunks()[(index >> detail::vector_bits) & detail::vector_mask].get();
+}
+
+// Moves the full tail into the trie, adding a level on top if the trie is
+// full. The caller replaces the tail.
+template <typename T>
+inline void vector<T>::push_tail() {
+  const size_t leafIndex = count - detail::vector_width;
+  if ((leafIndex >> detail::vector_bits) >= (size_t(1) << shift)) {
+    ptr<branch> grown = make<branch>(false);
+    grown.write()->branches()[0] = std::move(root);
+    root = std::move(grown);
+    shift += detail::vector_bits;
+  }
+
+  ptr<branch>* where = &root;
+  for (unsigned level = shift; level > detail::vector_bits;
+       level -= detail::vector_bits) {
+    if (!*where) {
+      *where = make<branch>(false);
+    }
+    where = &where->write()->branches()[(leafIndex >> level) & detail::vector_mask];
+  }
+  if (!*where) {
+    *where = make<branch>(true);
+  }
+  where->write()->chunks()[(leafIndex >> detail::vector_bits) & detail::vector_mask] = tail;
+}
+
+// Removes the chunk at leafIndex, the last one, from below where. Returns
+// whether that left where empty, in which case the caller drops it.
+template <typename T>
+inline bool vector<T>::pop_leaf(ptr<branch>& where, unsigned level,
+                                size_t leafIndex) {
+  branch* children = where.write();
+  const size_t slot = (leafIndex >> level) & detail::vector_mask;
+  if (level == detail::vector_bits) {
+    children->chunks()[slot] = nullptr;
+    return slot == 0;
+  }
+  if (pop_leaf(children->branches()[slot], level - detail::vector_bits, leafIndex)) {
+    children->branches()[slot] = nullptr;
+  }
+  return slot == 0 && !children->branches()[0];
+}
+
+template <typename T>
+template <typename ChunkFunc>
+inline void vector<T>::visit(const branch* from, unsigned level,
+                             ChunkFunc& func) {
+  for (size_t i = 0; i < detail::vector_width; ++i) {
+    if (level == detail::vector_bits) {
+      const chunk* leaf = from->chunks()[i].get();
+      if (!leaf) {
+        break;
+      }
+      func(leaf->data(), leaf->size());
+    } else {
+      const branch* child = from->branches()[i].get();
+      if (!child) {
+        break;
+      }
+      visit(child, level - detail::vector_bits, func);
+    }
+  }
+}
+
+// Both tries hold full chunks up to their tail offsets, so those are
+// compared node by node and the rest, which is the tails and whatever one
+// has past the other's end, element by element.
+template <typename T>
+template <typename Visitor>
+inline void vector<T>::diff(const vector& after, Visitor&& visitor) const {
+  const size_t shared = std::min(tail_offset(), after.tail_offset());
+  if (shared > 0) {
+    diff_nodes(root.get(), shift, after.root.get(), after.shift,
+               std::max(shift, after.shift), 0, shared, visitor);
+  }
+  const size_t common = std::min(count, after.count);
+  for (size_t i = shared; i < common; ++i) {
+    if (!detail::diff_same((*this)[i], after[i])) {
+      visitor.changed(i, (*this)[i], after[i]);
+    }
+  }
+  for (size_t i = common; i < count; ++i) {
+    visitor.removed(i, (*this)[i]);
+  }
+  for (size_t i = common; i < after.count; ++i) {
+    visitor.added(i, after[i]);
+  }
+}
+
+// Compares the elements in [base, limit) under before and after, which
+// each cover the vector_width << level elements from base. A trie that's
+// shorter than the other is treated as the first child of a chain of
+// branches, so a side whose shift is below level is its own first child.
+template <typename T>
+template <typename Visitor>
+inline void vector<T>::diff_nodes(const branch* before, unsigned beforeShift,
+                                  const branch* after, unsigned afterShift,
+                                  unsigned level, size_t base, size_t limit,
+                                  Visitor& visitor) {
+  if (before == after) {
+    return;
+  }
+  const size_t span = size_t(1) << level;
+  if (level == detail::vector_bits) {
+    for (size_t i = 0; i < detail::vector_width && base + i * span < limit; ++i) {
+      diff_chunks(before->chunks()[i].get(), after->chunks()[i].get(),
+                  base + i * span, limit, visitor);
+    }
+    return;
+  }
+  auto child = [level](const branch* from, unsigned fromShift, size_t slot) {
+    if (fromShift < level) {
+      assert(slot == 0);
+      return from;
+    }
+    return from->branches()[slot].get();
+  };
+  const unsigned below = level - detail::vector_bits;
+  for (size_t i = 0; i < detail::vector_width && base + i * span < limit; ++i) {
+    diff_nodes(child(before, beforeShift, i), std::min(beforeShift, below),
+               child(after, afterShift, i), std::min(afterShift, below), below,
+               base + i * span, limit, visitor);
+  }
+}
+
+template <typename T>
+template <typename Visitor>
+inline void vector<T>::diff_chunks(const chunk* before, const chunk* after,
+                                   size_t base, size_t limit,
+                                   Visitor& visitor) {
+  if (before == after) {
+    return;
+  }
+  const T* was = before->data();
+  const T* now = after->data();
+  for (size_t i = 0; i < detail::vector_width && base + i < limit; ++i) {
+    if (!detail::diff_same(was[i], now[i])) {
+      visitor.changed(base + i, was[i], now[i]);
+    }
+  }
+}
+
+template <typename T>
+inline vector<T>::const_iterator::const_iterator(const vector* from,
+                                                 size_t at) noexcept
+    : owner(from),
+      index(at),
+      data(at < from->count ? from->chunk_for(at)->data() : nullptr) {}
+
+template <typename T>
+inline auto vector<T>::const_iterator::operator*() const noexcept
+    -> reference {
+  return data[index & detail::vector_mask];
+}
+
+template <typename T>
+inline auto vector<T>::const_iterator::operator->() const noexcept
+    -> pointer {
+  return data + (index & detail::vector_mask);
+}
+
+template <typename T>
+inline auto vector<T>::const_iterator::operator++() noexcept
+    -> const_iterator& {
+  ++index;
+  if ((index & detail::vector_mask) == 0) {
+    data = index < owner->count ? owner->chunk_for(index)->data() : nullptr;
+  }
+  return *this;
+}
+
+template <typename T>
+inline auto vector<T>::const_iterator::operator++(int) noexcept
+    -> const_iterator {
+  const_iterator before = *this;
+  ++*this;
+  return before;
+}
+
+template <typename T>
+inline bool vector<T>::const_iterator::operator==(
+    const const_iterator& other) const noexcept {
+  return owner == other.owner && index == other.index;
+}
+
+template <typename T>
+inline bool vector<T>::const_iterator::operator!=(
+    const const_iterator& other) const noexcept {
+  return !(*this == other);
+}
+
+}  // namespace cow
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "cow/ptr.h"
+
+#include <concepts>
+
+namespace cow {
+
+namespace detail {
+// Whether two values a diff found in different nodes are the same, so it
+// needn't report them. Values without == are taken to differ.
+template <typename T>
+inline bool diff_same(const T& before, const T& after) {
+  if constexpr (std::equality_comparable<T>) {
+    return before == after;
+  } else {
+    return false;
+  }
+}
+
+template <typename T>
+concept has_diff_children = requires(const T& node) {
+  cow_for_each_child(node, [](const ptr<T>&) {});
+};
+}  // namespace detail
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// diff
+//
+// Reports what changed between two versions of a tree of cow::ptr nodes.
+// Equal ptrs are the same node, so whatever the two versions share is
+// skipped without looking inside, and the cost is in proportion to the
+// nodes on the paths that were copied, not to the size of the tree.
+//
+//   cow::diff(snapshot, current, visitor);
+//
+// The visitor gets:
+//
+//   visitor.added(const ptr<T>& node)     a subtree only in after
+//   visitor.removed(const ptr<T>& node)   a subtree only in before
+//   visitor.changed(const ptr<T>& before, const ptr<T>& after)
+//
+// changed() is for two different nodes in the same place, and their
+// children are compared after it. A node type says what its children are
+// with a function found by argument-dependent lookup:
+//
+//   template <typename Func>
+//   void cow_for_each_child(const tree& node, Func&& func);
+//
+// which calls func(const ptr<tree>&) for each child slot, null ones
+// included, in a fixed order; the i-th slots of the two versions are
+// compared with each other. A type without one is compared as a leaf.
+//
+// The containers each have a keyed diff, reached with the same call:
+//
+//   cow::diff(mapBefore, mapAfter, visitor);
+//
+// which calls visitor.added(key, value), visitor.removed(key, value) and
+// visitor.changed(key, before, after), with indices as the keys of a
+// vector. Values in copied nodes that still compare equal aren't reported.
+//
+
+template <typename T, typename Visitor>
+void diff(const ptr<T>& before, const ptr<T>& after, Visitor&& visitor);
+
+template <typename Container, typename Visitor>
+  requires requires(const Container& from, Visitor& visitor) {
+    from.diff(from, visitor);
+  }
+void diff(const Container& before, const Container& after, Visitor&& visitor);
+
+}  // namespace cow
+
+#include "cow/detail/diff.h"
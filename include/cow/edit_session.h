@@ -0,0 +1,43 @@
+#pragma once
+
+#include "cow/ptr.h"
+
+#include <cstddef>
+
+namespace cow {
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// edit_session
+//
+// A transient, in the Clojure sense. Every block made or cloned on this
+// thread while the session is active is stamped with the session's token,
+// and ptr::write() on a block carrying the current token goes straight to
+// the object without looking at the count. Copying a ptr to a stamped block
+// clears its stamp, so a stamped block has never had more than the one
+// reference and the shortcut can't write into anything shared.
+//
+// Ending the session retires its token, which freezes everything it made
+// back into ordinary persistent nodes without touching them. Sessions nest;
+// the inner one gets a fresh token and the outer one's nodes take the normal
+// path until it's current again.
+//
+// The token is a few bits of the refcount word and is reused after a
+// handful of sessions, which is harmless: any stamped block is unique. For
+// bulk loads, pair a session with a cow::local_scope so the counts
+// themselves aren't atomic either.
+//
+
+class edit_session {
+ public:
+  edit_session() noexcept;
+  ~edit_session();
+
+  edit_session(const edit_session&) = delete;
+  edit_session& operator=(const edit_session&) = delete;
+
+ private:
+  size_t outerStamp;
+};
+
+}  // namespace cow
@@ -0,0 +1,179 @@
+#pragma once
+
+#include "cow/diff.h"
+#include "cow/ptr.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <limits>
+#include <utility>
+
+namespace cow {
+
+namespace detail {
+// Each level of the trie uses hash_map_bits bits of the hash. Once they're
+// all used up, the remaining keys have equal hashes and share a collision
+// node.
+inline constexpr unsigned hash_map_bits = 5;
+inline constexpr unsigned hash_map_width = 1u << hash_map_bits;
+inline constexpr unsigned hash_map_hash_bits = std::numeric_limits<size_t>::digits;
+inline constexpr unsigned hash_map_max_depth =
+    (hash_map_hash_bits + hash_map_bits - 1) / hash_map_bits + 1;
+
+template <typename Key, typename Value>
+class hash_map_node;
+}  // namespace detail
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// hash_map
+//
+// A persistent hash map: copying one is O(1) and shares everything, and
+// changing a copy leaves the original alone.
+//
+//   cow::hash_map<std::string, int> a{{"x", 1}, {"y", 2}};
+//   cow::hash_map<std::string, int> b = a;
+//   b.insert_or_assign("x", 10);   // copies the few small nodes on the way
+//   assert(*a.find("x") == 1);     // down to "x", and nothing else
+//
+// It's a CHAMP trie (compressed hash-array mapped prefix tree) of cow::ptr
+// nodes, 32 ways per level. A node keeps two bitmaps, one for slots holding
+// an entry and one for slots holding a child, and two compact arrays
+// indexed by the popcount of the bits below a slot. Both arrays live in the
+// node itself, so copying a node on write is one allocation, and nodes
+// come in a few sizes so a sparse one stays small. Keys whose
+// whole hashes are equal end up in a chain of collision nodes at the
+// bottom, which is searched linearly.
+//
+// Erasing keeps the trie in its canonical shape: a child that's down to a
+// single entry is folded back into its parent, so two maps with the same
+// contents have the same shape and iterate in the same order.
+//
+
+template <typename Key,
+          typename Value,
+          typename Hash = std::hash<Key>,
+          typename KeyEqual = std::equal_to<Key>>
+class hash_map {
+ public:
+  using key_type = Key;
+  using mapped_type = Value;
+  using value_type = std::pair<Key, Value>;
+  using size_type = size_t;
+  using hasher = Hash;
+  using key_equal = KeyEqual;
+
+  class const_iterator;
+  using iterator = const_iterator;
+
+  hash_map() = default;
+  explicit hash_map(const Hash& hash, const KeyEqual& equal = KeyEqual());
+  hash_map(std::initializer_list<value_type> values, const Hash& hash = Hash(),
+           const KeyEqual& equal = KeyEqual());
+
+  hasher hash_function() const;
+  key_equal key_eq() const;
+
+  size_t size() const noexcept;
+  bool empty() const noexcept;
+
+  // The value for key, or nullptr if it isn't there.
+  const Value* find(const Key& key) const;
+  bool contains(const Key& key) const;
+
+  // A writable pointer to the value for key, after copying whatever is
+  // shared on the way down to it, or nullptr if key isn't there. Valid
+  // until this map is next changed.
+  Value* write(const Key& key);
+
+  // Adds key if it isn't already there. Returns whether it was added.
+  bool insert(Key key, Value value);
+
+  // Adds key, or replaces its value. Returns whether it was added.
+  bool insert_or_assign(Key key, Value value);
+
+  // Returns whether key was there.
+  bool erase(const Key& key);
+
+  void clear() noexcept;
+
+  const_iterator begin() const noexcept;
+  const_iterator end() const noexcept;
+
+  // Reports how after differs from this map, through
+  // visitor.added(key, value), visitor.removed(key, value) and
+  // visitor.changed(key, before, after). See cow::diff().
+  template <typename Visitor>
+  void diff(const hash_map& after, Visitor&& visitor) const;
+
+ private:
+  using node = detail::hash_map_node<Key, Value>;
+
+  size_t hash_of(const Key& key) const;
+  bool put(ptr<node>& where, unsigned shift, size_t hash, value_type&& entry,
+           bool assign);
+  static ptr<node> make_pair_node(unsigned shift,
+                                  value_type&& first, size_t firstHash,
+                                  value_type&& second, size_t secondHash);
+  void remove(ptr<node>& where, unsigned shift, size_t hash, const Key& key);
+  static value_type take_last(ptr<node>& where);
+  static node* make_room(ptr<node>& where);
+  static void shrink(ptr<node>& where);
+
+  template <typename Visitor>
+  void diff_nodes(const node* before, const node* after, unsigned shift,
+                  Visitor& visitor) const;
+  template <typename Visitor>
+  void diff_entry(const value_type& entry, const node* subtree,
+                  bool entryIsBefore, Visitor& visitor) const;
+
+  size_t count{0};
+  ptr<node> root;
+  [[no_unique_address]] Hash hashFunction;
+  [[no_unique_address]] KeyEqual keyEqual;
+};
+
+template <typename Key, typename Value, typename Hash, typename KeyEqual>
+class hash_map<Key, Value, Hash, KeyEqual>::const_iterator {
+ public:
+  using iterator_category = std::forward_iterator_tag;
+  using value_type = std::pair<Key, Value>;
+  using difference_type = std::ptrdiff_t;
+  using pointer = const value_type*;
+  using reference = const value_type&;
+
+  const_iterator() noexcept = default;
+
+  reference operator*() const noexcept;
+  pointer operator->() const noexcept;
+  const_iterator& operator++() noexcept;
+  const_iterator operator++(int) noexcept;
+
+  bool operator==(const const_iterator& other) const noexcept;
+  bool operator!=(const const_iterator& other) const noexcept;
+
+ private:
+  friend class hash_map;
+
+  // A node whose children are still to be visited, and the next one.
+  struct frame {
+    const node* at{nullptr};
+    size_t child{0};
+  };
+
+  explicit const_iterator(const node* root) noexcept;
+
+  void settle() noexcept;
+
+  frame stack[detail::hash_map_max_depth];
+  unsigned depth{0};
+  const node* current{nullptr};
+  size_t entry{0};
+};
+
+}  // namespace cow
+
+#include "cow/detail/hash_map.h"
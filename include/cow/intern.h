@@ -0,0 +1,63 @@
+#pragma once
+
+#include "cow/ptr.h"
+
+#include <cstddef>
+#include <functional>
+
+namespace cow {
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// intern
+//
+// Values that are built separately are never shared, even when they come
+// out equal: the same config block parsed twice is two blocks. intern()
+// looks a value up in a process-wide table and hands back the one block
+// already holding an equal value, if there is one, so the duplicate can be
+// let go.
+//
+//   cow::ptr<config> a = cow::intern(parse(text));
+//   cow::ptr<config> b = cow::intern(parse(text));
+//   assert(a == b);                    // the same block
+//
+// Values are looked up by Hash, std::hash<T> unless another is given, and
+// compared with T's ==. For trees, intern the children first and hash them
+// by address (p.get()); equal subtrees are then the same block, so hashing
+// and comparing a node never has to look below its own fields.
+//
+// The table only holds weak references. When the last ptr to an interned
+// block goes away the entry is dropped along with it, and an equal value
+// interned later starts a new one.
+//
+// An interned block is never written in place: write() always copies it,
+// and the copy isn't interned. So for two interned ptrs of the same type,
+// == on the ptrs is the same test as == on the values.
+//
+// Only for non-polymorphic types, and not inside a local_scope. A local or
+// biased block, or one in a mapped snapshot, is copied into a plain one
+// before it goes in the table.
+//
+
+struct intern_stats {
+  // Blocks currently in the table.
+  size_t entries{0};
+
+  // intern() calls that found an equal value already there, and the bytes
+  // of the blocks they could hand back instead, control blocks included.
+  size_t hits{0};
+  size_t bytes_saved{0};
+};
+
+template <typename T, typename Hash = std::hash<T>>
+ptr<T> intern(ptr<T> value, const Hash& hash = Hash{});
+
+// Whether value is the intern table's copy.
+template <typename T>
+bool is_interned(const ptr<T>& value) noexcept;
+
+intern_stats interned_stats() noexcept;
+
+}  // namespace cow
+
+#include "cow/detail/intern.h"
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "cow/ptr.h"
+
+#include <vector>
+
+namespace cow {
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// local_scope
+//
+// While a local_scope is active, every control block created on its thread
+// (by make(), allocate_make(), or a clone in ptr::write()) is refcounted with
+// plain loads and stores instead of atomic read-modify-writes. Building or
+// bulk-editing a structure on one thread then costs no lock-prefixed
+// instructions.
+//
+// Nothing created in the scope may be touched by another thread until it has
+// been published. publish() switches every live block the scope created over
+// to atomic refcounting, after which they're ordinary shared blocks. The
+// handoff to other threads still has to synchronize (a mutex, an atomic
+// store, starting the thread). The destructor publishes whatever is left.
+//
+// Debug builds assert if a local block is refcounted anywhere but in the
+// scope that created it. Only one local_scope can be active on a thread at a
+// time. On 32-bit targets there's no room in the refcount word to track local
+// blocks, and everything stays atomic.
+//
+
+class local_scope {
+ public:
+  local_scope() noexcept;
+  ~local_scope();
+
+  local_scope(const local_scope&) = delete;
+  local_scope& operator=(const local_scope&) = delete;
+
+  // Switch every live block created so far to atomic refcounting. The scope
+  // stays active, so blocks created afterwards are local again.
+  void publish() noexcept;
+
+  // Publishes, and hands back root, which must either have been created in
+  // this scope or already be shared.
+  template <typename ObjectType>
+  ptr<ObjectType> publish(ptr<ObjectType> root) noexcept;
+
+  // Number of live blocks still refcounted locally.
+  size_t size() const noexcept;
+
+ private:
+  friend size_t detail::register_local_block(detail::control_block* block);
+  friend void detail::unregister_local_block(detail::control_block* block,
+                                             size_t index) noexcept;
+  friend void detail::check_local_block(const detail::control_block* block,
+                                        size_t index) noexcept;
+
+  bool owns(const detail::control_block* block) const noexcept;
+
+  std::vector<detail::control_block*> blocks;
+};
+
+}  // namespace cow
+
+#include "cow/detail/local.h"
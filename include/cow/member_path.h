@@ -0,0 +1,63 @@
+#pragma once
+
+#include "cow/spot.h"
+
+namespace cow {
+
+namespace detail {
+template <typename MemberPointerType>
+struct ptr_member_traits;
+
+template <typename FromObjectType, typename ToObjectType>
+struct ptr_member_traits<ptr<ToObjectType> FromObjectType::*> {
+  using from_type = FromObjectType;
+  using to_type = ToObjectType;
+};
+
+template <auto... Members>
+struct member_chain;
+}  // namespace detail
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// member_path
+//
+// A spot reached from a root by a fixed chain of ptr members, spelled out at
+// compile time:
+//
+//   cow::member_path<&settings::config, &config::limits, &limits::rate> rate(&root);
+//   rate--->perSecond = 100;
+//
+// Each step is a member pointer whose class is the object type of the step
+// before, so there's no offset to compute and nothing to call virtually.
+// write() is straight-line code with one ptr::write() per level. It's a
+// spot of the last member's object type and can be passed or stepped from
+// like any other spot.
+//
+// Like other spots, it finds its place when constructed. A null ptr partway
+// down leaves it empty.
+//
+
+template <auto... Members>
+class member_path final
+    : public spot<typename detail::member_chain<Members...>::object_type> {
+  using chain = detail::member_chain<Members...>;
+
+ public:
+  using root_type = typename chain::root_type;
+  using object_type = typename chain::object_type;
+
+  explicit member_path(ptr<root_type>* rootWhere) noexcept;
+
+  member_path(member_path&& other) noexcept;
+  member_path& operator=(member_path&& other) noexcept;
+
+  object_type* write() noexcept override;
+
+ private:
+  ptr<root_type>* root;
+};
+
+}  // namespace cow
+
+#include "cow/detail/member_path.h"
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "cow/ptr.h"
+
+namespace cow {
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// memo
+//
+// Caches values derived from a node, like a subtree's size or checksum, in
+// the node's control block. A tree that's been edited shares every subtree
+// the edit didn't touch with the version before it, cached values and all,
+// so working out the new aggregate only runs the function on the nodes the
+// edit copied.
+//
+//   struct tree {
+//     int value{0};
+//     cow::ptr<tree> left, right;
+//
+//     struct total {
+//       long operator()(const tree& t) const {
+//         return t.value + (t.left ? cow::memo<total>(t.left) : 0) +
+//                (t.right ? cow::memo<total>(t.right) : 0);
+//       }
+//     };
+//     using cow_memos = cow::memo_slots<total>;
+//   };
+//
+//   long sum = cow::memo<total>(root);   // only the first time visits it all
+//
+// Each function named in cow_memos gets a slot in the blocks made for the
+// type. They're default-constructed, called on the const object, and their
+// results are copied out of the slot. A clone starts with its slots empty,
+// and write() and update() empty them before handing out the object in
+// place, so a slot never outlives a change made through them. Keep writing
+// through a pointer from write() after reading a memo, though, and the memo
+// will be stale.
+//
+// Safe to call from several threads at once on a shared node: if two of
+// them get there first, both run the function and the first one to finish
+// fills the slot. Only for non-polymorphic types. Types without cow_memos
+// don't pay anything for them.
+//
+
+template <typename... Functions>
+struct memo_slots {};
+
+// Function's value for the node, from its slot if it's been worked out
+// since the node last changed. Must not be null.
+template <typename Function, typename T>
+auto memo(const ptr<T>& node);
+
+}  // namespace cow
+
+#include "cow/detail/memo.h"
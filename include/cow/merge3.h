@@ -0,0 +1,79 @@
+#pragma once
+
+#include "cow/diff.h"
+#include "cow/ptr.h"
+
+#include <concepts>
+#include <optional>
+#include <utility>
+
+namespace cow {
+
+namespace detail {
+template <typename T>
+concept has_merge_children = requires(T& node) {
+  cow_for_each_child(node, [](ptr<T>&) {});
+  cow_for_each_child(std::as_const(node), [](const ptr<T>&) {});
+};
+
+template <typename Map>
+concept keyed_mergeable = requires(const Map& from, Map& to,
+                                   const typename Map::key_type& key,
+                                   const typename Map::mapped_type& value) {
+  { from.find(key) } -> std::convertible_to<const typename Map::mapped_type*>;
+  to.insert_or_assign(key, value);
+  to.erase(key);
+};
+}  // namespace detail
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// merge3
+//
+// Reconciles two versions that were both edited from a common base.
+// Wherever one side still has the base's node, the other side's node is
+// taken whole, so only the paths that both sides copied are visited, and
+// merging mostly separate edits costs about as much as the edits did.
+//
+//   auto merged = cow::merge3(base, ours, theirs, resolver);
+//
+// Where both sides changed the same node, the merge goes on into its
+// children, which are found with cow_for_each_child() as for cow::diff().
+// It has to be callable on a non-const node too, with func(ptr<T>&), so
+// that the merged children can be put in a copy. The node's own fields are
+// compared with T's ==, on copies whose children have been nulled out, and
+// each side's changes to them are kept.
+//
+// The resolver is only called where both sides changed the same thing in
+// different ways: the node's own fields, or a subtree where one side has
+// nothing, or children that don't line up. It gets the three subtrees
+// there, any of which may be null, and returns the merged one:
+//
+//   ptr<T> resolver(const ptr<T>& base, const ptr<T>& ours, const ptr<T>& theirs);
+//
+// A node type without == or without cow_for_each_child() is treated as one
+// value, so any node that both sides changed differently goes to the
+// resolver.
+//
+// hash_map and btree_map merge by key, applying what diff(base, theirs)
+// reports to a copy of ours:
+//
+//   std::optional<Value> resolver(const Key& key, const Value* base,
+//                                 const Value* ours, const Value* theirs);
+//
+// where a null pointer is a key that side doesn't have, and returning
+// std::nullopt leaves the key out of the result.
+//
+
+template <typename T, typename Resolver>
+ptr<T> merge3(const ptr<T>& base, const ptr<T>& ours, const ptr<T>& theirs,
+              Resolver&& resolver);
+
+template <typename Map, typename Resolver>
+  requires detail::keyed_mergeable<Map>
+Map merge3(const Map& base, const Map& ours, const Map& theirs,
+           Resolver&& resolver);
+
+}  // namespace cow
+
+#include "cow/detail/merge3.h"
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "cow/spot.h"
+
+#include <cstddef>
+#include <memory>
+
+namespace cow {
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// offset_path
+//
+// A path made only of push(const ptr<T>*) steps, which is most of them. A
+// cow::path keeps a full offset_spot per level and writes by chaining
+// virtual calls back up to the root. This keeps just the root, each level's
+// byte offset within its parent, and the cached location of each level's
+// ptr, and write() is one loop from the deepest level it has already
+// written down to the back. A deep path-copying write costs about what the
+// hand-written loop would.
+//
+// The first offset_path_inline_levels levels are stored inline. Like a path,
+// it's a spot<T> itself, so it can be stepped from or passed on as a
+// spot<T>&&.
+//
+
+inline constexpr size_t offset_path_inline_levels = 16;
+
+template <typename ObjectType>
+class offset_path final : public spot<ObjectType> {
+ public:
+  offset_path() noexcept;
+  explicit offset_path(ptr<ObjectType>* rootWhere) noexcept;
+  ~offset_path() = default;
+
+  offset_path(offset_path&& other) noexcept;
+  offset_path& operator=(offset_path&& other) noexcept;
+
+  // Number of levels, counting the root.
+  size_t size() const noexcept;
+
+  ObjectType* write() noexcept override;
+
+  // Same counting as path::pop() and path::resize().
+  offset_path& pop(size_t countToRemove = 1) noexcept;
+  offset_path& resize(size_t newSizeAfterRemove) noexcept;
+
+  // pointerInBackObject must point at a ptr inside the back object.
+  offset_path& push(const ptr<ObjectType>* pointerInBackObject);
+
+  // Where the ptr for a level currently is. Level 0 is the root.
+  const ptr<ObjectType>* location(size_t level) const noexcept;
+
+  offset_path& clear() noexcept;
+  offset_path& reset(ptr<ObjectType>* rootWhere) noexcept;
+
+ private:
+  struct level {
+    size_t offset;
+    const ptr<ObjectType>* where;
+  };
+
+  void take(offset_path&& other) noexcept;
+
+  level* levels{inlineLevels};
+  size_t count{0};
+  size_t capacity{offset_path_inline_levels};
+
+  // Levels below this have been written through this path, so their
+  // objects are already uniquely ours.
+  size_t written{0};
+
+  std::unique_ptr<level[]> heapLevels;
+  level inlineLevels[offset_path_inline_levels];
+};
+
+}  // namespace cow
+
+#include "cow/detail/offset_path.h"
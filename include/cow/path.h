@@ -2,16 +2,33 @@
 
 #include "cow/spot.h"
 
+#include <cstddef>
 #include <memory>
 #include <vector>
 
 namespace cow {
 
-// TODO: Write a good scratch allocator and use it here :-)
+// Spots live in a scratch arena inside the path: the first
+// path_inline_spots entries and path_inline_bytes of spots need no
+// allocation at all, and anything beyond that goes in heap chunks that are
+// kept for reuse. pop() and resize() rewind the arena, so walking up and
+// down a tree through the same path only allocates while it's deeper than
+// it has ever been.
+//
+// References returned by front() and back() stay valid until that spot is
+// popped, but not across a move of the path, which relocates the inline
+// spots.
+inline constexpr size_t path_inline_spots = 8;
+inline constexpr size_t path_inline_bytes = path_inline_spots * 48;
+
 template <typename ObjectType>
 class path : public spot<ObjectType> {
  public:
-  path() = default;
+  path() noexcept;
+  ~path();
+
+  path(path&& other) noexcept;
+  path& operator=(path&& other) noexcept;
 
   // Construct with a root_spot
   explicit path(ptr<ObjectType>* rootWhere);
@@ -50,7 +67,52 @@ class path : public spot<ObjectType> {
   path& reset(ArgTypes&&... args);
 
  private:
-  std::vector<std::unique_ptr<spot<ObjectType>>> spots;
+  // Moves a spot to a new address (or leaves it, if to is null) and points
+  // it back at the spot before it. Instantiated per spot type by place().
+  using relocate_function = spot<ObjectType>* (*)(spot<ObjectType>* from,
+                                                   void* to,
+                                                   spot<ObjectType>* newFrom) noexcept;
+
+  // Where the arena's bump pointer was before a spot was placed, so
+  // removing it can rewind to there.
+  struct arena_mark {
+    size_t chunk{0};
+    size_t used{0};
+  };
+
+  struct entry {
+    spot<ObjectType>* where{nullptr};
+    relocate_function relocate{nullptr};
+    arena_mark mark;
+  };
+
+  struct arena_chunk {
+    std::unique_ptr<std::byte[]> bytes;
+    size_t size;
+  };
+
+  template <typename SpotType>
+  static spot<ObjectType>* relocate(spot<ObjectType>* from, void* to,
+                                    spot<ObjectType>* newFrom) noexcept;
+
+  template <typename SpotType, typename... ArgTypes>
+  SpotType* place(ArgTypes&&... args);
+
+  void* allocate(size_t size, size_t align);
+  void truncate(size_t newSize) noexcept;
+  void take(path&& other) noexcept;
+
+  entry& at(size_t index) noexcept;
+  const entry& at(size_t index) const noexcept;
+
+  entry inlineEntries[path_inline_spots];
+  std::vector<entry> moreEntries;
+  size_t spotCount{0};
+
+  // Chunk 0 is inlineBytes; chunk n is chunks[n - 1].
+  arena_mark top;
+  std::vector<arena_chunk> chunks;
+  alignas(std::max_align_t) std::byte inlineBytes[path_inline_bytes];
 };
 
 }  // namespace cow
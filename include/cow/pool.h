@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+
+namespace cow {
+
+class block_pool;
+
+namespace detail {
+class pool_state;
+pool_state* state_of(block_pool& pool) noexcept;
+}  // namespace detail
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// block_pool
+//
+// An arena for control blocks. Small blocks are carved out of 64KiB slabs in
+// 16-byte size classes. Each thread keeps its own free list per size class and
+// only takes the pool's lock to refill or drain those lists in batches.
+//
+// A block always goes back to the pool it was allocated from, no matter which
+// thread drops the last reference, and clones made by ptr::write() are
+// allocated from the same pool as the original. Blocks too large for the size
+// classes fall through to the global operator new.
+//
+// The pool must outlive every block allocated from it.
+//
+
+class block_pool {
+ public:
+  block_pool();
+  ~block_pool();
+
+  block_pool(const block_pool&) = delete;
+  block_pool& operator=(const block_pool&) = delete;
+
+  // Bytes of slab memory this pool has reserved from the system.
+  size_t reserved_bytes() const noexcept;
+
+ private:
+  friend detail::pool_state* detail::state_of(block_pool& pool) noexcept;
+
+  std::shared_ptr<detail::pool_state> state;
+};
+
+// The pool used by cow::make().
+block_pool& default_pool() noexcept;
+
+}  // namespace cow
+
+#include "cow/detail/pool.h"
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "cow/ptr.h"
+
+#include <cstddef>
+#include <functional>
+#include <utility>
+#include <vector>
+
+namespace cow {
+
+namespace detail {
+// A pairing heap node: its children are firstChild and that child's
+// chain of nextSiblings.
+template <typename T>
+struct priority_queue_node {
+  template <typename... ArgTypes>
+  explicit priority_queue_node(std::in_place_t, ArgTypes&&... args)
+      : value(std::forward<ArgTypes>(args)...) {}
+
+  priority_queue_node(const priority_queue_node&) = default;
+  priority_queue_node& operator=(const priority_queue_node&) = delete;
+
+  ~priority_queue_node();
+
+  T value;
+  ptr<priority_queue_node> firstChild;
+  ptr<priority_queue_node> nextSibling;
+};
+}  // namespace detail
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// priority_queue
+//
+// A persistent priority queue: copying one is O(1) and shares everything,
+// and changing a copy leaves the original alone.
+//
+//   cow::priority_queue<job, by_deadline> pending = ...;
+//   auto plan = pending;          // what-if planning on a snapshot
+//   plan.pop();
+//   plan.push(extra);             // pending is unchanged
+//
+// It's a pairing heap of cow::ptr nodes. top() and push() are O(1), and so
+// is merge(). pop() is O(log n) amortized, pairing up the old top's
+// children and merging the pairs back together. Nodes reached through
+// ptr::write() are changed in place when nobody else holds them, so a queue
+// that isn't shared allocates only on push(); a pop from a snapshot copies
+// the children it relinks.
+//
+// Amortized bounds assume each version is popped once. Popping the same
+// snapshot over and over can repeat the expensive pops.
+//
+// As with std::priority_queue, top() is the greatest element under Compare.
+//
+
+template <typename T, typename Compare = std::less<T>>
+class priority_queue {
+ public:
+  using value_type = T;
+  using size_type = size_t;
+  using value_compare = Compare;
+
+  priority_queue() = default;
+  explicit priority_queue(const Compare& compare);
+
+  // Heapifies in O(n), by merging singletons in pairs.
+  template <typename Range>
+  static priority_queue from_range(Range&& values, const Compare& compare = Compare());
+
+  value_compare value_comp() const;
+
+  size_t size() const noexcept;
+  bool empty() const noexcept;
+
+  const T& top() const noexcept;
+
+  void push(T value);
+  template <typename... ArgTypes>
+  void emplace(ArgTypes&&... args);
+  void pop();
+
+  // Moves other's elements in, sharing its nodes. O(1). They're ordered
+  // by this queue's Compare, which has to agree with other's.
+  void merge(const priority_queue& other);
+
+  void clear() noexcept;
+
+ private:
+  using node = detail::priority_queue_node<T>;
+
+  ptr<node> meld(ptr<node> a, ptr<node> b) const;
+  static ptr<node> detach(ptr<node>& from);
+
+  size_t count{0};
+  ptr<node> root;
+  [[no_unique_address]] Compare compare;
+};
+
+}  // namespace cow
+
+#include "cow/detail/priority_queue.h"
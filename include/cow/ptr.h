@@ -1,14 +1,46 @@
 #pragma once
 
+#include <cstddef>
+#include <type_traits>
 #include <typeinfo>
 
 namespace cow {
 
+  class block_pool;
+
+  template<typename ObjectType>
+  class ref;
+
   namespace detail {
     class control_block;
-    template<typename ObjectType> class control_block_with_object;
+    struct ptr_access;
+
+    // Non-polymorphic objects get a control block without a vtable. Those
+    // blocks can only be referenced through a ptr of their exact type.
+    template<typename ObjectType>
+    inline constexpr bool uses_static_control_block = !std::is_polymorphic_v<ObjectType>;
+
+    template<typename ObjectType, bool IsStatic = uses_static_control_block<ObjectType>>
+    class control_block_with_object;
+
+    inline constexpr size_t cache_line_size = 64;
+
+    // Whether a ptr<FromType> may be reinterpreted as a ptr<ToType>. Either
+    // the types match, or both blocks are polymorphic and share a layout.
+    template<typename FromType, typename ToType>
+    inline constexpr bool is_same_block_layout =
+      std::is_same_v<std::remove_cv_t<FromType>, std::remove_cv_t<ToType>> ||
+      (!uses_static_control_block<FromType> && !uses_static_control_block<ToType>);
   }
 
+  // Specialize as true for a widely shared, non-polymorphic type to start
+  // its objects on a cache line of their own, away from the refcount. Then
+  // threads copying and dropping ptrs to it don't keep invalidating the
+  // line that everyone reading the object needs. Costs up to a cache line
+  // of padding per block.
+  template<typename ObjectType>
+  inline constexpr bool isolate_refcount = false;
+
   template<typename ObjectType>
   class ptr final {
   public:
@@ -21,12 +53,14 @@ namespace cow {
     ptr(ptr&&) noexcept;
 
     template <typename DerivedType,
-              std::enable_if_t<std::is_convertible_v<DerivedType*, ObjectType*>,
+              std::enable_if_t<std::is_convertible_v<DerivedType*, ObjectType*> &&
+                                 detail::is_same_block_layout<DerivedType, ObjectType>,
                                int> = 0>
     ptr(const ptr<DerivedType>&) noexcept;
 
     template <typename DerivedType,
-              std::enable_if_t<std::is_convertible_v<DerivedType*, ObjectType*>,
+              std::enable_if_t<std::is_convertible_v<DerivedType*, ObjectType*> &&
+                                 detail::is_same_block_layout<DerivedType, ObjectType>,
                                int> = 0>
     ptr(ptr<DerivedType>&&) noexcept;
 
@@ -34,12 +68,14 @@ namespace cow {
     ptr& operator=(ptr&&) noexcept;
     
     template <typename DerivedType,
-              std::enable_if_t<std::is_convertible_v<DerivedType*, ObjectType*>,
+              std::enable_if_t<std::is_convertible_v<DerivedType*, ObjectType*> &&
+                                 detail::is_same_block_layout<DerivedType, ObjectType>,
                                int> = 0>
     ptr& operator=(const ptr<DerivedType>&) noexcept;
     
     template <typename DerivedType,
-              std::enable_if_t<std::is_convertible_v<DerivedType*, ObjectType*>,
+              std::enable_if_t<std::is_convertible_v<DerivedType*, ObjectType*> &&
+                                 detail::is_same_block_layout<DerivedType, ObjectType>,
                                int> = 0>
     ptr& operator=(ptr<DerivedType>&&) noexcept;
 
@@ -57,6 +93,19 @@ namespace cow {
     ObjectType* operator--(int) noexcept;
     ObjectType* operator--() noexcept;
     ObjectType* write() noexcept;
+
+    // Replaces the object with func(const ObjectType&), which returns a new
+    // ObjectType. If the object is shared, the new block's object is built
+    // straight from func's result instead of cloning the old one first; if
+    // it's unique, the result is move-assigned over it. Must not be null,
+    // and only for non-polymorphic types.
+    template<typename UpdateFunc>
+    ObjectType* update(UpdateFunc&& func);
+
+    // As update(), but when the object is unique func is passed it as an
+    // ObjectType&& to take apart. func must accept both.
+    template<typename UpdateFunc>
+    ObjectType* update_move(UpdateFunc&& func);
     
     template<typename StaticCastType>
     const StaticCastType* read() const noexcept;
@@ -90,15 +139,17 @@ namespace cow {
 
   private:
     template<typename OtherType> friend class ptr;
+    friend struct detail::ptr_access;
 
     ObjectType* object;
 
     explicit ptr(ObjectType* objectPtr) noexcept;
 
-    detail::control_block_with_object<ObjectType>* control() const noexcept;
+    // Deduced so that ptr<T> can be declared while T is still incomplete.
+    auto* control() const noexcept;
 
-    template<typename ObjectType, typename... ObjectContructorArgTypes>
-    friend ptr<ObjectType> make(ObjectContructorArgTypes&&...);
+    template<typename MakeObjectType, typename... ObjectContructorArgTypes>
+    friend ptr<MakeObjectType> make(ObjectContructorArgTypes&&...);
 
     template<typename ObjectType1, typename ObjectType2>
     friend bool operator==(const ptr<ObjectType1>& ptr1, const ptr<ObjectType2>& ptr2);
@@ -116,6 +167,36 @@ namespace cow {
     friend bool operator==(std::nullptr_t, const ptr<ObjectType2>& ptr2);
   };
 
+  // Per-block options for allocate_make().
+  enum class block_flags : unsigned {
+    none = 0,
+
+    // Biased refcounting, for blocks that one thread copies far more often
+    // than anyone else. See cow/biased.h.
+    biased = 1u << 0,
+  };
+
+  constexpr block_flags operator|(block_flags a, block_flags b) noexcept {
+    return block_flags(unsigned(a) | unsigned(b));
+  }
+
+  constexpr block_flags operator&(block_flags a, block_flags b) noexcept {
+    return block_flags(unsigned(a) & unsigned(b));
+  }
+
+  // Allocates the control block and object from cow::default_pool().
+  template<typename ObjectType, typename... ObjectContructorArgTypes>
+  ptr<ObjectType> make(ObjectContructorArgTypes&&... objectConstructorArgs);
+
+  // Allocates the control block and object from the given pool. Clones made
+  // by write() stay in the same pool.
+  template<typename ObjectType, typename... ObjectContructorArgTypes>
+  ptr<ObjectType> allocate_make(block_pool& pool, ObjectContructorArgTypes&&... objectConstructorArgs);
+
+  // As above, with per-block options. Clones made by write() keep the flags.
+  template<typename ObjectType, typename... ObjectContructorArgTypes>
+  ptr<ObjectType> allocate_make(block_pool& pool, block_flags flags, ObjectContructorArgTypes&&... objectConstructorArgs);
+
   template<typename DestType, typename SourceType>
   inline ptr<DestType> static_pointer_cast(const ptr<SourceType>& src);
 
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "cow/ptr.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace cow {
+
+class reclaimer;
+
+namespace detail {
+class reclaimer_state;
+
+struct retired_block {
+  control_block* block;
+  destroy_function destroy;
+  size_t bytes;
+};
+
+struct reclaim_queue {
+  std::vector<retired_block> blocks;
+  size_t pendingBytes{0};
+  size_t reclaimedBlocks{0};
+  reclaimer_state* background{nullptr};
+};
+}  // namespace detail
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Deferred reclamation
+//
+// Dropping the last reference to an old version normally destroys it on the
+// spot, and with it every node only that version was holding, recursively.
+// For a big tree that's a latency spike on whichever thread let go, and a
+// long enough chain overflows the stack.
+//
+// While a deferred_scope is active, blocks that die on its thread are pushed
+// onto a queue instead of being destroyed. reclaim() then destroys them a
+// budgeted number at a time; the children each one releases go on the same
+// queue rather than being torn down recursively. A scope made with a
+// reclaimer hands its queue over to the reclaimer's thread in batches
+// instead, so the releasing thread does no teardown at all.
+//
+// Nothing is handed off while a cow::local_scope is active on the thread,
+// since the blocks being released may still be local.
+//
+// The destructor reclaims or hands off whatever is left. Pools must outlive
+// their blocks' reclamation, and a reclaimer must outlive every scope using
+// it. Only one deferred_scope can be active on a thread at a time.
+//
+
+struct reclaim_stats {
+  // Blocks queued but not yet destroyed, and their size including control
+  // blocks. A reclaimer counts the batches handed to it; nodes those release
+  // aren't counted until they're destroyed.
+  size_t pending_blocks{0};
+  size_t pending_bytes{0};
+
+  // Blocks destroyed so far.
+  size_t reclaimed_blocks{0};
+};
+
+class deferred_scope {
+ public:
+  // Dead blocks wait until reclaim() or the destructor.
+  deferred_scope() noexcept;
+
+  // Dead blocks are handed to background in batches.
+  explicit deferred_scope(reclaimer& background) noexcept;
+
+  ~deferred_scope();
+
+  deferred_scope(const deferred_scope&) = delete;
+  deferred_scope& operator=(const deferred_scope&) = delete;
+
+  // Destroys up to budget queued blocks on this thread, and returns how many
+  // it destroyed.
+  size_t reclaim(size_t budget = SIZE_MAX) noexcept;
+
+  // Hands everything queued so far to the reclaimer, if there is one and no
+  // local_scope is active.
+  void hand_off() noexcept;
+
+  reclaim_stats stats() const noexcept;
+
+ private:
+  detail::reclaim_queue queue;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// reclaimer
+//
+// A background thread that destroys what deferred_scopes hand it. The
+// destructor finishes everything already handed over before joining.
+//
+
+class reclaimer {
+ public:
+  reclaimer();
+  ~reclaimer();
+
+  reclaimer(const reclaimer&) = delete;
+  reclaimer& operator=(const reclaimer&) = delete;
+
+  // Waits until everything handed over so far has been destroyed.
+  void flush();
+
+  reclaim_stats stats() const noexcept;
+
+ private:
+  friend class deferred_scope;
+
+  std::unique_ptr<detail::reclaimer_state> state;
+};
+
+}  // namespace cow
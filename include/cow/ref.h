@@ -0,0 +1,97 @@
+#pragma once
+
+#include "cow/ptr.h"
+
+#include <cstddef>
+#include <type_traits>
+
+namespace cow {
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// ref
+//
+// A read-only view of an object some ptr is keeping alive. Copying a ptr
+// takes a reference, an atomic increment and later a decrement on the
+// node's block, which is a lot to pay to hand a subtree to a helper. A
+// const ptr& is free but can't be stored anywhere. A ref is just the
+// object pointer: it converts from a ptr for nothing, copies for nothing,
+// and can go in containers and lambdas, so a read-only walk over a deep
+// tree does no atomic operations at all.
+//
+//   size_t count(cow::ref<tree> t) {
+//     return t ? 1 + count(t->left) + count(t->right) : 0;
+//   }
+//
+// own() turns it back into a ptr with a single incRef, for keeping a
+// subtree found along the way.
+//
+// A ref doesn't keep anything alive. It's only good while the ptr it was
+// made from, or some other ptr to the same block, still holds it: the same
+// rule as for a raw pointer from ptr::get(). atom::borrow() hands out refs
+// that stay good until the read_guard ends.
+//
+
+template <typename ObjectType>
+class ref final {
+ public:
+  using object_type = ObjectType;
+
+  ref(std::nullptr_t = nullptr) noexcept;
+  ref(const ptr<ObjectType>& owner) noexcept;
+
+  template <typename DerivedType,
+            std::enable_if_t<std::is_convertible_v<DerivedType*, ObjectType*> &&
+                                 detail::is_same_block_layout<DerivedType, ObjectType>,
+                             int> = 0>
+  ref(const ref<DerivedType>& other) noexcept;
+
+  template <typename DerivedType,
+            std::enable_if_t<std::is_convertible_v<DerivedType*, ObjectType*> &&
+                                 detail::is_same_block_layout<DerivedType, ObjectType>,
+                             int> = 0>
+  ref(const ptr<DerivedType>& owner) noexcept;
+
+  // Nothing would hold a temporary's object once the full expression ends.
+  ref(ptr<ObjectType>&& owner) = delete;
+
+  template <typename DerivedType,
+            std::enable_if_t<std::is_convertible_v<DerivedType*, ObjectType*> &&
+                                 detail::is_same_block_layout<DerivedType, ObjectType>,
+                             int> = 0>
+  ref(ptr<DerivedType>&& owner) = delete;
+
+  explicit operator bool() const noexcept;
+
+  const ObjectType& operator*() const noexcept;
+  const ObjectType* operator->() const noexcept;
+  const ObjectType* get() const noexcept;
+
+  // A ptr sharing the object. Must be called while the object is still
+  // alive.
+  ptr<ObjectType> own() const noexcept;
+
+  size_t use_count() const noexcept;
+
+ private:
+  template <typename OtherType>
+  friend class ref;
+  friend struct detail::ptr_access;
+
+  explicit ref(ObjectType* objectPtr) noexcept;
+
+  ObjectType* object;
+};
+
+template <typename ObjectType1, typename ObjectType2>
+bool operator==(const ref<ObjectType1>& ref1, const ref<ObjectType2>& ref2) noexcept;
+
+template <typename ObjectType1, typename ObjectType2>
+bool operator==(const ref<ObjectType1>& ref1, const ptr<ObjectType2>& ptr2) noexcept;
+
+template <typename ObjectType>
+bool operator==(const ref<ObjectType>& ref1, std::nullptr_t) noexcept;
+
+}  // namespace cow
+
+#include "cow/detail/ref.h"
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "cow/ptr.h"
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace cow {
+
+// Bytes per chunk. An edit copies at most a couple of chunks' worth.
+inline constexpr size_t rope_chunk_size = 1024;
+
+namespace detail {
+// Holds first followed by second, which must fit. The bytes are only
+// copied in, never zeroed first. Defined in rope.cpp.
+struct rope_chunk {
+  explicit rope_chunk(std::string_view first,
+                      std::string_view second = {}) noexcept;
+
+  size_t size{0};
+  char bytes[rope_chunk_size];
+};
+
+// A leaf is a view of length bytes of chunk, from offset; a branch is the
+// concatenation of left and right, and height keeps it AVL balanced.
+struct rope_node {
+  size_t length{0};
+  unsigned height{0};
+  ptr<rope_node> left;
+  ptr<rope_node> right;
+  ptr<rope_chunk> chunk;
+  size_t offset{0};
+};
+}  // namespace detail
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// rope
+//
+// A persistent byte string for large payloads: copying one is O(1), and a
+// small edit copies about a chunk's worth of bytes rather than the whole
+// thing.
+//
+//   cow::rope body(payload);       // a few megabytes
+//   cow::rope edited = body;
+//   edited.insert(1000, "x");      // body still shares every other chunk
+//
+// The bytes live in chunks of up to rope_chunk_size that are never changed
+// once they're shared. Leaves of a balanced binary tree each view part of a
+// chunk, so slicing or splitting a rope just makes new views of the same
+// chunks. insert(), erase() and slice() are O(log n): split the tree at the
+// ends, and join the pieces back together. Adjacent small leaves are merged
+// as they're joined, so repeated edits don't leave a trail of tiny chunks.
+//
+// for_each_chunk() hands out the bytes as string_views in order, ready for
+// a writev()-style gather without copying.
+//
+
+class rope {
+ public:
+  rope() noexcept = default;
+  explicit rope(std::string_view bytes);
+
+  size_t size() const noexcept;
+  bool empty() const noexcept;
+
+  // O(log n).
+  char operator[](size_t index) const noexcept;
+
+  void insert(size_t at, std::string_view bytes);
+  void insert(size_t at, const rope& other);
+  void append(std::string_view bytes);
+  void append(const rope& other);
+  void erase(size_t at, size_t count);
+  void clear() noexcept;
+
+  // The count bytes from at, sharing this rope's chunks.
+  rope slice(size_t at, size_t count) const;
+
+  // Calls func(std::string_view) for each run of contiguous bytes, in order.
+  template <typename ChunkFunc>
+  void for_each_chunk(ChunkFunc&& func) const;
+
+  std::string str() const;
+
+ private:
+  using node = detail::rope_node;
+
+  explicit rope(ptr<node> from) noexcept;
+
+  template <typename ChunkFunc>
+  static void visit(const node& from, ChunkFunc& func);
+
+  ptr<node> root;
+};
+
+template <typename ChunkFunc>
+inline void rope::for_each_chunk(ChunkFunc&& func) const {
+  if (root) {
+    visit(*root, func);
+  }
+}
+
+template <typename ChunkFunc>
+inline void rope::visit(const node& from, ChunkFunc& func) {
+  if (from.height == 0) {
+    func(std::string_view(from.chunk->bytes + from.offset, from.length));
+    return;
+  }
+  visit(*from.left, func);
+  visit(*from.right, func);
+}
+
+}  // namespace cow
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "cow/ptr.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+
+namespace cow {
+
+namespace detail {
+// What a snapshot file was written for, checked by the loader so a file
+// can't be mapped as the wrong type or by an incompatible build.
+struct snapshot_layout {
+  uint64_t typeHash;
+  uint64_t blockSize;
+  uint64_t blockAlign;
+  uint64_t objectOffset;
+};
+
+// An open snapshot's pages. Defined in snapshot.cpp.
+struct snapshot_mapping {
+  void* address{nullptr};
+  size_t size{0};
+  const void* roots{nullptr};
+  size_t rootCount{0};
+  size_t nodeCount{0};
+  bool relocated{false};
+};
+}  // namespace detail
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// snapshot
+//
+// Saves trees of cow::ptr nodes to a file that can be mapped straight back
+// into memory, so a large tree can be reopened without being rebuilt.
+//
+//   cow::save_snapshot("state.cow", root);
+//   ...
+//   cow::snapshot<tree> saved("state.cow");
+//   cow::ptr<tree> root = saved.root();
+//
+// Each distinct block goes in the file once, so subtrees shared between
+// roots, or within one, are still shared when it's loaded. The loader maps
+// the file read-only and hands out ptrs into it. Their blocks are marked
+// immortal: copying and dropping those ptrs leaves the mapped pages alone,
+// and nothing in them is ever destroyed. write() on one copies the node
+// onto the heap as it would any shared node, so a loaded tree is edited
+// like any other, and the edited copy shares its untouched subtrees with
+// the file.
+//
+// Child ptrs are stored as the addresses they'll have when the file is
+// mapped where the writer planned. If that range is free, loading only
+// reads the header, and pages are read in from the file as the tree is
+// walked. Otherwise the loader maps a private copy elsewhere and fixes up
+// every child ptr, which touches the whole file.
+//
+// Nodes are found with the same cow_for_each_child() as cow::diff (see
+// cow/diff.h), and are stored as the bytes of their blocks. So T must hold
+// nothing but plain data besides its child ptrs: no std::string, no heap
+// pointers, no ptrs that cow_for_each_child doesn't report. Only for
+// non-polymorphic types without memos.
+//
+// The snapshot must outlive every ptr into it, including the children that
+// edited copies of its nodes still share. Saving over a file that's open
+// is fine: the new one is renamed into place, and the old mapping keeps
+// the old file.
+//
+// The loader checks the header, but trusts the nodes, as it would a shared
+// library. Files are only readable by the same build on the same kind of
+// machine, and mapping them needs a POSIX mmap().
+//
+
+template <typename T>
+void save_snapshot(const std::string& path, std::span<const ptr<T>> roots);
+
+template <typename T>
+void save_snapshot(const std::string& path, const ptr<T>& root);
+
+template <typename T>
+class snapshot final {
+ public:
+  // Throws std::system_error if the file can't be read or mapped, and
+  // std::runtime_error if it isn't a snapshot of T from a compatible build.
+  explicit snapshot(const std::string& path);
+  ~snapshot();
+
+  snapshot(snapshot&& other) noexcept;
+  snapshot& operator=(snapshot&& other) noexcept;
+
+  // The roots, in the order they were saved.
+  std::span<const ptr<T>> roots() const noexcept;
+  const ptr<T>& root(size_t index = 0) const noexcept;
+
+  // Distinct nodes in the file.
+  size_t node_count() const noexcept;
+
+  // Whether the file couldn't be mapped where it was written for, so its
+  // child ptrs had to be fixed up on load.
+  bool relocated() const noexcept;
+
+ private:
+  detail::snapshot_mapping mapping;
+};
+
+}  // namespace cow
+
+#include "cow/detail/snapshot.h"
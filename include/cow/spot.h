@@ -1,6 +1,7 @@
 #pragma once
 
 #include "cow/ptr.h"
+#include "cow/ref.h"
 
 namespace cow {
 
@@ -20,6 +21,8 @@ class spot {
  public:
   using object_type = ObjectType;
 
+  virtual ~spot() = default;
+
   explicit operator bool() const noexcept;
   const ObjectType* get() const noexcept;
   const ObjectType& operator*() const noexcept;
@@ -33,6 +36,10 @@ class spot {
 
   size_t use_count() const noexcept;
 
+  // The object here, for read-only helpers that take a ref. Good until
+  // this spot is next written through.
+  ref<ObjectType> borrow() const noexcept;
+
   template <typename StepFunc>
   auto step(StepFunc&& func) noexcept;
 
@@ -91,6 +98,9 @@ class next_spot : public spot<ToObjectType> {
       const FromObjectType& from) const noexcept = 0;
 
  private:
+  // A path relinks fromSpot when it moves its spots.
+  friend class path<ToObjectType>;
+
   spot<FromObjectType>* fromSpot;
   bool hasWritten;
 };
@@ -0,0 +1,160 @@
+#pragma once
+
+#include "cow/diff.h"
+#include "cow/ptr.h"
+
+#include <cstddef>
+#include <initializer_list>
+#include <iterator>
+#include <vector>
+
+namespace cow {
+
+namespace detail {
+// Each level of the trie indexes vector_bits bits of the element index.
+inline constexpr unsigned vector_bits = 5;
+inline constexpr size_t vector_width = size_t(1) << vector_bits;
+inline constexpr size_t vector_mask = vector_width - 1;
+
+template <typename T>
+class vector_branch;
+
+template <typename T>
+class vector_chunk;
+}  // namespace detail
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// vector
+//
+// A persistent vector: copying one is O(1) and shares everything, and
+// changing a copy leaves the original alone.
+//
+//   cow::vector<int> a = cow::vector<int>::from_range(numbers);
+//   cow::vector<int> b = a;
+//   b.set(1000, 7);        // copies the 32-element chunk and the branches
+//   b.push_back(8);        // above it, and nothing else
+//
+// It's a 32-way trie of cow::ptr nodes. Elements live in chunks of 32, and
+// the last (partial) chunk is kept out of the trie as a tail, so
+// push_back() and pop_back() usually touch only the tail. set(),
+// push_back() and pop_back() are O(log32 n), copying the nodes on the path
+// down with ptr::write(); nodes that aren't shared are changed in place.
+//
+// Chunks are contiguous, so for_each_chunk() and the iterators scan 32
+// elements at a time rather than descending the trie for each one.
+//
+
+template <typename T>
+class vector {
+ public:
+  using value_type = T;
+  using size_type = size_t;
+  using reference = const T&;
+  using const_reference = const T&;
+
+  class const_iterator;
+  using iterator = const_iterator;
+
+  vector() noexcept = default;
+  vector(std::initializer_list<T> values);
+
+  // Builds the trie bottom-up: each element is copied once into its chunk,
+  // and each branch is made full.
+  template <typename Range>
+  static vector from_range(Range&& values);
+
+  size_t size() const noexcept;
+  bool empty() const noexcept;
+
+  const T& operator[](size_t index) const noexcept;
+  const T& front() const noexcept;
+  const T& back() const noexcept;
+
+  // A writable reference to one element, after copying whatever is shared
+  // on the way down to it. Valid until this vector is next changed.
+  T& write(size_t index);
+  void set(size_t index, T value);
+
+  void push_back(T value);
+  template <typename... ArgTypes>
+  T& emplace_back(ArgTypes&&... args);
+  void pop_back();
+  void clear() noexcept;
+
+  // Calls func(const T* data, size_t count) for each run of contiguous
+  // elements, in order.
+  template <typename ChunkFunc>
+  void for_each_chunk(ChunkFunc&& func) const;
+
+  const_iterator begin() const noexcept;
+  const_iterator end() const noexcept;
+
+  // Reports how after differs from this vector, by index, through
+  // visitor.added(index, value), visitor.removed(index, value) and
+  // visitor.changed(index, before, after). See cow::diff().
+  template <typename Visitor>
+  void diff(const vector& after, Visitor&& visitor) const;
+
+ private:
+  using branch = detail::vector_branch<T>;
+  using chunk = detail::vector_chunk<T>;
+
+  size_t tail_offset() const noexcept;
+  const chunk* chunk_for(size_t index) const noexcept;
+  void push_tail();
+
+  template <typename Child>
+  static std::vector<ptr<branch>> group(std::vector<ptr<Child>>& children);
+  static bool pop_leaf(ptr<branch>& where, unsigned level, size_t leafIndex);
+
+  template <typename ChunkFunc>
+  static void visit(const branch* from, unsigned level, ChunkFunc& func);
+
+  template <typename Visitor>
+  static void diff_nodes(const branch* before, unsigned beforeShift,
+                         const branch* after, unsigned afterShift,
+                         unsigned level, size_t base, size_t limit,
+                         Visitor& visitor);
+  template <typename Visitor>
+  static void diff_chunks(const chunk* before, const chunk* after, size_t base,
+                          size_t limit, Visitor& visitor);
+
+  size_t count{0};
+  unsigned shift{detail::vector_bits};
+  ptr<branch> root;
+  ptr<chunk> tail;
+};
+
+template <typename T>
+class vector<T>::const_iterator {
+ public:
+  using iterator_category = std::forward_iterator_tag;
+  using value_type = T;
+  using difference_type = std::ptrdiff_t;
+  using pointer = const T*;
+  using reference = const T&;
+
+  const_iterator() noexcept = default;
+
+  reference operator*() const noexcept;
+  pointer operator->() const noexcept;
+  const_iterator& operator++() noexcept;
+  const_iterator operator++(int) noexcept;
+
+  bool operator==(const const_iterator& other) const noexcept;
+  bool operator!=(const const_iterator& other) const noexcept;
+
+ private:
+  friend class vector;
+
+  const_iterator(const vector* from, size_t at) noexcept;
+
+  const vector* owner{nullptr};
+  size_t index{0};
+  const T* data{nullptr};
+};
+
+}  // namespace cow
+
+#include "cow/detail/vector.h"
@@ -0,0 +1,165 @@
+#include "cow/atom.h"
+
+#include <assert.h>
+#include <thread>
+#include <vector>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace cow::detail {
+
+namespace {
+
+std::atomic<hazard_record*> g_records{nullptr};
+
+struct retired_root {
+  control_block* block;
+  release_function release;
+  size_t epoch;
+};
+
+// Whether a reader has the root announced, or is in a read_guard that
+// started before the root was retired and so may have borrowed it.
+bool is_guarded(const retired_root& root) noexcept {
+  for (hazard_record* record = g_records.load(std::memory_order_acquire); record;
+       record = record->next) {
+    if (record->hazard.load(std::memory_order_seq_cst) == root.block) {
+      return true;
+    }
+    const size_t epoch = record->epoch.load(std::memory_order_seq_cst);
+    if (epoch != 0 && epoch <= root.epoch) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Releases whichever of roots no reader can still see. A release can tear
+// down a whole tree, and in it the last reference to another atom, so the
+// list is settled before any of them run.
+void release_unguarded(std::vector<retired_root>& roots) noexcept {
+  std::vector<retired_root> ready;
+  size_t kept = 0;
+  for (const retired_root& root : roots) {
+    if (is_guarded(root)) {
+      roots[kept++] = root;
+    } else {
+      try {
+        ready.push_back(root);
+      } catch (...) {
+        root.release(root.block);
+      }
+    }
+  }
+  roots.resize(kept);
+  for (const retired_root& root : ready) {
+    root.release(root.block);
+  }
+}
+
+void release_when_unguarded(const retired_root& root) noexcept {
+  while (is_guarded(root)) {
+    std::this_thread::yield();
+  }
+  root.release(root.block);
+}
+
+struct hazard_holder {
+  ~hazard_holder();
+
+  hazard_record* record{nullptr};
+  std::vector<retired_root> retired;
+};
+
+// Atoms can still be used by other thread_local destructors after ours has
+// run. Their releases then wait for the readers instead of being put off.
+thread_local bool t_tornDown = false;
+thread_local hazard_holder t_holder;
+
+hazard_holder::~hazard_holder() {
+  t_tornDown = true;
+  std::vector<retired_root> left;
+  left.swap(retired);
+  for (const retired_root& root : left) {
+    release_when_unguarded(root);
+  }
+  if (record) {
+    t_hazardRecord = nullptr;
+    record->active.store(false, std::memory_order_release);
+  }
+}
+
+}  // namespace
+
+hazard_record* acquire_hazard_record() {
+  hazard_record* found = nullptr;
+  for (hazard_record* record = g_records.load(std::memory_order_acquire); record;
+       record = record->next) {
+    bool active = false;
+    if (!record->active.load(std::memory_order_relaxed) &&
+        record->active.compare_exchange_strong(active, true, std::memory_order_acquire)) {
+      found = record;
+      break;
+    }
+  }
+  if (!found) {
+    found = new hazard_record;
+    found->active.store(true, std::memory_order_relaxed);
+    found->next = g_records.load(std::memory_order_relaxed);
+    while (!g_records.compare_exchange_weak(found->next, found, std::memory_order_release,
+                                            std::memory_order_relaxed)) {
+    }
+  }
+  // A thread that's already torn down keeps its record for good.
+  if (!t_tornDown) {
+    t_holder.record = found;
+  }
+  t_hazardRecord = found;
+  return found;
+}
+
+void retire_root(control_block* block, release_function release) noexcept {
+  // Guards that start from here on can only see what replaced it.
+  const retired_root root{block, release, g_readEpoch.fetch_add(1, std::memory_order_seq_cst)};
+  if (t_tornDown) {
+    release_when_unguarded(root);
+    return;
+  }
+  try {
+    t_holder.retired.push_back(root);
+  } catch (...) {
+    // Out of memory for the list; wait for the readers instead.
+    release_when_unguarded(root);
+  }
+  release_unguarded(t_holder.retired);
+}
+
+void atom_backoff(unsigned attempt) noexcept {
+  if (attempt >= 8) {
+    std::this_thread::yield();
+    return;
+  }
+  for (unsigned i = 0; i < (1u << attempt); ++i) {
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+  }
+}
+
+}  // namespace cow::detail
+
+namespace cow {
+
+size_t collect_roots() noexcept {
+  if (detail::t_tornDown) {
+    return 0;
+  }
+  detail::release_unguarded(detail::t_holder.retired);
+  return detail::t_holder.retired.size();
+}
+
+}  // namespace cow
@@ -0,0 +1,139 @@
+#include "cow/biased.h"
+
+#include <mutex>
+#include <vector>
+
+namespace cow::detail {
+
+struct biased_owner {
+  std::mutex mutex;
+  bool alive{true};
+  std::vector<control_block*> queue;
+  std::atomic<bool> pending{false};
+
+  // Owner records are never freed, since blocks point at them for as long
+  // as they live. They're kept on a list so leak checkers can still see them.
+  biased_owner* nextOwner{nullptr};
+};
+
+namespace {
+
+std::atomic<biased_owner*> g_owners{nullptr};
+
+size_t drain_queue(biased_owner& owner) noexcept {
+  size_t merged = 0;
+  std::vector<control_block*> queue;
+  for (;;) {
+    {
+      std::lock_guard lock(owner.mutex);
+      owner.pending.store(false, std::memory_order_relaxed);
+      queue.swap(owner.queue);
+    }
+    if (queue.empty()) {
+      return merged;
+    }
+    for (control_block* block : queue) {
+      destroy_function retire = block->prefix()->retire;
+      if (block->mergeBiased(true)) {
+        retire(block);
+      }
+    }
+    merged += queue.size();
+    queue.clear();
+  }
+}
+
+struct owner_holder {
+  ~owner_holder();
+
+  biased_owner* owner{nullptr};
+};
+
+// Biased blocks can still be made by other thread_local destructors after
+// ours has run; they start out merged.
+thread_local bool t_tornDown = false;
+thread_local owner_holder t_holder;
+
+owner_holder::~owner_holder() {
+  t_tornDown = true;
+  if (!owner) {
+    return;
+  }
+  drain_queue(*owner);
+
+  // From here on this thread's releases take the shared path, and anything
+  // queued after the lock is merged by the thread that queues it.
+  t_biasedOwner = nullptr;
+  {
+    std::lock_guard lock(owner->mutex);
+    owner->alive = false;
+  }
+  for (control_block* block : owner->queue) {
+    destroy_function retire = block->prefix()->retire;
+    if (block->mergeBiased(true)) {
+      retire(block);
+    }
+  }
+  owner->queue.clear();
+  owner->queue.shrink_to_fit();
+}
+
+}  // namespace
+
+void init_biased_block(control_block* block, destroy_function retire) noexcept {
+  biased_prefix* const prefix = block->prefix();
+  prefix->retire = retire;
+  const size_t stamp =
+      block->refCount.load(std::memory_order_relaxed) & control_block::edit_token_mask;
+
+  if (t_tornDown) {
+    prefix->owner = nullptr;
+    prefix->biased.store(0, std::memory_order_relaxed);
+    block->refCount.store(1 | control_block::biased_flag | control_block::merged_flag | stamp,
+                          std::memory_order_relaxed);
+    return;
+  }
+
+  biased_owner* owner = t_biasedOwner;
+  if (!owner) {
+    owner = new biased_owner;
+    owner->nextOwner = g_owners.load(std::memory_order_relaxed);
+    while (!g_owners.compare_exchange_weak(owner->nextOwner, owner, std::memory_order_release,
+                                           std::memory_order_relaxed)) {
+    }
+    t_holder.owner = owner;
+    t_biasedOwner = owner;
+  } else if (owner->pending.load(std::memory_order_relaxed)) {
+    drain_queue(*owner);
+  }
+
+  prefix->owner = owner;
+  prefix->biased.store(1, std::memory_order_relaxed);
+  block->refCount.store(control_block::biased_flag | control_block::biased_zero | stamp,
+                        std::memory_order_relaxed);
+}
+
+bool queue_biased_block(control_block* block) noexcept {
+  biased_owner* const owner = block->prefix()->owner;
+  {
+    std::lock_guard lock(owner->mutex);
+    if (owner->alive) {
+      owner->queue.push_back(block);
+      owner->pending.store(true, std::memory_order_relaxed);
+      return false;
+    }
+  }
+  // The owner has exited, so its count won't change any more.
+  return block->mergeBiased(true);
+}
+
+}  // namespace cow::detail
+
+namespace cow {
+
+size_t collect_biased() noexcept {
+  detail::biased_owner* const owner = detail::t_biasedOwner;
+  return owner ? detail::drain_queue(*owner) : 0;
+}
+
+}  // namespace cow
@@ -0,0 +1,22 @@
+#include "cow/edit_session.h"
+
+namespace cow {
+
+namespace {
+thread_local size_t t_lastToken = 0;
+}
+
+edit_session::edit_session() noexcept : outerStamp(detail::t_editStamp) {
+  using detail::control_block;
+  constexpr size_t tokenCount = size_t(1) << control_block::edit_token_bits;
+
+  // Token 0 means unstamped.
+  t_lastToken = t_lastToken % (tokenCount - 1) + 1;
+  detail::t_editStamp = t_lastToken << control_block::edit_token_shift;
+}
+
+edit_session::~edit_session() {
+  detail::t_editStamp = outerStamp;
+}
+
+}  // namespace cow
@@ -0,0 +1,131 @@
+#include "cow/intern.h"
+
+#include <assert.h>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+
+namespace cow::detail {
+
+namespace {
+
+// A block's shard is kept in its refcount word, in the bits local blocks use
+// for their index. On targets too narrow for those there's only one.
+constexpr unsigned intern_shard_bits = control_block::supports_local ? 6 : 0;
+constexpr size_t intern_shard_count = size_t(1) << intern_shard_bits;
+
+struct intern_entry {
+  control_block* block;
+  intern_equal_function equal;
+};
+
+struct intern_shard {
+  std::mutex mutex;
+  std::unordered_multimap<size_t, intern_entry> byHash;
+  std::unordered_map<const control_block*, size_t> hashOf;
+};
+
+// Never freed, since interned blocks can still be let go during static
+// destruction.
+intern_shard* shards() {
+  static intern_shard* const table = new intern_shard[intern_shard_count];
+  return table;
+}
+
+size_t shard_for_hash(size_t hash) noexcept {
+  if constexpr (intern_shard_bits == 0) {
+    return 0;
+  } else {
+    return size_t(uint64_t(hash) * 0x9E3779B97F4A7C15ull >> (64 - intern_shard_bits));
+  }
+}
+
+size_t shard_of_block(size_t word) noexcept {
+  if constexpr (intern_shard_bits == 0) {
+    return 0;
+  } else {
+    return (word & control_block::local_index_mask) >> control_block::interned_shard_shift;
+  }
+}
+
+std::atomic<size_t> g_entries{0};
+std::atomic<size_t> g_hits{0};
+std::atomic<size_t> g_bytesSaved{0};
+
+}  // namespace
+
+control_block* intern_block(control_block* candidate, size_t hash,
+                            intern_equal_function equal, size_t bytes) {
+  const size_t index = shard_for_hash(hash);
+  intern_shard& shard = shards()[index];
+  std::lock_guard lock(shard.mutex);
+
+  // An entry whose count has already reached zero is on its way out; its
+  // object is still intact, since it can't be destroyed until it's been
+  // taken out under this lock, but it can't be handed out again.
+  auto [first, last] = shard.byHash.equal_range(hash);
+  for (auto it = first; it != last; ++it) {
+    const intern_entry& entry = it->second;
+    if (entry.block == candidate) {
+      return candidate;
+    }
+    if (entry.equal == equal && equal(entry.block, candidate) && entry.block->tryIncRef()) {
+      g_hits.fetch_add(1, std::memory_order_relaxed);
+      g_bytesSaved.fetch_add(bytes, std::memory_order_relaxed);
+      return entry.block;
+    }
+  }
+
+  shard.hashOf.emplace(candidate, hash);
+  try {
+    shard.byHash.emplace(hash, intern_entry{candidate, equal});
+  } catch (...) {
+    shard.hashOf.erase(candidate);
+    throw;
+  }
+
+  // Other threads may be taking and dropping references meanwhile. Nobody
+  // else can change the flags of a plain block.
+  auto word = candidate->refCount.load(std::memory_order_relaxed);
+  size_t next;
+  do {
+    next = (word & ~(control_block::edit_token_mask | control_block::local_index_mask)) |
+           control_block::interned_flag;
+    if constexpr (intern_shard_bits != 0) {
+      next |= index << control_block::interned_shard_shift;
+    }
+  } while (!candidate->refCount.compare_exchange_weak(word, next, std::memory_order_relaxed));
+  g_entries.fetch_add(1, std::memory_order_relaxed);
+  return candidate;
+}
+
+void release_interned(control_block* block) noexcept {
+  intern_shard& shard = shards()[shard_of_block(block->refCount.load(std::memory_order_relaxed))];
+  std::lock_guard lock(shard.mutex);
+  auto found = shard.hashOf.find(block);
+  assert(found != shard.hashOf.end());
+  auto [first, last] = shard.byHash.equal_range(found->second);
+  for (auto it = first; it != last; ++it) {
+    if (it->second.block == block) {
+      shard.byHash.erase(it);
+      break;
+    }
+  }
+  shard.hashOf.erase(found);
+  g_entries.fetch_sub(1, std::memory_order_relaxed);
+}
+
+}  // namespace cow::detail
+
+namespace cow {
+
+intern_stats interned_stats() noexcept {
+  intern_stats stats;
+  stats.entries = detail::g_entries.load(std::memory_order_relaxed);
+  stats.hits = detail::g_hits.load(std::memory_order_relaxed);
+  stats.bytes_saved = detail::g_bytesSaved.load(std::memory_order_relaxed);
+  return stats;
+}
+
+}  // namespace cow
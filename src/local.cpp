@@ -0,0 +1,81 @@
+#include "cow/local.h"
+
+namespace cow {
+
+namespace {
+thread_local local_scope* t_localScope = nullptr;
+}
+
+namespace detail {
+
+size_t register_local_block(control_block* block) {
+  auto& blocks = t_localScope->blocks;
+  if (blocks.size() > control_block::max_local_index) {
+    return control_block::max_local_index + 1;
+  }
+  blocks.push_back(block);
+  return blocks.size() - 1;
+}
+
+void unregister_local_block(control_block* block, size_t index) noexcept {
+  check_local_block(block, index);
+  auto& blocks = t_localScope->blocks;
+
+  // Swap the last block into the hole and fix up its index. It's local to
+  // this thread too, so a plain store is fine.
+  control_block* last = blocks.back();
+  if (last != block) {
+    blocks[index] = last;
+    auto word = last->refCount.load(std::memory_order_relaxed);
+    word = (word & ~control_block::local_index_mask) | (index << control_block::local_index_shift);
+    last->refCount.store(word, std::memory_order_relaxed);
+  }
+  blocks.pop_back();
+}
+
+void check_local_block([[maybe_unused]] const control_block* block,
+                       [[maybe_unused]] size_t index) noexcept {
+  assert(t_localScope && "local block used outside of its local_scope");
+  assert(index < t_localScope->blocks.size() &&
+         t_localScope->blocks[index] == block &&
+         "local block used outside of its local_scope");
+}
+
+}  // namespace detail
+
+local_scope::local_scope() noexcept {
+  assert(!t_localScope && "only one local_scope can be active per thread");
+  t_localScope = this;
+  detail::t_localScopeActive = detail::control_block::supports_local;
+}
+
+local_scope::~local_scope() {
+  assert(t_localScope == this);
+  publish();
+  t_localScope = nullptr;
+  detail::t_localScopeActive = false;
+}
+
+void local_scope::publish() noexcept {
+  assert(t_localScope == this && "local_scope published from another thread");
+  constexpr size_t localBits =
+      detail::control_block::local_flag | detail::control_block::local_index_mask;
+  for (detail::control_block* block : blocks) {
+    auto word = block->refCount.load(std::memory_order_relaxed);
+    block->refCount.store(word & ~localBits, std::memory_order_relaxed);
+  }
+  blocks.clear();
+}
+
+size_t local_scope::size() const noexcept {
+  return blocks.size();
+}
+
+bool local_scope::owns(const detail::control_block* block) const noexcept {
+  auto word = block->refCount.load(std::memory_order_relaxed);
+  size_t index = (word & detail::control_block::local_index_mask) >>
+                 detail::control_block::local_index_shift;
+  return index < blocks.size() && blocks[index] == block;
+}
+
+}  // namespace cow
@@ -0,0 +1,177 @@
+#include "cow/pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+namespace cow::detail {
+
+class pool_state : public std::enable_shared_from_this<pool_state> {
+ public:
+  ~pool_state() {
+    while (slabs) {
+      pool_slab* next = slabs->nextSlab;
+      ::operator delete(slabs, std::align_val_t(pool_slab_size));
+      slabs = next;
+    }
+  }
+
+  // Caller must hold the mutex.
+  void* pop(size_t sizeClass) {
+    if (pool_free_block* block = lists[sizeClass]) {
+      lists[sizeClass] = block->next;
+      return block;
+    }
+
+    const size_t blockSize = (sizeClass + 1) * pool_granularity;
+    if (carveEnd[sizeClass] - carveNext[sizeClass] < ptrdiff_t(blockSize)) {
+      auto* slab = static_cast<pool_slab*>(
+          ::operator new(pool_slab_size, std::align_val_t(pool_slab_size)));
+      slab->owner = this;
+      slab->nextSlab = slabs;
+      slabs = slab;
+      reservedBytes.fetch_add(pool_slab_size, std::memory_order_relaxed);
+      carveNext[sizeClass] = reinterpret_cast<char*>(slab) + sizeof(pool_slab);
+      carveEnd[sizeClass] = reinterpret_cast<char*>(slab) + pool_slab_size;
+    }
+
+    void* block = carveNext[sizeClass];
+    carveNext[sizeClass] += blockSize;
+    return block;
+  }
+
+  // Caller must hold the mutex.
+  void push(pool_free_block* block, size_t sizeClass) noexcept {
+    block->next = lists[sizeClass];
+    lists[sizeClass] = block;
+  }
+
+  std::mutex mutex;
+  std::atomic<bool> alive{true};
+  std::atomic<size_t> reservedBytes{0};
+
+ private:
+  pool_free_block* lists[pool_class_count]{};
+  char* carveNext[pool_class_count]{};
+  char* carveEnd[pool_class_count]{};
+  pool_slab* slabs{nullptr};
+};
+
+namespace {
+
+void flush_thread_cache(thread_cache& cache) noexcept {
+  std::lock_guard lock(cache.pool->mutex);
+  for (size_t sizeClass = 0; sizeClass < pool_class_count; ++sizeClass) {
+    while (pool_free_block* block = cache.lists[sizeClass]) {
+      cache.lists[sizeClass] = block->next;
+      cache.pool->push(block, sizeClass);
+    }
+    cache.counts[sizeClass] = 0;
+  }
+}
+
+struct thread_caches {
+  ~thread_caches();
+
+  std::vector<std::unique_ptr<thread_cache>> caches;
+};
+
+// Blocks can still be released by other thread_local destructors after ours
+// has run; they go straight to the shared lists.
+thread_local bool t_tornDown = false;
+thread_local thread_caches t_caches;
+
+thread_caches::~thread_caches() {
+  t_lastCache = nullptr;
+  t_tornDown = true;
+  for (auto& cache : caches) {
+    flush_thread_cache(*cache);
+  }
+}
+
+}  // namespace
+
+thread_cache* find_thread_cache(pool_state* pool) {
+  if (t_tornDown) {
+    return nullptr;
+  }
+
+  auto& caches = t_caches.caches;
+  for (auto& cache : caches) {
+    if (cache->pool.get() == pool) {
+      t_lastCache = cache.get();
+      return cache.get();
+    }
+  }
+
+  // Drop caches for pools that have been destroyed. Their blocks can't be
+  // live any more, so there's nothing to hand back.
+  t_lastCache = nullptr;
+  std::erase_if(caches, [](const std::unique_ptr<thread_cache>& cache) {
+    return !cache->pool->alive.load(std::memory_order_relaxed);
+  });
+
+  auto& cache = caches.emplace_back(std::make_unique<thread_cache>());
+  cache->pool = pool->shared_from_this();
+  t_lastCache = cache.get();
+  return cache.get();
+}
+
+void* refill_thread_cache(thread_cache& cache, size_t sizeClass) {
+  std::lock_guard lock(cache.pool->mutex);
+  for (unsigned i = 1; i < pool_batch_size; ++i) {
+    auto* block = static_cast<pool_free_block*>(cache.pool->pop(sizeClass));
+    block->next = cache.lists[sizeClass];
+    cache.lists[sizeClass] = block;
+  }
+  cache.counts[sizeClass] += pool_batch_size - 1;
+  return cache.pool->pop(sizeClass);
+}
+
+void drain_thread_cache(thread_cache& cache, size_t sizeClass) noexcept {
+  std::lock_guard lock(cache.pool->mutex);
+  while (cache.counts[sizeClass] > pool_batch_size) {
+    pool_free_block* block = cache.lists[sizeClass];
+    cache.lists[sizeClass] = block->next;
+    --cache.counts[sizeClass];
+    cache.pool->push(block, sizeClass);
+  }
+}
+
+void* allocate_shared(pool_state* pool, size_t sizeClass) {
+  std::lock_guard lock(pool->mutex);
+  return pool->pop(sizeClass);
+}
+
+void deallocate_shared(pool_state* pool, void* block, size_t sizeClass) noexcept {
+  std::lock_guard lock(pool->mutex);
+  pool->push(static_cast<pool_free_block*>(block), sizeClass);
+}
+
+pool_state* state_of(block_pool& pool) noexcept {
+  return pool.state.get();
+}
+
+}  // namespace cow::detail
+
+namespace cow {
+
+block_pool::block_pool() : state(std::make_shared<detail::pool_state>()) {}
+
+block_pool::~block_pool() {
+  state->alive.store(false, std::memory_order_relaxed);
+}
+
+size_t block_pool::reserved_bytes() const noexcept {
+  return state->reservedBytes.load(std::memory_order_relaxed);
+}
+
+block_pool& default_pool() noexcept {
+  // Never destroyed, so blocks released during static destruction still
+  // have somewhere to go.
+  static block_pool* pool = new block_pool();
+  return *pool;
+}
+
+}  // namespace cow
@@ -0,0 +1,209 @@
+#include "cow/reclaim.h"
+
+#include <assert.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+namespace cow::detail {
+
+// Scopes with a reclaimer hand off once they've queued this many blocks.
+inline constexpr size_t reclaim_batch_size = 256;
+
+class reclaimer_state {
+ public:
+  void add(std::vector<retired_block>& blocks, size_t bytes) {
+    {
+      std::lock_guard lock(mutex);
+      pendingBlocks.fetch_add(blocks.size(), std::memory_order_relaxed);
+      pendingBytes.fetch_add(bytes, std::memory_order_relaxed);
+      if (incoming.empty()) {
+        incoming.swap(blocks);
+      } else {
+        incoming.insert(incoming.end(), blocks.begin(), blocks.end());
+      }
+    }
+    blocks.clear();
+    wakeups.fetch_add(1, std::memory_order_release);
+    wakeups.notify_one();
+  }
+
+  void run();
+
+  // Bumped whenever there's new work or the reclaimer is stopping, and
+  // whenever a batch has been finished.
+  std::atomic<unsigned> wakeups{0};
+  std::atomic<unsigned> batchesDone{0};
+
+  std::mutex mutex;
+  std::vector<retired_block> incoming;
+  bool busy{false};
+  bool stopping{false};
+
+  std::atomic<size_t> pendingBlocks{0};
+  std::atomic<size_t> pendingBytes{0};
+  std::atomic<size_t> reclaimedBlocks{0};
+
+  std::thread thread;
+};
+
+namespace {
+
+thread_local deferred_scope* t_deferredScope = nullptr;
+
+size_t drain(reclaim_queue& queue, size_t budget) noexcept {
+  size_t destroyed = 0;
+  while (destroyed < budget && !queue.blocks.empty()) {
+    const retired_block retired = queue.blocks.back();
+    queue.blocks.pop_back();
+    queue.pendingBytes -= retired.bytes;
+    retired.destroy(retired.block);
+    ++destroyed;
+  }
+  queue.reclaimedBlocks += destroyed;
+  return destroyed;
+}
+
+void hand_off(reclaim_queue& queue) noexcept {
+  // Anything built in a local_scope may still be refcounted locally, all the
+  // way down, so it has to be torn down on this thread.
+  if (!queue.background || queue.blocks.empty() || t_localScopeActive) {
+    return;
+  }
+  try {
+    queue.background->add(queue.blocks, queue.pendingBytes);
+    queue.pendingBytes = 0;
+  } catch (...) {
+    // Out of memory for the handoff; do the work here instead.
+    drain(queue, SIZE_MAX);
+  }
+}
+
+}  // namespace
+
+void reclaimer_state::run() {
+  reclaim_queue local;
+  t_reclaimQueue = &local;
+
+  for (;;) {
+    const unsigned seen = wakeups.load(std::memory_order_acquire);
+    std::unique_lock lock(mutex);
+    if (incoming.empty()) {
+      if (stopping) {
+        break;
+      }
+      lock.unlock();
+      wakeups.wait(seen, std::memory_order_acquire);
+      continue;
+    }
+    local.blocks.swap(incoming);
+    busy = true;
+    lock.unlock();
+
+    const size_t handed = local.blocks.size();
+    size_t handedBytes = 0;
+    for (const retired_block& retired : local.blocks) {
+      handedBytes += retired.bytes;
+    }
+    local.pendingBytes = handedBytes;
+    const size_t destroyed = drain(local, SIZE_MAX);
+
+    lock.lock();
+    pendingBlocks.fetch_sub(handed, std::memory_order_relaxed);
+    pendingBytes.fetch_sub(handedBytes, std::memory_order_relaxed);
+    reclaimedBlocks.fetch_add(destroyed, std::memory_order_relaxed);
+    busy = false;
+    lock.unlock();
+    batchesDone.fetch_add(1, std::memory_order_release);
+    batchesDone.notify_all();
+  }
+
+  t_reclaimQueue = nullptr;
+}
+
+void defer_block(reclaim_queue* queue, control_block* block, destroy_function destroy,
+                 size_t bytes) noexcept {
+  try {
+    queue->blocks.push_back({block, destroy, bytes});
+  } catch (...) {
+    destroy(block);
+    return;
+  }
+  queue->pendingBytes += bytes;
+  if (queue->background && queue->blocks.size() >= reclaim_batch_size) {
+    hand_off(*queue);
+  }
+}
+
+}  // namespace cow::detail
+
+namespace cow {
+
+deferred_scope::deferred_scope() noexcept {
+  assert(!detail::t_deferredScope && "only one deferred_scope can be active per thread");
+  detail::t_deferredScope = this;
+  detail::t_reclaimQueue = &queue;
+}
+
+deferred_scope::deferred_scope(reclaimer& background) noexcept : deferred_scope() {
+  queue.background = background.state.get();
+}
+
+deferred_scope::~deferred_scope() {
+  assert(detail::t_deferredScope == this);
+  if (queue.background) {
+    detail::hand_off(queue);
+  }
+  detail::drain(queue, SIZE_MAX);
+  detail::t_reclaimQueue = nullptr;
+  detail::t_deferredScope = nullptr;
+}
+
+size_t deferred_scope::reclaim(size_t budget) noexcept {
+  assert(detail::t_deferredScope == this && "deferred_scope used from another thread");
+  return detail::drain(queue, budget);
+}
+
+void deferred_scope::hand_off() noexcept {
+  assert(detail::t_deferredScope == this && "deferred_scope used from another thread");
+  detail::hand_off(queue);
+}
+
+reclaim_stats deferred_scope::stats() const noexcept {
+  return {queue.blocks.size(), queue.pendingBytes, queue.reclaimedBlocks};
+}
+
+reclaimer::reclaimer() : state(std::make_unique<detail::reclaimer_state>()) {
+  state->thread = std::thread([s = state.get()] { s->run(); });
+}
+
+reclaimer::~reclaimer() {
+  {
+    std::lock_guard lock(state->mutex);
+    state->stopping = true;
+  }
+  state->wakeups.fetch_add(1, std::memory_order_release);
+  state->wakeups.notify_one();
+  state->thread.join();
+}
+
+void reclaimer::flush() {
+  for (;;) {
+    const unsigned seen = state->batchesDone.load(std::memory_order_acquire);
+    {
+      std::lock_guard lock(state->mutex);
+      if (state->incoming.empty() && !state->busy) {
+        return;
+      }
+    }
+    state->batchesDone.wait(seen, std::memory_order_acquire);
+  }
+}
+
+reclaim_stats reclaimer::stats() const noexcept {
+  return {state->pendingBlocks.load(std::memory_order_relaxed),
+          state->pendingBytes.load(std::memory_order_relaxed),
+          state->reclaimedBlocks.load(std::memory_order_relaxed)};
+}
+
+}  // namespace cow
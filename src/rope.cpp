@@ -0,0 +1,217 @@
+#include "cow/rope.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <vector>
+
+namespace cow {
+
+detail::rope_chunk::rope_chunk(std::string_view first,
+                               std::string_view second) noexcept
+    : size(first.size() + second.size()) {
+  assert(size <= rope_chunk_size);
+  std::memcpy(bytes, first.data(), first.size());
+  std::memcpy(bytes + first.size(), second.data(), second.size());
+}
+
+namespace {
+
+using detail::rope_chunk;
+using detail::rope_node;
+
+ptr<rope_node> make_leaf(ptr<rope_chunk> chunk, size_t offset, size_t length) {
+  return make<rope_node>(length, 0u, nullptr, nullptr, std::move(chunk), offset);
+}
+
+ptr<rope_node> make_branch(ptr<rope_node> left, ptr<rope_node> right) {
+  const size_t length = left->length + right->length;
+  const unsigned height = std::max(left->height, right->height) + 1;
+  return make<rope_node>(length, height, std::move(left), std::move(right),
+                         nullptr, size_t(0));
+}
+
+unsigned height_of(const ptr<rope_node>& from) noexcept {
+  return from->height;
+}
+
+// Copies bytes into a fresh chunk. bytes must fit.
+ptr<rope_node> make_chunk(std::string_view bytes) {
+  return make_leaf(make<rope_chunk>(bytes), 0, bytes.size());
+}
+
+// Two adjacent leaves that fit in one chunk become one: a wider view if
+// they're neighbours in the same chunk, or else a copy.
+ptr<rope_node> merge_leaves(const ptr<rope_node>& left,
+                            const ptr<rope_node>& right) {
+  if (left->chunk == right->chunk &&
+      left->offset + left->length == right->offset) {
+    return make_leaf(left->chunk, left->offset, left->length + right->length);
+  }
+  return make_leaf(
+      make<rope_chunk>(
+          std::string_view(left->chunk->bytes + left->offset, left->length),
+          std::string_view(right->chunk->bytes + right->offset, right->length)),
+      0, left->length + right->length);
+}
+
+// Builds a branch over two subtrees whose heights may differ by two, with
+// a single or double rotation if they do.
+ptr<rope_node> balance(ptr<rope_node> left, ptr<rope_node> right) {
+  if (height_of(left) > height_of(right) + 1) {
+    if (height_of(left->left) >= height_of(left->right)) {
+      return make_branch(left->left, make_branch(left->right, std::move(right)));
+    }
+    const ptr<rope_node>& middle = left->right;
+    return make_branch(make_branch(left->left, middle->left),
+                       make_branch(middle->right, std::move(right)));
+  }
+  if (height_of(right) > height_of(left) + 1) {
+    if (height_of(right->right) >= height_of(right->left)) {
+      return make_branch(make_branch(std::move(left), right->left), right->right);
+    }
+    const ptr<rope_node>& middle = right->left;
+    return make_branch(make_branch(std::move(left), middle->left),
+                       make_branch(middle->right, right->right));
+  }
+  return make_branch(std::move(left), std::move(right));
+}
+
+// Concatenates two trees in O(difference in height): the shorter one is
+// joined onto the taller one's nearer edge, rebalancing on the way back up.
+ptr<rope_node> join(ptr<rope_node> left, ptr<rope_node> right) {
+  if (!left) {
+    return right;
+  }
+  if (!right) {
+    return left;
+  }
+  if (left->height == 0 && right->height == 0 &&
+      left->length + right->length <= rope_chunk_size) {
+    return merge_leaves(left, right);
+  }
+  if (left->height > right->height + 1) {
+    return balance(left->left, join(left->right, std::move(right)));
+  }
+  if (right->height > left->height + 1) {
+    return balance(join(std::move(left), right->left), right->right);
+  }
+  return make_branch(std::move(left), std::move(right));
+}
+
+// The first at bytes of from, and the rest.
+std::pair<ptr<rope_node>, ptr<rope_node>> split(const ptr<rope_node>& from,
+                                                size_t at) {
+  if (!from || at == 0) {
+    return {nullptr, from};
+  }
+  if (at >= from->length) {
+    return {from, nullptr};
+  }
+  if (from->height == 0) {
+    return {make_leaf(from->chunk, from->offset, at),
+            make_leaf(from->chunk, from->offset + at, from->length - at)};
+  }
+  const size_t leftLength = from->left->length;
+  if (at <= leftLength) {
+    auto [before, after] = split(from->left, at);
+    return {std::move(before), join(std::move(after), from->right)};
+  }
+  auto [before, after] = split(from->right, at - leftLength);
+  return {join(from->left, std::move(before)), std::move(after)};
+}
+
+ptr<rope_node> build(const std::vector<ptr<rope_node>>& leaves, size_t first,
+                     size_t last) {
+  if (last - first == 1) {
+    return leaves[first];
+  }
+  const size_t middle = first + (last - first) / 2;
+  return make_branch(build(leaves, first, middle), build(leaves, middle, last));
+}
+
+// Full chunks, balanced by halving.
+ptr<rope_node> build(std::string_view bytes) {
+  if (bytes.empty()) {
+    return nullptr;
+  }
+  std::vector<ptr<rope_node>> leaves;
+  leaves.reserve((bytes.size() + rope_chunk_size - 1) / rope_chunk_size);
+  for (size_t at = 0; at < bytes.size(); at += rope_chunk_size) {
+    leaves.push_back(make_chunk(bytes.substr(at, rope_chunk_size)));
+  }
+  return build(leaves, 0, leaves.size());
+}
+
+}  // namespace
+
+rope::rope(std::string_view bytes) : root(build(bytes)) {}
+
+rope::rope(ptr<node> from) noexcept : root(std::move(from)) {}
+
+size_t rope::size() const noexcept {
+  return root ? root->length : 0;
+}
+
+bool rope::empty() const noexcept {
+  return !root;
+}
+
+char rope::operator[](size_t index) const noexcept {
+  assert(index < size());
+  const node* at = root.get();
+  while (at->height > 0) {
+    if (index < at->left->length) {
+      at = at->left.get();
+    } else {
+      index -= at->left->length;
+      at = at->right.get();
+    }
+  }
+  return at->chunk->bytes[at->offset + index];
+}
+
+void rope::insert(size_t at, std::string_view bytes) {
+  insert(at, rope(bytes));
+}
+
+void rope::insert(size_t at, const rope& other) {
+  assert(at <= size());
+  auto [before, after] = split(root, at);
+  root = join(join(std::move(before), other.root), std::move(after));
+}
+
+void rope::append(std::string_view bytes) {
+  append(rope(bytes));
+}
+
+void rope::append(const rope& other) {
+  root = join(std::move(root), other.root);
+}
+
+void rope::erase(size_t at, size_t count) {
+  assert(at <= size());
+  auto [before, rest] = split(root, at);
+  auto [erased, after] = split(rest, count);
+  root = join(std::move(before), std::move(after));
+}
+
+void rope::clear() noexcept {
+  root = nullptr;
+}
+
+rope rope::slice(size_t at, size_t count) const {
+  assert(at <= size());
+  auto [before, rest] = split(root, at);
+  auto [kept, after] = split(rest, count);
+  return rope(std::move(kept));
+}
+
+std::string rope::str() const {
+  std::string result;
+  result.reserve(size());
+  for_each_chunk([&](std::string_view bytes) { result.append(bytes); });
+  return result;
+}
+
+}  // namespace cow
@@ -0,0 +1,282 @@
+#include "cow/snapshot.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace cow::detail {
+
+namespace {
+
+constexpr char snapshot_magic[8] = {'c', 'o', 'w', 's', 'n', 'a', 'p', '\0'};
+constexpr uint32_t snapshot_version = 1;
+constexpr uint32_t snapshot_byte_order = 0x01020304;
+
+// At the start of the file. Offsets are from the start of the file, and
+// relocations are the offsets of every non-null pointer in the roots and
+// blocks, which hold the addresses they'll have if the file is mapped at
+// base.
+struct snapshot_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t byteOrder;
+  uint32_t pointerSize;
+  uint32_t reserved;
+  snapshot_layout layout;
+  uint64_t base;
+  uint64_t fileSize;
+  uint64_t rootsOffset;
+  uint64_t rootCount;
+  uint64_t blocksOffset;
+  uint64_t blockCount;
+  uint64_t relocationsOffset;
+  uint64_t relocationCount;
+};
+
+uint64_t align_up(uint64_t offset, uint64_t align) noexcept {
+  return (offset + align - 1) / align * align;
+}
+
+// Each file is written for its own address, picked at random from 64K
+// 1GiB-aligned slots well clear of where the system puts heaps and
+// libraries, so several snapshots open at once usually all get the
+// addresses they were written for. Narrower targets don't have room to
+// spare, and always relocate.
+uintptr_t pick_base() {
+  if constexpr (sizeof(uintptr_t) < 8) {
+    return 0;
+  } else {
+    std::random_device seed;
+    const uint64_t slot = seed() % (uint64_t(1) << 16);
+    return uintptr_t((uint64_t(1) << 44) + (slot << 30));
+  }
+}
+
+[[noreturn]] void throw_errno(const std::string& what) {
+  throw std::system_error(errno, std::generic_category(), what);
+}
+
+[[noreturn]] void throw_invalid(const std::string& path, const char* why) {
+  throw std::runtime_error("snapshot " + path + ": " + why);
+}
+
+void check_header(const snapshot_header& header, const snapshot_layout& layout, uint64_t fileSize,
+                  const std::string& path) {
+  if (std::memcmp(header.magic, snapshot_magic, sizeof(snapshot_magic)) != 0) {
+    throw_invalid(path, "not a snapshot file");
+  }
+  if (header.version != snapshot_version || header.byteOrder != snapshot_byte_order ||
+      header.pointerSize != sizeof(uintptr_t)) {
+    throw_invalid(path, "written by an incompatible build");
+  }
+  if (header.layout.typeHash != layout.typeHash || header.layout.blockSize != layout.blockSize ||
+      header.layout.blockAlign != layout.blockAlign ||
+      header.layout.objectOffset != layout.objectOffset) {
+    throw_invalid(path, "written for a different type");
+  }
+  if (header.fileSize != fileSize || header.rootsOffset < sizeof(snapshot_header) ||
+      header.rootsOffset > fileSize || header.blocksOffset > fileSize ||
+      header.rootCount > fileSize / sizeof(uintptr_t) ||
+      header.blocksOffset < header.rootsOffset + header.rootCount * sizeof(uintptr_t) ||
+      header.blocksOffset % layout.blockAlign != 0 || header.blockCount > fileSize / layout.blockSize ||
+      header.relocationsOffset < header.blocksOffset + header.blockCount * layout.blockSize ||
+      header.relocationsOffset > fileSize ||
+      header.relocationCount > (fileSize - header.relocationsOffset) / sizeof(uint64_t)) {
+    throw_invalid(path, "truncated or corrupt");
+  }
+}
+
+// Moves every pointer in a private mapping by how far it is from base.
+void relocate(char* address, const snapshot_header& header, const std::string& path) {
+  const uintptr_t delta = reinterpret_cast<uintptr_t>(address) - uintptr_t(header.base);
+  const uint64_t end = header.blocksOffset + header.blockCount * header.layout.blockSize;
+  const char* entry = address + header.relocationsOffset;
+  for (uint64_t i = 0; i < header.relocationCount; ++i, entry += sizeof(uint64_t)) {
+    uint64_t offset;
+    std::memcpy(&offset, entry, sizeof(offset));
+    if (offset < header.rootsOffset || offset > end - sizeof(uintptr_t) ||
+        offset % alignof(uintptr_t) != 0) {
+      throw_invalid(path, "truncated or corrupt");
+    }
+    *reinterpret_cast<uintptr_t*>(address + offset) += delta;
+  }
+}
+
+}  // namespace
+
+snapshot_writer::snapshot_writer(const std::string& path, const snapshot_layout& layout, size_t rootCount,
+                                 size_t blockCount)
+    : file(std::fopen((path + ".part").c_str(), "wb")),
+      path(path),
+      layout(layout),
+      base(pick_base()),
+      rootCount(rootCount),
+      blockCount(blockCount),
+      rootsOffset(align_up(sizeof(snapshot_header), alignof(uintptr_t))),
+      blocksOffset(align_up(rootsOffset + rootCount * sizeof(uintptr_t), layout.blockAlign)) {
+  if (!file) {
+    throw_errno("can't create snapshot " + path);
+  }
+}
+
+snapshot_writer::~snapshot_writer() {
+  if (file) {
+    std::fclose(file);
+    std::remove((path + ".part").c_str());
+  }
+}
+
+uintptr_t snapshot_writer::object_address(size_t index) const noexcept {
+  assert(index < blockCount);
+  return base + uintptr_t(blocksOffset + index * layout.blockSize + layout.objectOffset);
+}
+
+void snapshot_writer::write_root(uintptr_t object) {
+  assert(rootsWritten < rootCount);
+  pad_to(rootsOffset + rootsWritten * sizeof(uintptr_t));
+  if (object) {
+    relocations.push_back(position);
+  }
+  write(&object, sizeof(object));
+  ++rootsWritten;
+}
+
+void snapshot_writer::write_block(const void* image, const std::vector<size_t>& slots) {
+  assert(rootsWritten == rootCount && blocksWritten < blockCount);
+  pad_to(blocksOffset + blocksWritten * layout.blockSize);
+  for (const size_t slot : slots) {
+    relocations.push_back(position + slot);
+  }
+  write(image, layout.blockSize);
+  ++blocksWritten;
+}
+
+void snapshot_writer::finish() {
+  assert(rootsWritten == rootCount && blocksWritten == blockCount);
+  pad_to(std::max(position, blocksOffset));
+  const uint64_t relocationsOffset = align_up(position, alignof(uint64_t));
+  pad_to(relocationsOffset);
+  write(relocations.data(), relocations.size() * sizeof(uint64_t));
+
+  snapshot_header header{};
+  std::memcpy(header.magic, snapshot_magic, sizeof(snapshot_magic));
+  header.version = snapshot_version;
+  header.byteOrder = snapshot_byte_order;
+  header.pointerSize = sizeof(uintptr_t);
+  header.layout = layout;
+  header.base = base;
+  header.fileSize = position;
+  header.rootsOffset = rootsOffset;
+  header.rootCount = rootCount;
+  header.blocksOffset = blocksOffset;
+  header.blockCount = blockCount;
+  header.relocationsOffset = relocationsOffset;
+  header.relocationCount = relocations.size();
+  if (std::fseek(file, 0, SEEK_SET) != 0) {
+    throw_errno("can't write snapshot " + path);
+  }
+  write(&header, sizeof(header));
+
+  // Renamed into place, so a snapshot already open from path keeps the
+  // file it mapped.
+  std::FILE* const closing = std::exchange(file, nullptr);
+  if (std::fclose(closing) != 0 || std::rename((path + ".part").c_str(), path.c_str()) != 0) {
+    const int error = errno;
+    std::remove((path + ".part").c_str());
+    errno = error;
+    throw_errno("can't write snapshot " + path);
+  }
+}
+
+void snapshot_writer::write(const void* bytes, size_t size) {
+  if (size != 0 && std::fwrite(bytes, 1, size, file) != size) {
+    throw_errno("can't write snapshot " + path);
+  }
+  position += size;
+}
+
+void snapshot_writer::pad_to(uint64_t offset) {
+  static constexpr char zeros[64] = {};
+  assert(offset >= position);
+  while (position < offset) {
+    write(zeros, size_t(std::min<uint64_t>(offset - position, sizeof(zeros))));
+  }
+}
+
+snapshot_mapping map_snapshot(const std::string& path, const snapshot_layout& layout) {
+  const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    throw_errno("can't open snapshot " + path);
+  }
+  struct closer {
+    int fd;
+    ~closer() { ::close(fd); }
+  } closeOnExit{fd};
+
+  struct stat info;
+  if (::fstat(fd, &info) != 0) {
+    throw_errno("can't open snapshot " + path);
+  }
+  const uint64_t fileSize = uint64_t(info.st_size);
+  snapshot_header header;
+  if (fileSize < sizeof(header) || ::pread(fd, &header, sizeof(header), 0) != ssize_t(sizeof(header))) {
+    throw_invalid(path, "not a snapshot file");
+  }
+  check_header(header, layout, fileSize, path);
+
+  // Where it was written for, the pages are only read in as they're used.
+  const size_t size = size_t(fileSize);
+  void* const wanted = reinterpret_cast<void*>(uintptr_t(header.base));
+  void* address = ::mmap(wanted, size, PROT_READ, MAP_SHARED, fd, 0);
+  if (address == MAP_FAILED) {
+    throw_errno("can't map snapshot " + path);
+  }
+  if (address == wanted) {
+    return {address, size, static_cast<char*>(address) + header.rootsOffset, size_t(header.rootCount),
+            size_t(header.blockCount), false};
+  }
+
+  // Anywhere else, a private copy has every pointer in it moved.
+  ::munmap(address, size);
+  address = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if (address == MAP_FAILED) {
+    throw_errno("can't map snapshot " + path);
+  }
+  try {
+    relocate(static_cast<char*>(address), header, path);
+  } catch (...) {
+    ::munmap(address, size);
+    throw;
+  }
+  ::mprotect(address, size, PROT_READ);
+  return {address, size, static_cast<char*>(address) + header.rootsOffset, size_t(header.rootCount),
+          size_t(header.blockCount), true};
+}
+
+void unmap_snapshot(const snapshot_mapping& mapping) noexcept {
+  if (mapping.address) {
+    ::munmap(mapping.address, mapping.size);
+  }
+}
+
+uint64_t snapshot_type_hash(const char* name) noexcept {
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for (; *name; ++name) {
+    hash = (hash ^ uint8_t(*name)) * 0x100000001b3ull;
+  }
+  return hash;
+}
+
+}  // namespace cow::detail
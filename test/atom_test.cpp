@@ -0,0 +1,167 @@
+#include "cow/atom.h"
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace {
+std::atomic<int> g_live{0};
+
+struct counter {
+  long value{0};
+  long twice{0};
+
+  counter(long v = 0) : value(v), twice(2 * v) { ++g_live; }
+  counter(const counter& other) : value(other.value), twice(other.twice) { ++g_live; }
+  ~counter() { --g_live; }
+};
+}  // namespace
+
+TEST(CowAtom, LoadStoreExchange) {
+  {
+    cow::atom<counter> cell(cow::make<counter>(1));
+    cow::ptr<counter> one = cell.load();
+    EXPECT_EQ(one->value, 1);
+    EXPECT_EQ(one.use_count(), 2u);
+
+    cell.store(cow::make<counter>(2));
+    EXPECT_EQ(one.use_count(), 1u);
+    EXPECT_EQ(cell.load()->value, 2);
+
+    cow::ptr<counter> two = cell.exchange(cow::make<counter>(3));
+    EXPECT_EQ(two->value, 2);
+    EXPECT_EQ(two.use_count(), 1u);
+
+    cow::ptr<counter> expected = one;
+    EXPECT_FALSE(cell.compare_exchange(expected, cow::make<counter>(4)));
+    EXPECT_EQ(expected->value, 3);
+    EXPECT_TRUE(cell.compare_exchange(expected, cow::make<counter>(4)));
+    EXPECT_EQ(cell.load()->value, 4);
+    EXPECT_EQ(expected.use_count(), 1u);
+
+    // The atom still shares the root it hands update, so write() copies.
+    cow::ptr<counter> before = cell.load();
+    cow::ptr<counter> after = cell.swap([](cow::ptr<counter> c) {
+      c.write()->value += 1;
+      return c;
+    });
+    EXPECT_EQ(before->value, 4);
+    EXPECT_EQ(after->value, 5);
+    EXPECT_EQ(cell.load(), after);
+
+    cell.store(nullptr);
+    EXPECT_FALSE(cell.load());
+  }
+  EXPECT_EQ(g_live.load(), 0);
+}
+
+TEST(CowAtom, AnnouncedRootsAreReleasedLater) {
+  cow::atom<counter> cell(cow::make<counter>(1));
+  cow::ptr<counter> probe = cell.load();
+  const int live = g_live.load();
+
+  // Pretend a reader is between reading the root and taking its reference.
+  // This thread has a record already, from the load().
+  cow::detail::hazard_record* const record = cow::detail::t_hazardRecord;
+  record->hazard.store(cow::detail::ptr_access::control(probe));
+  const counter* const announced = probe.get();
+  cell.store(cow::make<counter>(2));
+  probe = nullptr;
+  EXPECT_EQ(g_live.load(), live + 1);
+  EXPECT_EQ(announced->value, 1);
+
+  record->hazard.store(nullptr);
+  cell.store(cow::make<counter>(3));
+  EXPECT_EQ(g_live.load(), live);
+}
+
+TEST(CowAtom, ReadersAndWritersRace) {
+  const int live = g_live.load();
+  {
+    cow::atom<counter> cell(cow::make<counter>(0));
+    std::atomic<bool> done{false};
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 4; ++r) {
+      readers.emplace_back([&] {
+        long last = 0;
+        while (!done.load(std::memory_order_relaxed)) {
+          const cow::ptr<counter> snapshot = cell.load();
+          ASSERT_EQ(snapshot->twice, 2 * snapshot->value);
+          ASSERT_GE(snapshot->value, last);
+          last = snapshot->value;
+        }
+      });
+    }
+    std::vector<std::thread> writers;
+    for (int w = 0; w < 2; ++w) {
+      writers.emplace_back([&] {
+        for (int i = 0; i < 5000; ++i) {
+          cell.swap([](cow::ptr<counter> c) {
+            counter* at = c.write();
+            at->value += 1;
+            at->twice += 2;
+            return c;
+          });
+        }
+      });
+    }
+    for (std::thread& writer : writers) {
+      writer.join();
+    }
+    done.store(true);
+    for (std::thread& reader : readers) {
+      reader.join();
+    }
+    EXPECT_EQ(cell.load()->value, 10000);
+  }
+  EXPECT_EQ(g_live.load(), live);
+}
+
+TEST(CowAtom, BorrowedRootsOutliveTheirGuards) {
+  cow::atom<counter> cell(cow::make<counter>(1));
+  const int live = g_live.load();
+  {
+    cow::read_guard guard;
+    const cow::ref<counter> first = cell.borrow(guard);
+    EXPECT_EQ(first->value, 1);
+    EXPECT_EQ(first.use_count(), 1u);
+
+    // Replaced while borrowed, and not released until the guard ends.
+    cell.store(cow::make<counter>(2));
+    EXPECT_EQ(cow::collect_roots(), 1u);
+    EXPECT_EQ(g_live.load(), live + 1);
+    {
+      cow::read_guard nested;
+      EXPECT_EQ(cell.borrow(nested)->value, 2);
+    }
+    EXPECT_EQ(first->value, 1);
+    EXPECT_EQ(cow::collect_roots(), 1u);
+  }
+  EXPECT_EQ(cow::collect_roots(), 0u);
+  EXPECT_EQ(g_live.load(), live);
+
+  // Readers borrowing while writers replace the root.
+  std::atomic<bool> done{false};
+  std::vector<std::thread> readers;
+  for (int r = 0; r < 4; ++r) {
+    readers.emplace_back([&] {
+      while (!done.load(std::memory_order_relaxed)) {
+        cow::read_guard guard;
+        for (int i = 0; i < 16; ++i) {
+          const cow::ref<counter> c = cell.borrow(guard);
+          ASSERT_EQ(c->twice, 2 * c->value);
+        }
+      }
+    });
+  }
+  for (int i = 0; i < 20000; ++i) {
+    cell.store(cow::make<counter>(i));
+  }
+  done.store(true);
+  for (std::thread& reader : readers) {
+    reader.join();
+  }
+  cow::collect_roots();
+  EXPECT_EQ(g_live.load(), live);
+}
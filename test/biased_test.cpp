@@ -0,0 +1,135 @@
+#include "cow/biased.h"
+#include "cow/local.h"
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+
+namespace {
+std::atomic<int> liveCount{0};
+
+struct counted {
+  explicit counted(int v = 0) : value(v) { ++liveCount; }
+  counted(const counted& other) : value(other.value) { ++liveCount; }
+  ~counted() { --liveCount; }
+  int value;
+};
+
+struct shape {
+  virtual ~shape() = default;
+  int sides{0};
+};
+
+struct square : shape {
+  square() { sides = 4; }
+};
+
+cow::ptr<counted> make_biased(int value = 0) {
+  return cow::allocate_make<counted>(cow::default_pool(), cow::block_flags::biased, value);
+}
+}  // namespace
+
+TEST(CowBiased, OwnerCopiesAndDrops) {
+  {
+    auto a = make_biased(1);
+    auto b = a;
+    auto c = b;
+    EXPECT_EQ(a.use_count(), 3);
+    c = nullptr;
+    EXPECT_EQ(a.use_count(), 2);
+
+    // Shared, so this clones; the clone is biased to this thread too.
+    b--->value = 2;
+    EXPECT_EQ(liveCount, 2);
+    EXPECT_EQ(b.use_count(), 1);
+    b--->value = 3;
+    EXPECT_EQ(liveCount, 2);
+    EXPECT_EQ(a->value, 1);
+  }
+  EXPECT_EQ(liveCount, 0);
+}
+
+TEST(CowBiased, OtherThreadOutlivesOwnerRefs) {
+  auto a = make_biased(1);
+  auto copy = a;
+  std::thread reader([copy = std::move(copy)]() mutable {
+    auto more = copy;
+    EXPECT_EQ(more->value, 1);
+  });
+  reader.join();
+
+  // The reader's drops took the shared count below zero, so the block waits
+  // in this thread's queue even though a is still alive.
+  EXPECT_EQ(liveCount, 1);
+  a = nullptr;
+  EXPECT_EQ(liveCount, 1);
+  EXPECT_EQ(cow::collect_biased(), 1);
+  EXPECT_EQ(liveCount, 0);
+}
+
+TEST(CowBiased, OwnerDropsFirst) {
+  auto a = make_biased(1);
+  std::atomic<int> step{0};
+  std::thread reader([&] {
+    auto copy = a;
+    step.store(1);
+    while (step.load() != 2) {
+      std::this_thread::yield();
+    }
+    // The owner's count has been merged, so this is an ordinary drop.
+    EXPECT_EQ(copy.use_count(), 1);
+    copy = nullptr;
+    EXPECT_EQ(liveCount, 0);
+  });
+  while (step.load() != 1) {
+    std::this_thread::yield();
+  }
+  a = nullptr;
+  step.store(2);
+  reader.join();
+  EXPECT_EQ(cow::collect_biased(), 0);
+}
+
+TEST(CowBiased, OwnerExits) {
+  cow::ptr<counted> kept;
+  std::thread([&] {
+    auto a = make_biased(5);
+    kept = a;
+    auto b = a;
+  }).join();
+  EXPECT_EQ(kept->value, 5);
+  kept = nullptr;
+  EXPECT_EQ(liveCount, 0);
+}
+
+TEST(CowBiased, WriteOnOtherThreadClones) {
+  auto a = make_biased(1);
+  cow::ptr<counted> result;
+  std::thread([&, moved = std::move(a)]() mutable {
+    moved--->value = 2;
+    result = std::move(moved);
+  }).join();
+  EXPECT_EQ(result->value, 2);
+  EXPECT_EQ(cow::collect_biased(), 1);
+  EXPECT_EQ(liveCount, 1);
+  result = nullptr;
+  EXPECT_EQ(liveCount, 0);
+}
+
+TEST(CowBiased, Polymorphic) {
+  cow::ptr<shape> s = cow::allocate_make<square>(cow::default_pool(), cow::block_flags::biased);
+  auto t = s;
+  EXPECT_EQ(t.use_count(), 2);
+  t--->sides = 5;
+  EXPECT_EQ(t->sides, 5);
+  EXPECT_EQ(s->sides, 4);
+  EXPECT_EQ(t.type_info(), typeid(square));
+}
+
+TEST(CowBiased, LocalScopeWins) {
+  cow::local_scope scope;
+  auto a = make_biased(1);
+  EXPECT_TRUE(cow::detail::ptr_access::control(a)->is_local());
+  a = nullptr;
+  EXPECT_EQ(liveCount, 0);
+}
@@ -0,0 +1,333 @@
+#include "cow/btree_map.h"
+#include <gtest/gtest.h>
+
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+template <typename Map, typename Expected>
+void expect_same(const Map& actual, const Expected& expected) {
+  ASSERT_EQ(actual.size(), expected.size());
+  auto want = expected.begin();
+  for (const auto& [key, value] : actual) {
+    ASSERT_NE(want, expected.end());
+    EXPECT_EQ(key, want->first);
+    EXPECT_EQ(value, want->second);
+    ++want;
+  }
+  EXPECT_EQ(want, expected.end());
+}
+
+// Neither can be default constructed. Only live values are counted.
+struct id {
+  explicit id(int value) : value(value) {}
+  int value;
+  bool operator<(const id& other) const { return value < other.value; }
+};
+
+struct tracked {
+  static inline int live = 0;
+
+  explicit tracked(int value) : value(value) { ++live; }
+  tracked(const tracked& other) : value(other.value) { ++live; }
+  tracked(tracked&& other) noexcept : value(other.value) { ++live; }
+  tracked& operator=(const tracked&) = default;
+  tracked& operator=(tracked&&) noexcept = default;
+  ~tracked() { --live; }
+
+  int value;
+};
+
+// Orders keys either way, as chosen when it's made.
+struct either_way {
+  explicit either_way(bool descending = false) : descending(descending) {}
+  bool operator()(int a, int b) const { return descending ? b < a : a < b; }
+  bool descending;
+};
+}  // namespace
+
+TEST(CowBTreeMap, MatchesStdMap) {
+  cow::btree_map<int, int> map;
+  std::map<int, int> expected;
+  std::vector<std::pair<cow::btree_map<int, int>, std::map<int, int>>> snapshots;
+
+  std::mt19937 random(2024);
+  for (int i = 0; i < 30000; ++i) {
+    const int key = int(random() % 20000);
+    switch (random() % 8) {
+      case 0:
+      case 1:
+        EXPECT_EQ(map.insert(key, i), expected.emplace(key, i).second);
+        break;
+      case 2:
+      case 3:
+        EXPECT_EQ(map.insert_or_assign(key, i), expected.insert_or_assign(key, i).second);
+        break;
+      case 4:
+      case 5:
+        EXPECT_EQ(map.erase(key), expected.erase(key) == 1);
+        break;
+      case 6: {
+        const int to = key + int(random() % 300);
+        auto first = expected.lower_bound(key);
+        auto last = expected.lower_bound(to);
+        const size_t removed = size_t(std::distance(first, last));
+        expected.erase(first, last);
+        EXPECT_EQ(map.erase(key, to), removed);
+        break;
+      }
+      case 7: {
+        auto found = map.lower_bound(key);
+        auto want = expected.lower_bound(key);
+        if (want == expected.end()) {
+          EXPECT_TRUE(found == map.end());
+        } else {
+          ASSERT_TRUE(found != map.end());
+          EXPECT_EQ(found.key(), want->first);
+          EXPECT_EQ(found.value(), want->second);
+        }
+        break;
+      }
+    }
+    if (i % 3000 == 0) {
+      snapshots.emplace_back(map, expected);
+    }
+  }
+  expect_same(map, expected);
+
+  // Earlier copies never see later changes.
+  for (const auto& [snapshot, then] : snapshots) {
+    expect_same(snapshot, then);
+  }
+}
+
+TEST(CowBTreeMap, StringKeysAndLookups) {
+  cow::btree_map<std::string, int> map;
+  std::map<std::string, int> expected;
+  for (int i = 0; i < 2000; ++i) {
+    map.insert(std::to_string(i * 37 % 2000), i);
+    expected.emplace(std::to_string(i * 37 % 2000), i);
+  }
+  expect_same(map, expected);
+  EXPECT_EQ(*map.find("1234"), expected["1234"]);
+  EXPECT_EQ(map.find("nope"), nullptr);
+  EXPECT_EQ(map.lower_bound("1235x").key(), "1236");
+
+  EXPECT_EQ(map.erase("1", "2"), 1111u);
+  EXPECT_FALSE(map.contains("1999"));
+  EXPECT_TRUE(map.contains("2"));
+  EXPECT_EQ(map.size(), 889u);
+  EXPECT_EQ(map.erase("", "~"), 889u);
+  EXPECT_TRUE(map.empty());
+  EXPECT_TRUE(map.begin() == map.end());
+}
+
+TEST(CowBTreeMap, CursorWriteCopiesPath) {
+  cow::btree_map<int, int> a;
+  for (int i = 0; i < 10000; ++i) {
+    a.insert(i, i);
+  }
+  auto b = a;
+
+  auto cursor = b.seek(5000);
+  ASSERT_TRUE(cursor);
+  EXPECT_EQ(cursor.key(), 5000);
+  *cursor.write() = -1;
+  ++cursor;
+  EXPECT_EQ(cursor.key(), 5001);
+  *cursor.write() = -2;
+
+  EXPECT_EQ(*a.find(5000), 5000);
+  EXPECT_EQ(*b.find(5000), -1);
+  EXPECT_EQ(*b.find(5001), -2);
+
+  // Leaves off the written path are still shared.
+  EXPECT_EQ(a.find(0), b.find(0));
+  EXPECT_EQ(a.find(9999), b.find(9999));
+  EXPECT_NE(a.find(5000), b.find(5000));
+
+  // Unique now, so writing again changes b in place.
+  const int* before = b.find(5000);
+  *b.seek(5000).write() = -3;
+  EXPECT_EQ(b.find(5000), before);
+
+  // A cursor walks every leaf in order.
+  int expected = 9000;
+  for (auto walk = b.seek(9000); walk; ++walk) {
+    EXPECT_EQ(walk.key(), expected++);
+  }
+  EXPECT_EQ(expected, 10000);
+  EXPECT_FALSE(b.seek(10000));
+}
+
+TEST(CowBTreeMap, RangeEraseSharesUntouchedNodes) {
+  cow::btree_map<int, int> a;
+  for (int i = 0; i < 50000; ++i) {
+    a.insert(i, i);
+  }
+  auto b = a;
+
+  EXPECT_EQ(b.erase(1000, 49000), 48000u);
+  EXPECT_EQ(b.size(), 2000u);
+  EXPECT_EQ(a.size(), 50000u);
+  EXPECT_EQ(a.find(0), b.find(0));
+  EXPECT_EQ(*a.find(20000), 20000);
+  EXPECT_FALSE(b.contains(20000));
+
+  std::vector<int> keys;
+  for (const auto& [key, value] : b) {
+    keys.push_back(key);
+  }
+  ASSERT_EQ(keys.size(), 2000u);
+  EXPECT_EQ(keys[999], 999);
+  EXPECT_EQ(keys[1000], 49000);
+
+  // It keeps working as a tree afterwards.
+  for (int i = 1000; i < 49000; i += 7) {
+    b.insert(i, -i);
+  }
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_TRUE(b.erase(i));
+  }
+  EXPECT_EQ(b.size(), 1000u + (48000 + 6) / 7);
+  EXPECT_EQ(b.begin().key(), 1000);
+}
+
+TEST(CowBTreeMap, RangeEraseThenEraseLast) {
+  cow::btree_map<int, int> map;
+  for (int i = 0; i < 20000; ++i) {
+    map.insert(i, i);
+  }
+  EXPECT_EQ(map.erase(1, 19999), 19998u);
+  EXPECT_TRUE(map.erase(19999));
+  std::map<int, int> expected{{0, 0}};
+  expect_same(map, expected);
+  EXPECT_EQ(map.lower_bound(1), map.end());
+}
+
+TEST(CowBTreeMap, RangeErasesOnTallTrees) {
+  // Sequential inserts leave leaves and branches half full, so 20000 keys
+  // make a tree of height 3.
+  cow::btree_map<int, int> full;
+  std::map<int, int> fullExpected;
+  for (int i = 0; i < 20000; ++i) {
+    full.insert(i, i);
+    fullExpected.emplace(i, i);
+  }
+
+  std::mt19937 random(7);
+  for (int trial = 0; trial < 100; ++trial) {
+    cow::btree_map<int, int> map = full;
+    std::map<int, int> expected = fullExpected;
+    for (int range = 0; range < 2; ++range) {
+      // Often leave just a key or two in the first leaf under some branch
+      // and in the last, so the branches at the ends are left with a
+      // single, nearly empty child.
+      int from = int(random() % 20000);
+      int to = from + int(random() % (random() % 2 ? 20000 : 200));
+      if (random() % 2) {
+        const int span = random() % 2 ? 256 : 4096;
+        from = from / span * span + 1 + int(random() % 2);
+        to = (to / span + 1) * span - 1 - int(random() % 2);
+      }
+      auto first = expected.lower_bound(from);
+      auto last = expected.lower_bound(to);
+      const size_t removed = size_t(std::distance(first, last));
+      expected.erase(first, last);
+      ASSERT_EQ(map.erase(from, to), removed);
+
+      // The leaves at either end of the range are the ones left small, so
+      // empty them one key at a time.
+      for (int i = int(random() % 40); i > 0; --i) {
+        auto after = expected.lower_bound(to);
+        if (after != expected.end()) {
+          const int key = after->first;
+          expected.erase(after);
+          ASSERT_TRUE(map.erase(key));
+        }
+        auto before = expected.lower_bound(from);
+        if (before != expected.begin()) {
+          const int key = std::prev(before)->first;
+          expected.erase(std::prev(before));
+          ASSERT_TRUE(map.erase(key));
+        }
+      }
+      expect_same(map, expected);
+    }
+    for (int i = 0; i < 100; ++i) {
+      const int key = int(random() % 20000);
+      ASSERT_EQ(map.insert(key, -key), expected.emplace(key, -key).second);
+    }
+    expect_same(map, expected);
+  }
+  expect_same(full, fullExpected);
+}
+
+TEST(CowBTreeMap, HoldsOnlyItsEntries) {
+  {
+    cow::btree_map<id, tracked> map;
+    for (int i = 0; i < 5000; ++i) {
+      map.insert_or_assign(id(i * 7 % 5000), tracked(i));
+    }
+    EXPECT_EQ(tracked::live, 5000);
+
+    const cow::btree_map<id, tracked> before = map;
+    for (int i = 0; i < 5000; i += 3) {
+      map.erase(id(i));
+    }
+    map.erase(id(1000), id(3000));
+    int expected = 0;
+    for (const auto& [key, value] : map) {
+      EXPECT_TRUE(key.value % 3 != 0 && (key.value < 1000 || key.value >= 3000));
+      ++expected;
+    }
+    EXPECT_EQ(int(map.size()), expected);
+
+    // Copied leaves hold copies of their live values and nothing else, so
+    // between them the two maps hold at most every value twice.
+    EXPECT_GE(tracked::live, 5000);
+    EXPECT_LE(tracked::live, 5000 + expected);
+    EXPECT_EQ(before.size(), 5000u);
+  }
+  EXPECT_EQ(tracked::live, 0);
+}
+
+TEST(CowBTreeMap, UsesItsOwnComparator) {
+  cow::btree_map<int, int, either_way> map(either_way(true));
+  EXPECT_TRUE(map.key_comp().descending);
+  for (int i = 0; i < 2000; ++i) {
+    map.insert(i * 7 % 2000, i);
+  }
+  int previous = 2000;
+  for (const auto& [key, value] : map) {
+    EXPECT_LT(key, previous);
+    previous = key;
+  }
+  ASSERT_NE(map.find(700), nullptr);
+  EXPECT_EQ(*map.find(700), 100);
+  EXPECT_EQ(map.lower_bound(1500).key(), 1500);
+
+  // In descending order, [1500, 500) is the keys from 1500 down to 501.
+  EXPECT_EQ(map.erase(1500, 500), 1000u);
+  EXPECT_EQ(map.size(), 1000u);
+  EXPECT_TRUE(map.contains(1501));
+  EXPECT_FALSE(map.contains(1000));
+  EXPECT_TRUE(map.contains(500));
+
+  // diff walks both maps in the same order.
+  cow::btree_map<int, int, either_way> changed = map;
+  changed.erase(1600);
+  changed.insert_or_assign(400, -1);
+  changed.insert(1000, 1000);
+  std::vector<int> seen;
+  struct {
+    std::vector<int>& seen;
+    void added(int key, int) { seen.push_back(key); }
+    void removed(int key, int) { seen.push_back(-key); }
+    void changed(int key, int, int) { seen.push_back(key); }
+  } visitor{seen};
+  map.diff(changed, visitor);
+  EXPECT_EQ(seen, (std::vector<int>{-1600, 1000, 400}));
+}
@@ -0,0 +1,143 @@
+#include "cow/deque.h"
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <deque>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+template <typename T>
+std::vector<T> contents(const cow::deque<T>& d) {
+  std::vector<T> result;
+  d.for_each_chunk([&](const T* data, size_t count) { result.insert(result.end(), data, data + count); });
+  return result;
+}
+
+template <typename T>
+std::vector<T> contents(const std::deque<T>& d) {
+  return std::vector<T>(d.begin(), d.end());
+}
+}  // namespace
+
+TEST(CowDeque, MatchesStdDeque) {
+  cow::deque<int> d;
+  std::deque<int> expected;
+  std::vector<std::pair<cow::deque<int>, std::deque<int>>> snapshots;
+
+  std::mt19937 random(5);
+  for (int i = 0; i < 50000; ++i) {
+    switch (random() % 6) {
+      case 0:
+      case 1:
+        d.push_back(i);
+        expected.push_back(i);
+        break;
+      case 2:
+      case 3:
+        d.push_front(i);
+        expected.push_front(i);
+        break;
+      case 4:
+        if (!expected.empty()) {
+          d.pop_back();
+          expected.pop_back();
+        }
+        break;
+      case 5:
+        if (!expected.empty()) {
+          d.pop_front();
+          expected.pop_front();
+        }
+        break;
+    }
+    ASSERT_EQ(d.size(), expected.size());
+    if (!expected.empty()) {
+      ASSERT_EQ(d.front(), expected.front());
+      ASSERT_EQ(d.back(), expected.back());
+    }
+    if (i % 5000 == 0) {
+      snapshots.emplace_back(d, expected);
+    }
+  }
+  EXPECT_EQ(contents(d), contents(expected));
+  for (size_t i = 0; i < expected.size(); i += 7) {
+    ASSERT_EQ(d[i], expected[i]);
+  }
+
+  // Earlier copies never see later edits.
+  for (const auto& [snapshot, then] : snapshots) {
+    EXPECT_EQ(contents(snapshot), contents(then));
+  }
+}
+
+TEST(CowDeque, SplitAndAppend) {
+  std::vector<std::string> values;
+  for (int i = 0; i < 5000; ++i) {
+    values.push_back(std::to_string(i));
+  }
+  const cow::deque<std::string> whole = cow::deque<std::string>::from_range(values);
+
+  for (size_t at : {size_t(0), size_t(1), size_t(31), size_t(32), size_t(33), size_t(1000),
+                    size_t(2500), size_t(4999), size_t(5000)}) {
+    auto [before, after] = whole.split(at);
+    ASSERT_EQ(before.size(), at);
+    ASSERT_EQ(after.size(), values.size() - at);
+    EXPECT_EQ(contents(before), std::vector<std::string>(values.begin(), values.begin() + at));
+    EXPECT_EQ(contents(after), std::vector<std::string>(values.begin() + at, values.end()));
+
+    before.append(after);
+    ASSERT_EQ(contents(before), values);
+    for (size_t i = 0; i < values.size(); i += 13) {
+      ASSERT_EQ(before[i], values[i]);
+    }
+  }
+
+  // Splits and joins in a random order still index correctly.
+  std::mt19937 random(11);
+  cow::deque<std::string> shuffled = whole;
+  std::vector<std::string> expected = values;
+  for (int i = 0; i < 200; ++i) {
+    const size_t at = random() % (expected.size() + 1);
+    auto [before, after] = shuffled.split(at);
+    after.append(before);
+    shuffled = after;
+    std::rotate(expected.begin(), expected.begin() + at, expected.end());
+    ASSERT_EQ(shuffled.size(), expected.size());
+    const size_t probe = random() % expected.size();
+    ASSERT_EQ(shuffled[probe], expected[probe]);
+  }
+  EXPECT_EQ(contents(shuffled), expected);
+  EXPECT_EQ(contents(whole), values);
+
+  cow::deque<std::string> doubled = whole;
+  doubled.append(doubled);
+  EXPECT_EQ(doubled.size(), 2 * values.size());
+  EXPECT_EQ(doubled[values.size()], values.front());
+}
+
+TEST(CowDeque, WriteCopiesOnlyThePath) {
+  cow::deque<int> original;
+  for (int i = 0; i < 10000; ++i) {
+    original.push_back(i);
+  }
+  cow::deque<int> edited = original;
+  edited.write(5000) = -1;
+  edited.write(0) = -2;
+  edited.write(9999) = -3;
+
+  EXPECT_EQ(original[5000], 5000);
+  EXPECT_EQ(original.front(), 0);
+  EXPECT_EQ(original.back(), 9999);
+  EXPECT_EQ(edited[5000], -1);
+  EXPECT_EQ(edited.front(), -2);
+  EXPECT_EQ(edited.back(), -3);
+
+  std::vector<const int*> before;
+  original.for_each_chunk([&](const int* data, size_t) { before.push_back(data); });
+  size_t shared = 0;
+  size_t index = 0;
+  edited.for_each_chunk([&](const int* data, size_t) { shared += data == before[index++]; });
+  EXPECT_EQ(shared + 3, before.size());
+}
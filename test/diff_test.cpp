@@ -0,0 +1,230 @@
+#include "cow/diff.h"
+#include "cow/btree_map.h"
+#include "cow/hash_map.h"
+#include "cow/vector.h"
+#include <gtest/gtest.h>
+
+#include <map>
+#include <random>
+#include <vector>
+
+namespace {
+struct tree {
+  int value{0};
+  cow::ptr<tree> children[2];
+};
+
+template <typename Func>
+void cow_for_each_child(const tree& node, Func&& func) {
+  for (const cow::ptr<tree>& child : node.children) {
+    func(child);
+  }
+}
+
+cow::ptr<tree> build(int depth) {
+  if (depth == 0) {
+    return nullptr;
+  }
+  auto result = cow::make<tree>();
+  result.write()->value = depth;
+  for (cow::ptr<tree>& child : result.write()->children) {
+    child = build(depth - 1);
+  }
+  return result;
+}
+
+struct node_visitor {
+  int addedCount = 0;
+  int removedCount = 0;
+  int changedCount = 0;
+
+  void added(const cow::ptr<tree>&) { ++addedCount; }
+  void removed(const cow::ptr<tree>&) { ++removedCount; }
+  void changed(const cow::ptr<tree>&, const cow::ptr<tree>&) { ++changedCount; }
+};
+
+// A value that counts how often it's compared, to check how much of a map
+// a diff looks at.
+int g_comparisons = 0;
+
+struct counted {
+  int value{0};
+  bool operator==(const counted& other) const {
+    ++g_comparisons;
+    return value == other.value;
+  }
+};
+
+// Collects a keyed diff as (key, before, after), with -1 for a missing side.
+struct keyed_visitor {
+  std::map<int, std::pair<int, int>> changes;
+
+  template <typename Key, typename Value>
+  void added(const Key& key, const Value& value) {
+    EXPECT_TRUE(changes.emplace(int(key), std::pair(-1, unwrap(value))).second);
+  }
+  template <typename Key, typename Value>
+  void removed(const Key& key, const Value& value) {
+    EXPECT_TRUE(changes.emplace(int(key), std::pair(unwrap(value), -1)).second);
+  }
+  template <typename Key, typename Value>
+  void changed(const Key& key, const Value& before, const Value& after) {
+    EXPECT_TRUE(changes.emplace(int(key), std::pair(unwrap(before), unwrap(after))).second);
+  }
+
+  static int unwrap(int value) { return value; }
+  static int unwrap(const counted& value) { return value.value; }
+};
+
+std::map<int, std::pair<int, int>> expected_changes(const std::map<int, int>& before,
+                                                    const std::map<int, int>& after) {
+  std::map<int, std::pair<int, int>> result;
+  for (const auto& [key, value] : before) {
+    auto found = after.find(key);
+    if (found == after.end()) {
+      result[key] = {value, -1};
+    } else if (found->second != value) {
+      result[key] = {value, found->second};
+    }
+  }
+  for (const auto& [key, value] : after) {
+    if (!before.count(key)) {
+      result[key] = {-1, value};
+    }
+  }
+  return result;
+}
+}  // namespace
+
+TEST(CowDiff, NodesSkipSharedSubtrees) {
+  const cow::ptr<tree> before = build(10);
+  cow::ptr<tree> after = before;
+
+  // One leaf edited: only the ten nodes on its path differ.
+  tree* at = after.write();
+  for (int depth = 10; depth > 1; --depth) {
+    at = at->children[1].write();
+  }
+  at->value = -1;
+  node_visitor edited;
+  cow::diff(before, after, edited);
+  EXPECT_EQ(edited.changedCount, 10);
+  EXPECT_EQ(edited.addedCount, 0);
+  EXPECT_EQ(edited.removedCount, 0);
+
+  // A subtree dropped and another grafted under the edited leaf.
+  at->children[0] = build(2);
+  after.write()->children[0] = nullptr;
+  node_visitor grafted;
+  cow::diff(before, after, grafted);
+  EXPECT_EQ(grafted.changedCount, 10);
+  EXPECT_EQ(grafted.addedCount, 1);
+  EXPECT_EQ(grafted.removedCount, 1);
+
+  node_visitor same;
+  cow::diff(before, before, same);
+  EXPECT_EQ(same.changedCount + same.addedCount + same.removedCount, 0);
+}
+
+TEST(CowDiff, KeyedContainers) {
+  std::mt19937 random(9);
+  std::map<int, int> model;
+  cow::btree_map<int, int> tree;
+  cow::hash_map<int, int> hash;
+  for (int i = 0; i < 5000; ++i) {
+    const int key = int(random() % 20000);
+    model[key] = i;
+    tree.insert_or_assign(key, i);
+    hash.insert_or_assign(key, i);
+  }
+
+  for (int round = 0; round < 20; ++round) {
+    const std::map<int, int> modelBefore = model;
+    const cow::btree_map<int, int> treeBefore = tree;
+    const cow::hash_map<int, int> hashBefore = hash;
+    const int edits = round < 10 ? round + 1 : 500;
+    for (int i = 0; i < edits; ++i) {
+      const int key = int(random() % 20000);
+      if (random() % 3 == 0) {
+        model.erase(key);
+        tree.erase(key);
+        hash.erase(key);
+      } else {
+        const int value = int(random() % 3);
+        model[key] = value;
+        tree.insert_or_assign(key, value);
+        hash.insert_or_assign(key, value);
+      }
+    }
+    const auto expected = expected_changes(modelBefore, model);
+
+    keyed_visitor treeChanges;
+    cow::diff(treeBefore, tree, treeChanges);
+    EXPECT_EQ(treeChanges.changes, expected);
+
+    keyed_visitor hashChanges;
+    cow::diff(hashBefore, hash, hashChanges);
+    EXPECT_EQ(hashChanges.changes, expected);
+  }
+
+  // vector, with indices as keys.
+  cow::vector<int> before;
+  for (int i = 0; i < 3000; ++i) {
+    before.push_back(i);
+  }
+  cow::vector<int> after = before;
+  after.set(5, -5);
+  after.set(2000, -2000);
+  after.set(1000, 1000);
+  for (int i = 0; i < 100; ++i) {
+    after.push_back(i);
+  }
+  keyed_visitor grown;
+  cow::diff(before, after, grown);
+  std::map<int, std::pair<int, int>> expected = {{5, {5, -5}}, {2000, {2000, -2000}}};
+  for (int i = 0; i < 100; ++i) {
+    expected[3000 + i] = {-1, i};
+  }
+  EXPECT_EQ(grown.changes, expected);
+
+  keyed_visitor shrunk;
+  cow::diff(after, before, shrunk);
+  EXPECT_EQ(shrunk.changes.size(), expected.size());
+  EXPECT_EQ(shrunk.changes[3050], std::pair(50, -1));
+}
+
+TEST(CowDiff, CostFollowsTheChange) {
+  cow::btree_map<int, counted> tree;
+  cow::hash_map<int, counted> hash;
+  cow::vector<counted> values;
+  for (int i = 0; i < 100000; ++i) {
+    tree.insert(i, counted{i});
+    hash.insert(i, counted{i});
+    values.push_back(counted{i});
+  }
+  auto treeAfter = tree;
+  treeAfter.insert_or_assign(50000, counted{-1});
+  treeAfter.insert(100000, counted{0});
+  auto hashAfter = hash;
+  hashAfter.insert_or_assign(50000, counted{-1});
+  auto valuesAfter = values;
+  valuesAfter.set(50000, counted{-1});
+
+  keyed_visitor treeChanges;
+  g_comparisons = 0;
+  cow::diff(tree, treeAfter, treeChanges);
+  EXPECT_EQ(treeChanges.changes.size(), 2u);
+  EXPECT_LT(g_comparisons, 200);
+
+  keyed_visitor hashChanges;
+  g_comparisons = 0;
+  cow::diff(hash, hashAfter, hashChanges);
+  EXPECT_EQ(hashChanges.changes.size(), 1u);
+  EXPECT_LT(g_comparisons, 200);
+
+  keyed_visitor valueChanges;
+  g_comparisons = 0;
+  cow::diff(values, valuesAfter, valueChanges);
+  EXPECT_EQ(valueChanges.changes.size(), 1u);
+  EXPECT_LT(g_comparisons, 100);
+}
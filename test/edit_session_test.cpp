@@ -0,0 +1,87 @@
+#include "cow/edit_session.h"
+#include "cow/local.h"
+#include <gtest/gtest.h>
+
+#include <vector>
+
+namespace {
+struct node {
+  int value;
+  cow::ptr<node> left, right;
+};
+
+template <typename ObjectType>
+bool is_stamped(const cow::ptr<ObjectType>& p) {
+  return cow::detail::ptr_access::control(p)->is_edit_stamped();
+}
+}  // namespace
+
+TEST(CowEditSession, StampsNewAndClonedNodes) {
+  auto shared = cow::make<node>(1, cow::make<node>(2));
+  auto edited = shared;
+  EXPECT_FALSE(is_stamped(shared));
+
+  {
+    cow::edit_session session;
+    edited--->left--->value = 20;
+    EXPECT_TRUE(is_stamped(edited));
+    EXPECT_TRUE(is_stamped(edited->left));
+    EXPECT_EQ(shared->left->value, 2);
+
+    // Stamped nodes are written in place.
+    const node* before = edited.get();
+    edited--->value = 10;
+    EXPECT_EQ(edited.get(), before);
+
+    auto fresh = cow::make<node>(3);
+    EXPECT_TRUE(is_stamped(fresh));
+    edited--->right = std::move(fresh);
+    EXPECT_TRUE(is_stamped(edited->right));
+  }
+
+  // Retiring the token freezes them.
+  EXPECT_FALSE(is_stamped(edited));
+  EXPECT_FALSE(is_stamped(edited->left));
+}
+
+TEST(CowEditSession, CopyClearsStamp) {
+  cow::edit_session session;
+  auto a = cow::make<node>(1);
+  EXPECT_TRUE(is_stamped(a));
+
+  auto snapshot = a;
+  EXPECT_FALSE(is_stamped(a));
+  a--->value = 2;
+  EXPECT_NE(a, snapshot);
+  EXPECT_EQ(snapshot->value, 1);
+  EXPECT_TRUE(is_stamped(a));
+}
+
+TEST(CowEditSession, Nested) {
+  cow::edit_session outer;
+  auto a = cow::make<node>(1);
+  {
+    cow::edit_session inner;
+    EXPECT_FALSE(is_stamped(a));
+    auto b = cow::make<node>(2);
+    EXPECT_TRUE(is_stamped(b));
+  }
+  EXPECT_TRUE(is_stamped(a));
+}
+
+TEST(CowEditSession, WithLocalScope) {
+  cow::ptr<node> root;
+  {
+    cow::local_scope scope;
+    cow::edit_session session;
+    for (int i = 0; i < 100; ++i) {
+      root = cow::make<node>(i, std::move(root));
+      EXPECT_TRUE(is_stamped(root));
+      root--->value += 1;
+    }
+    root = scope.publish(std::move(root));
+  }
+  EXPECT_FALSE(is_stamped(root));
+  EXPECT_FALSE(cow::detail::ptr_access::control(root)->is_local());
+  EXPECT_EQ(root->value, 100);
+}
@@ -0,0 +1,253 @@
+#include "cow/hash_map.h"
+#include <gtest/gtest.h>
+
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+// Only a handful of distinct hashes, so most keys share a collision node.
+struct few_hashes {
+  size_t operator()(int key) const noexcept { return size_t(key % 4) * 0x9e3779b97f4a7c15ull; }
+};
+
+// Every key collides, so they all end up in one chain of collision nodes.
+struct one_hash {
+  size_t operator()(int) const noexcept { return 42; }
+};
+
+// Keys are equal if they're equal modulo a divisor the map is given, so
+// the map has to use the functors it was made with.
+struct modulo_hash {
+  explicit modulo_hash(int divisor) : divisor(divisor) {}
+  size_t operator()(int key) const noexcept { return size_t(key % divisor) * 0x9e3779b97f4a7c15ull; }
+  int divisor;
+};
+
+struct modulo_equal {
+  explicit modulo_equal(int divisor) : divisor(divisor) {}
+  bool operator()(int a, int b) const noexcept { return a % divisor == b % divisor; }
+  int divisor;
+};
+
+struct change_counter {
+  int addedCount = 0;
+  int removedCount = 0;
+  int changedCount = 0;
+
+  void added(int, int) { ++addedCount; }
+  void removed(int, int) { ++removedCount; }
+  void changed(int, int, int) { ++changedCount; }
+};
+
+template <typename Map, typename Expected>
+void expect_same(const Map& actual, const Expected& expected) {
+  ASSERT_EQ(actual.size(), expected.size());
+  size_t seen = 0;
+  for (const auto& [key, value] : actual) {
+    auto found = expected.find(key);
+    ASSERT_NE(found, expected.end());
+    EXPECT_EQ(found->second, value);
+    ++seen;
+  }
+  EXPECT_EQ(seen, expected.size());
+  for (const auto& [key, value] : expected) {
+    const auto* found = actual.find(key);
+    ASSERT_NE(found, nullptr);
+    EXPECT_EQ(*found, value);
+  }
+}
+}  // namespace
+
+// A sparse node gets a block sized for the few slots it uses, small enough
+// for a pool even in a map of strings.
+static_assert(sizeof(cow::detail::hash_map_node_of<int, int, 2>) <= 64);
+static_assert(sizeof(cow::detail::control_block_with_object<
+                     cow::detail::hash_map_node_of<std::string, std::string, 2>>) <=
+              cow::detail::pool_max_block_size);
+
+TEST(CowHashMap, MatchesUnorderedMap) {
+  cow::hash_map<int, int> map;
+  std::unordered_map<int, int> expected;
+  std::vector<std::pair<cow::hash_map<int, int>, std::unordered_map<int, int>>> snapshots;
+
+  std::mt19937 random(12345);
+  for (int i = 0; i < 20000; ++i) {
+    const int key = int(random() % 5000);
+    switch (random() % 4) {
+      case 0:
+        EXPECT_EQ(map.insert(key, i), expected.emplace(key, i).second);
+        break;
+      case 1:
+        EXPECT_EQ(map.insert_or_assign(key, i), expected.insert_or_assign(key, i).second);
+        break;
+      case 2:
+        EXPECT_EQ(map.erase(key), expected.erase(key) == 1);
+        break;
+      case 3:
+        if (int* value = map.write(key)) {
+          *value += 1;
+          ++expected.at(key);
+        } else {
+          EXPECT_EQ(expected.count(key), 0u);
+        }
+        break;
+    }
+    if (i % 2500 == 0) {
+      snapshots.emplace_back(map, expected);
+    }
+  }
+  expect_same(map, expected);
+
+  // Earlier copies never see later changes.
+  for (const auto& [snapshot, then] : snapshots) {
+    expect_same(snapshot, then);
+  }
+}
+
+TEST(CowHashMap, CopiesLeaveOriginalAlone) {
+  cow::hash_map<std::string, int> a{{"x", 1}, {"y", 2}, {"z", 3}};
+  auto b = a;
+
+  EXPECT_TRUE(b.insert_or_assign("w", 0));
+  EXPECT_FALSE(b.insert_or_assign("x", 10));
+  EXPECT_FALSE(b.insert("y", 20));
+  EXPECT_TRUE(b.erase("z"));
+  EXPECT_FALSE(b.erase("z"));
+  EXPECT_EQ(b.write("missing"), nullptr);
+
+  EXPECT_EQ(a.size(), 3u);
+  EXPECT_EQ(*a.find("x"), 1);
+  EXPECT_EQ(*a.find("z"), 3);
+  EXPECT_FALSE(a.contains("w"));
+
+  EXPECT_EQ(b.size(), 3u);
+  EXPECT_EQ(*b.find("x"), 10);
+  EXPECT_EQ(*b.find("y"), 2);
+  EXPECT_FALSE(b.contains("z"));
+
+  // Unique now, so writing again changes b in place.
+  const int* before = b.find("x");
+  *b.write("x") = 11;
+  EXPECT_EQ(b.find("x"), before);
+  EXPECT_EQ(*b.find("x"), 11);
+}
+
+TEST(CowHashMap, CollidingHashes) {
+  cow::hash_map<int, std::string, few_hashes> map;
+  std::unordered_map<int, std::string> expected;
+  for (int i = 0; i < 200; ++i) {
+    map.insert(i, std::to_string(i));
+    expected.emplace(i, std::to_string(i));
+  }
+  expect_same(map, expected);
+  EXPECT_FALSE(map.contains(1000));
+
+  auto kept = map;
+  for (int i = 0; i < 200; i += 3) {
+    EXPECT_TRUE(map.erase(i));
+    expected.erase(i);
+  }
+  *map.write(1) = "one";
+  expected[1] = "one";
+  expect_same(map, expected);
+  EXPECT_EQ(*kept.find(1), "1");
+
+  for (int i = 0; i < 200; ++i) {
+    map.erase(i);
+  }
+  EXPECT_TRUE(map.empty());
+  EXPECT_TRUE(map.begin() == map.end());
+  EXPECT_EQ(kept.size(), 200u);
+}
+
+TEST(CowHashMap, LongCollisionChains) {
+  cow::hash_map<int, int, one_hash> map;
+  std::unordered_map<int, int> expected;
+  std::mt19937 random(7);
+  for (int i = 0; i < 3000; ++i) {
+    const int key = int(random() % 400);
+    if (random() % 3 == 0) {
+      EXPECT_EQ(map.erase(key), expected.erase(key) == 1);
+    } else {
+      EXPECT_EQ(map.insert_or_assign(key, i), expected.insert_or_assign(key, i).second);
+    }
+  }
+  expect_same(map, expected);
+
+  // Changes anywhere along the chain leave copies alone, and show up in a
+  // diff.
+  const auto kept = map;
+  const auto keptExpected = expected;
+  change_counter changes;
+  for (const auto& [key, value] : keptExpected) {
+    if (key % 3 == 0) {
+      *map.write(key) = -1;
+      ++changes.changedCount;
+    } else if (key % 3 == 1) {
+      map.erase(key);
+      ++changes.removedCount;
+    }
+  }
+  map.insert(1000, 1000);
+  ++changes.addedCount;
+  expect_same(kept, keptExpected);
+
+  change_counter seen;
+  kept.diff(map, seen);
+  EXPECT_EQ(seen.addedCount, changes.addedCount);
+  EXPECT_EQ(seen.removedCount, changes.removedCount);
+  EXPECT_EQ(seen.changedCount, changes.changedCount);
+
+  for (const auto& [key, value] : keptExpected) {
+    map.erase(key);
+  }
+  EXPECT_EQ(map.size(), 1u);
+  EXPECT_EQ(*map.find(1000), 1000);
+}
+
+TEST(CowHashMap, UsesItsOwnFunctors) {
+  cow::hash_map<int, int, modulo_hash, modulo_equal> map(modulo_hash(10), modulo_equal(10));
+  for (int i = 0; i < 100; ++i) {
+    map.insert_or_assign(i, i);
+  }
+  EXPECT_EQ(map.size(), 10u);
+  EXPECT_EQ(*map.find(3), 93);
+  EXPECT_EQ(*map.find(1003), 93);
+  EXPECT_TRUE(map.erase(13));
+  EXPECT_FALSE(map.contains(3));
+  EXPECT_EQ(map.hash_function().divisor, 10);
+  EXPECT_EQ(map.key_eq().divisor, 10);
+
+  auto copy = map;
+  *copy.write(4) = -4;
+  change_counter changes;
+  map.diff(copy, changes);
+  EXPECT_EQ(changes.changedCount, 1);
+}
+
+TEST(CowHashMap, ShapeDoesNotDependOnHistory) {
+  cow::hash_map<int, int> forward;
+  cow::hash_map<int, int> backward;
+  for (int i = 0; i < 3000; ++i) {
+    forward.insert(i * 7919, i);
+    backward.insert((2999 - i) * 7919, 2999 - i);
+  }
+  for (int i = 0; i < 3000; i += 2) {
+    forward.erase(i * 7919);
+  }
+  cow::hash_map<int, int> fresh;
+  for (int i = 1; i < 3000; i += 2) {
+    fresh.insert(i * 7919, i);
+    backward.erase((i - 1) * 7919);
+  }
+
+  std::vector<int> forwardOrder, backwardOrder, freshOrder;
+  for (const auto& entry : forward) forwardOrder.push_back(entry.first);
+  for (const auto& entry : backward) backwardOrder.push_back(entry.first);
+  for (const auto& entry : fresh) freshOrder.push_back(entry.first);
+  EXPECT_EQ(forwardOrder.size(), 1500u);
+  EXPECT_EQ(forwardOrder, freshOrder);
+  EXPECT_EQ(backwardOrder, freshOrder);
+}
@@ -0,0 +1,131 @@
+#include "cow/intern.h"
+#include "cow/biased.h"
+#include <gtest/gtest.h>
+
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+struct setting {
+  std::string name;
+  int value{0};
+
+  bool operator==(const setting&) const = default;
+};
+
+struct setting_hash {
+  size_t operator()(const setting& s) const {
+    return std::hash<std::string>()(s.name) * 31 + size_t(s.value);
+  }
+};
+
+// Children are interned before their parents, so they're hashed and
+// compared by address.
+struct tree {
+  int value{0};
+  cow::ptr<tree> left;
+  cow::ptr<tree> right;
+
+  bool operator==(const tree&) const = default;
+};
+
+struct tree_hash {
+  size_t operator()(const tree& t) const {
+    const std::hash<const tree*> child;
+    return (size_t(t.value) * 31 + child(t.left.get())) * 31 + child(t.right.get());
+  }
+};
+
+cow::ptr<tree> build(int depth) {
+  if (depth == 0) {
+    return nullptr;
+  }
+  return cow::intern(cow::make<tree>(tree{depth, build(depth - 1), build(depth - 1)}), tree_hash());
+}
+}  // namespace
+
+TEST(CowIntern, EqualValuesShareABlock) {
+  const cow::intern_stats before = cow::interned_stats();
+
+  cow::ptr<setting> a = cow::intern(cow::make<setting>(setting{"timeout", 30}), setting_hash());
+  cow::ptr<setting> b = cow::intern(cow::make<setting>(setting{"timeout", 30}), setting_hash());
+  cow::ptr<setting> c = cow::intern(cow::make<setting>(setting{"timeout", 60}), setting_hash());
+  EXPECT_TRUE(cow::is_interned(a));
+  EXPECT_EQ(a, b);
+  EXPECT_NE(a, c);
+  EXPECT_EQ(a.use_count(), 2u);
+  EXPECT_EQ(cow::intern(a, setting_hash()), a);
+
+  cow::intern_stats after = cow::interned_stats();
+  EXPECT_EQ(after.entries - before.entries, 2u);
+  EXPECT_EQ(after.hits - before.hits, 1u);
+  EXPECT_GE(after.bytes_saved - before.bytes_saved, sizeof(setting));
+
+  // Writing copies, and the copy isn't interned, even when it's unique.
+  b.write()->value = 31;
+  EXPECT_EQ(a->value, 30);
+  EXPECT_FALSE(cow::is_interned(b));
+  EXPECT_EQ(a.use_count(), 1u);
+  a.write()->value = 32;
+  EXPECT_FALSE(cow::is_interned(a));
+
+  // The last reference going away drops the entry, so the same value
+  // interned again gets a fresh one.
+  c = nullptr;
+  EXPECT_EQ(cow::interned_stats().entries, before.entries);
+  c = cow::intern(cow::make<setting>(setting{"timeout", 60}), setting_hash());
+  EXPECT_TRUE(cow::is_interned(c));
+  EXPECT_EQ(c.use_count(), 1u);
+  EXPECT_EQ(cow::interned_stats().entries, before.entries + 1);
+
+  // Biased blocks are copied into plain ones to go in the table.
+  cow::ptr<setting> biased =
+      cow::allocate_make<setting>(cow::default_pool(), cow::block_flags::biased, setting{"timeout", 60});
+  EXPECT_EQ(cow::intern(biased, setting_hash()), c);
+}
+
+TEST(CowIntern, TreesCollapseToOneNodePerLevel) {
+  const size_t entries = cow::interned_stats().entries;
+  {
+    cow::ptr<tree> root = build(12);
+    EXPECT_EQ(cow::interned_stats().entries - entries, 12u);
+    EXPECT_EQ(root->left, root->right);
+
+    cow::ptr<tree> again = build(12);
+    EXPECT_EQ(again, root);
+    EXPECT_EQ(cow::interned_stats().entries - entries, 12u);
+  }
+  EXPECT_EQ(cow::interned_stats().entries, entries);
+}
+
+TEST(CowIntern, ConcurrentInternAndRelease) {
+  const size_t entries = cow::interned_stats().entries;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([t] {
+      std::vector<cow::ptr<setting>> kept;
+      for (int i = 0; i < 20000; ++i) {
+        const int value = (i * 7 + t) % 64;
+        cow::ptr<setting> p = cow::intern(cow::make<setting>(setting{"k", value}), setting_hash());
+        ASSERT_EQ(p->value, value);
+        if (i % 5 == 0) {
+          kept.push_back(std::move(p));
+        }
+        if (kept.size() > 16) {
+          kept.erase(kept.begin());
+        }
+      }
+      for (size_t i = 1; i < kept.size(); ++i) {
+        for (size_t j = 0; j < i; ++j) {
+          ASSERT_EQ(kept[i] == kept[j], kept[i]->value == kept[j]->value);
+        }
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(cow::interned_stats().entries, entries);
+}
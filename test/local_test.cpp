@@ -0,0 +1,82 @@
+#include "cow/local.h"
+#include <gtest/gtest.h>
+
+#include <thread>
+
+namespace {
+struct tree {
+  int value;
+  cow::ptr<tree> left, right;
+};
+
+template <typename ObjectType>
+bool is_local(const cow::ptr<ObjectType>& p) {
+  return cow::detail::ptr_access::control(p)->is_local();
+}
+
+cow::ptr<tree> build(int depth, int& next) {
+  if (depth == 0) {
+    return nullptr;
+  }
+  auto left = build(depth - 1, next);
+  int value = next++;
+  auto right = build(depth - 1, next);
+  return cow::make<tree>(value, std::move(left), std::move(right));
+}
+
+int sum(const cow::ptr<tree>& t) {
+  return t ? t->value + sum(t->left) + sum(t->right) : 0;
+}
+}  // namespace
+
+TEST(CowLocal, BuildAndPublish) {
+  cow::ptr<tree> root;
+  {
+    cow::local_scope scope;
+    int next = 0;
+    auto local = build(4, next);
+    EXPECT_EQ(scope.size(), 15);
+    EXPECT_TRUE(is_local(local));
+    EXPECT_TRUE(is_local(local->left->right));
+
+    // Copies and writes inside the scope use plain refcounts.
+    auto copy = local;
+    EXPECT_EQ(local.use_count(), 2);
+    copy--->left--->value += 100;
+    EXPECT_EQ(scope.size(), 17);
+    copy = nullptr;
+    EXPECT_EQ(scope.size(), 15);
+
+    root = scope.publish(std::move(local));
+    EXPECT_EQ(scope.size(), 0);
+  }
+  EXPECT_FALSE(is_local(root));
+  EXPECT_FALSE(is_local(root->left->left->left));
+  EXPECT_EQ(root.use_count(), 1);
+
+  int total = 0;
+  std::thread([&, snapshot = root] { total = sum(snapshot); }).join();
+  EXPECT_EQ(total, 105);
+}
+
+TEST(CowLocal, MixedWithShared) {
+  auto shared = cow::make<tree>(1, cow::make<tree>(2), cow::make<tree>(3));
+  EXPECT_FALSE(is_local(shared));
+
+  cow::local_scope scope;
+  auto edited = shared;
+  edited--->right--->value = 30;
+
+  // The path down to the edit was cloned locally; the untouched left subtree
+  // is still the shared block.
+  EXPECT_TRUE(is_local(edited));
+  EXPECT_TRUE(is_local(edited->right));
+  EXPECT_FALSE(is_local(edited->left));
+  EXPECT_EQ(edited->left, shared->left);
+  EXPECT_EQ(shared->left.use_count(), 2);
+  EXPECT_EQ(shared->right->value, 3);
+
+  edited = nullptr;
+  EXPECT_EQ(scope.size(), 0);
+  EXPECT_EQ(shared->left.use_count(), 1);
+}
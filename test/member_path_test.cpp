@@ -0,0 +1,65 @@
+#include "cow/member_path.h"
+#include <gtest/gtest.h>
+
+#include <string>
+
+namespace {
+struct limits {
+  int rate;
+};
+
+struct config {
+  std::string name;
+  cow::ptr<limits> limit;
+};
+
+struct settings {
+  cow::ptr<config> primary;
+  cow::ptr<config> fallback;
+};
+
+void set_rate(cow::spot<limits>&& where, int rate) {
+  where--->rate = rate;
+}
+}  // namespace
+
+TEST(CowMemberPath, WriteCopiesChain) {
+  auto a = cow::make<settings>(
+      cow::make<config>("primary", cow::make<limits>(10)),
+      cow::make<config>("fallback", cow::make<limits>(5)));
+  auto b = a;
+
+  cow::member_path<&settings::primary, &config::limit> rate(&a);
+  EXPECT_EQ(rate->rate, 10);
+  EXPECT_EQ(rate.use_count(), 1);
+
+  rate--->rate = 20;
+  EXPECT_EQ(a->primary->limit->rate, 20);
+  EXPECT_EQ(b->primary->limit->rate, 10);
+  EXPECT_EQ(a->fallback, b->fallback);
+  EXPECT_EQ(a->primary->name, "primary");
+
+  // Passed along as a plain spot.
+  set_rate(cow::member_path<&settings::fallback, &config::limit>(&a), 7);
+  EXPECT_EQ(a->fallback->limit->rate, 7);
+  EXPECT_EQ(b->fallback->limit->rate, 5);
+}
+
+TEST(CowMemberPath, SingleStepAndStepFrom) {
+  auto a = cow::make<settings>(cow::make<config>("x", cow::make<limits>(1)));
+  auto b = a;
+
+  cow::member_path<&settings::primary> primary(&a);
+  EXPECT_EQ(primary->name, "x");
+  auto limit = primary.step(&primary->limit);
+  limit--->rate = 2;
+  EXPECT_EQ(a->primary->limit->rate, 2);
+  EXPECT_EQ(b->primary->limit->rate, 1);
+}
+
+TEST(CowMemberPath, NullPartway) {
+  auto a = cow::make<settings>();
+  cow::member_path<&settings::primary, &config::limit> rate(&a);
+  EXPECT_FALSE(rate);
+  EXPECT_EQ(rate.write(), nullptr);
+}
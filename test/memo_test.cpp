@@ -0,0 +1,105 @@
+#include "cow/memo.h"
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace {
+std::atomic<int> g_totals{0};
+
+struct tree {
+  int value{0};
+  cow::ptr<tree> left;
+  cow::ptr<tree> right;
+
+  struct total {
+    long operator()(const tree& t) const {
+      ++g_totals;
+      return t.value + (t.left ? cow::memo<total>(t.left) : 0) +
+             (t.right ? cow::memo<total>(t.right) : 0);
+    }
+  };
+  struct height {
+    int operator()(const tree& t) const {
+      return 1 + std::max(t.left ? cow::memo<height>(t.left) : 0,
+                          t.right ? cow::memo<height>(t.right) : 0);
+    }
+  };
+  using cow_memos = cow::memo_slots<total, height>;
+};
+
+cow::ptr<tree> build(int depth, int& next) {
+  if (depth == 0) {
+    return nullptr;
+  }
+  auto result = cow::make<tree>();
+  result.write()->left = build(depth - 1, next);
+  result.write()->value = next++;
+  result.write()->right = build(depth - 1, next);
+  return result;
+}
+
+long brute_total(const cow::ptr<tree>& t) {
+  return t ? t->value + brute_total(t->left) + brute_total(t->right) : 0;
+}
+}  // namespace
+
+TEST(CowMemo, RecomputesOnlyTheEditedPath) {
+  int next = 0;
+  cow::ptr<tree> root = build(12, next);
+  const int nodes = next;
+
+  g_totals = 0;
+  EXPECT_EQ(cow::memo<tree::total>(root), brute_total(root));
+  EXPECT_EQ(g_totals.load(), nodes);
+  EXPECT_EQ(cow::memo<tree::height>(root), 12);
+  g_totals = 0;
+  EXPECT_EQ(cow::memo<tree::total>(root), brute_total(root));
+  EXPECT_EQ(g_totals.load(), 0);
+
+  // Editing a copy clones the path, and the clones start out empty.
+  const cow::ptr<tree> before = root;
+  tree* at = root.write();
+  for (int depth = 12; depth > 1; --depth) {
+    at = at->left.write();
+  }
+  at->value += 1000;
+  g_totals = 0;
+  EXPECT_EQ(cow::memo<tree::total>(root), brute_total(root));
+  EXPECT_EQ(g_totals.load(), 12);
+  EXPECT_EQ(cow::memo<tree::total>(before) + 1000, cow::memo<tree::total>(root));
+  EXPECT_EQ(g_totals.load(), 12);
+
+  // Writing in place, now that the path is unique, empties the slots too.
+  root.write()->right.write()->value += 1;
+  g_totals = 0;
+  EXPECT_EQ(cow::memo<tree::total>(root), brute_total(root));
+  EXPECT_EQ(g_totals.load(), 2);
+
+  root.update([](const tree& t) {
+    tree result = t;
+    result.value = 0;
+    return result;
+  });
+  g_totals = 0;
+  EXPECT_EQ(cow::memo<tree::total>(root), brute_total(root));
+  EXPECT_EQ(g_totals.load(), 1);
+}
+
+TEST(CowMemo, SharedBetweenThreads) {
+  int next = 0;
+  const cow::ptr<tree> root = build(10, next);
+  const long expected = brute_total(root);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&] {
+      EXPECT_EQ(cow::memo<tree::total>(root), expected);
+      EXPECT_EQ(cow::memo<tree::height>(root), 10);
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+}
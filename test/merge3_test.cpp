@@ -0,0 +1,186 @@
+#include "cow/merge3.h"
+#include "cow/btree_map.h"
+#include "cow/hash_map.h"
+#include <gtest/gtest.h>
+
+#include <map>
+#include <optional>
+#include <type_traits>
+
+namespace {
+struct tree {
+  int value{0};
+  cow::ptr<tree> children[2];
+
+  bool operator==(const tree&) const = default;
+};
+
+template <typename Node, typename Func>
+  requires std::is_same_v<std::remove_const_t<Node>, tree>
+void cow_for_each_child(Node& node, Func&& func) {
+  for (auto& child : node.children) {
+    func(child);
+  }
+}
+
+cow::ptr<tree> build(int depth, int& next) {
+  if (depth == 0) {
+    return nullptr;
+  }
+  auto result = cow::make<tree>();
+  result.write()->value = next++;
+  for (cow::ptr<tree>& child : result.write()->children) {
+    child = build(depth - 1, next);
+  }
+  return result;
+}
+
+// The node reached by following the given child slots from the root.
+tree* walk(cow::ptr<tree>& root, std::initializer_list<int> slots) {
+  tree* at = root.write();
+  for (int slot : slots) {
+    at = at->children[slot].write();
+  }
+  return at;
+}
+
+const tree& read(const cow::ptr<tree>& root, std::initializer_list<int> slots) {
+  const tree* at = root.get();
+  for (int slot : slots) {
+    at = at->children[slot].get();
+  }
+  return *at;
+}
+
+template <typename Map>
+std::map<int, int> as_map(const Map& from) {
+  std::map<int, int> result;
+  for (const auto& [key, value] : from) {
+    result[key] = value;
+  }
+  return result;
+}
+
+struct counting_resolver {
+  int calls = 0;
+
+  cow::ptr<tree> operator()(const cow::ptr<tree>&, const cow::ptr<tree>&,
+                            const cow::ptr<tree>& theirs) {
+    ++calls;
+    return theirs;
+  }
+};
+}  // namespace
+
+TEST(CowMerge3, DisjointEditsNeedNoResolver) {
+  int next = 0;
+  const cow::ptr<tree> base = build(10, next);
+  cow::ptr<tree> ours = base;
+  cow::ptr<tree> theirs = base;
+  walk(ours, {0, 0, 1})->value = -1;
+  walk(theirs, {0, 1, 1})->value = -2;
+  walk(theirs, {1})->children[0] = nullptr;
+  ours.write()->value = -3;
+
+  counting_resolver resolver;
+  const cow::ptr<tree> merged = cow::merge3(base, ours, theirs, resolver);
+  EXPECT_EQ(resolver.calls, 0);
+  EXPECT_EQ(merged->value, -3);
+  EXPECT_EQ(read(merged, {0, 0, 1}).value, -1);
+  EXPECT_EQ(read(merged, {0, 1, 1}).value, -2);
+  EXPECT_FALSE(read(merged, {1}).children[0]);
+
+  // Untouched subtrees come straight from base, and each side's edited
+  // subtree from that side.
+  EXPECT_EQ(read(merged, {0, 0}).children[0], read(base, {0, 0}).children[0]);
+  EXPECT_EQ(merged->children[1], theirs->children[1]);
+  EXPECT_EQ(read(merged, {0}).children[0], read(ours, {0}).children[0]);
+  EXPECT_EQ(base->value, 0);
+
+  EXPECT_EQ(cow::merge3(base, ours, base, resolver), ours);
+  EXPECT_EQ(cow::merge3(base, base, theirs, resolver), theirs);
+  EXPECT_EQ(resolver.calls, 0);
+}
+
+TEST(CowMerge3, ConflictsGoToTheResolver) {
+  int next = 0;
+  const cow::ptr<tree> base = build(6, next);
+
+  // The same change on both sides isn't a conflict.
+  cow::ptr<tree> ours = base;
+  cow::ptr<tree> theirs = base;
+  walk(ours, {1, 1})->value = 100;
+  walk(theirs, {1, 1})->value = 100;
+  counting_resolver resolver;
+  cow::ptr<tree> merged = cow::merge3(base, ours, theirs, resolver);
+  EXPECT_EQ(resolver.calls, 0);
+  EXPECT_EQ(read(merged, {1, 1}).value, 100);
+
+  // Different changes to one node are, and only that node is resolved.
+  walk(theirs, {1, 1})->value = 200;
+  walk(theirs, {0, 0})->value = 300;
+  cow::ptr<tree> seen;
+  merged = cow::merge3(base, ours, theirs,
+                       [&](const cow::ptr<tree>& was, const cow::ptr<tree>& mine,
+                           const cow::ptr<tree>& other) {
+                         EXPECT_EQ(was->value, read(base, {1, 1}).value);
+                         EXPECT_EQ(mine->value, 100);
+                         EXPECT_EQ(other->value, 200);
+                         seen = mine;
+                         return mine;
+                       });
+  EXPECT_TRUE(seen);
+  EXPECT_EQ(read(merged, {1, 1}).value, 100);
+  EXPECT_EQ(read(merged, {0, 0}).value, 300);
+}
+
+TEST(CowMerge3, KeyedMaps) {
+  cow::btree_map<int, int> base;
+  cow::hash_map<int, int> hashBase;
+  for (int i = 0; i < 10000; ++i) {
+    base.insert(i, i);
+    hashBase.insert(i, i);
+  }
+
+  auto edit = [](auto map, bool mine) {
+    map.insert_or_assign(mine ? 10 : 20, -1);   // changed on one side
+    map.erase(mine ? 30 : 40);                   // erased on one side
+    map.insert(mine ? 20000 : 20001, 1);         // added on one side
+    map.insert_or_assign(50, mine ? 7 : 8);      // conflict
+    map.erase(60);                               // the same on both sides
+    map.insert(30000, 3);                        // the same on both sides
+    return map;
+  };
+  std::map<int, int> expected;
+  for (int i = 0; i < 10000; ++i) {
+    expected[i] = i;
+  }
+  expected[10] = -1;
+  expected[20] = -1;
+  expected.erase(30);
+  expected.erase(40);
+  expected[20000] = 1;
+  expected[20001] = 1;
+  expected[50] = 15;
+  expected.erase(60);
+  expected[30000] = 3;
+
+  int calls = 0;
+  auto resolver = [&](const int& key, const int* was, const int* ours,
+                      const int* theirs) -> std::optional<int> {
+    ++calls;
+    EXPECT_EQ(key, 50);
+    EXPECT_EQ(*was, 50);
+    return *ours + *theirs;
+  };
+
+  const auto merged = cow::merge3(base, edit(base, true), edit(base, false), resolver);
+  EXPECT_EQ(calls, 1);
+  EXPECT_EQ(as_map(merged), expected);
+
+  calls = 0;
+  const auto hashMerged =
+      cow::merge3(hashBase, edit(hashBase, true), edit(hashBase, false), resolver);
+  EXPECT_EQ(calls, 1);
+  EXPECT_EQ(as_map(hashMerged), expected);
+}
@@ -0,0 +1,89 @@
+#include "cow/offset_path.h"
+#include <gtest/gtest.h>
+
+namespace {
+struct tree {
+  int value;
+  cow::ptr<tree> left, right;
+};
+
+cow::ptr<tree> full(int depth, int& next) {
+  if (depth == 0) {
+    return nullptr;
+  }
+  auto left = full(depth - 1, next);
+  int value = next++;
+  auto right = full(depth - 1, next);
+  return cow::make<tree>(value, std::move(left), std::move(right));
+}
+}  // namespace
+
+TEST(CowOffsetPath, WriteCopiesPath) {
+  int next = 0;
+  cow::ptr<tree> a = full(5, next);
+  cow::ptr<tree> b = a;
+
+  cow::offset_path<tree> walk(&a);
+  walk.push(&walk->right).push(&walk->left).push(&walk->left);
+  EXPECT_EQ(walk.size(), 4);
+  EXPECT_EQ(walk->value, 17);
+
+  walk--->value = 100;
+  EXPECT_NE(a, b);
+  EXPECT_EQ(a->right->left->left->value, 100);
+  EXPECT_EQ(b->right->left->left->value, 17);
+  EXPECT_EQ(a->left, b->left);
+  EXPECT_EQ(a->right->right, b->right->right);
+  EXPECT_EQ(walk.location(2), &a->right->left);
+
+  // Already unique all the way down, so nothing more is cloned.
+  const tree* written = walk.get();
+  walk--->value = 101;
+  EXPECT_EQ(walk.get(), written);
+
+  // Back up and go down a sibling: only the new level needs copying.
+  const tree* parent = a->right->left.get();
+  walk.pop().push(&walk->right);
+  walk--->value = 200;
+  EXPECT_EQ(a->right->left.get(), parent);
+  EXPECT_EQ(a->right->left->right->value, 200);
+  EXPECT_EQ(b->right->left->right->value, 21);
+  EXPECT_EQ(a->right->left->left->value, 101);
+}
+
+TEST(CowOffsetPath, DeepAndMoved) {
+  cow::ptr<tree> a;
+  for (int i = 50; i > 0; --i) {
+    a = cow::make<tree>(i, std::move(a));
+  }
+  cow::ptr<tree> b = a;
+
+  cow::offset_path<tree> walk(&a);
+  while (walk->left) {
+    walk.push(&walk->left);
+  }
+  EXPECT_EQ(walk.size(), 50);
+
+  cow::offset_path<tree> moved = std::move(walk);
+  EXPECT_EQ(walk.size(), 0);
+  moved.resize(10);
+  cow::offset_path<tree> small = std::move(moved);
+  small--->value = -10;
+
+  EXPECT_EQ(a->left->left->left->left->left->left->left->left->left->value, -10);
+  EXPECT_EQ(b->left->left->left->left->left->left->left->left->left->value, 10);
+}
+
+TEST(CowOffsetPath, AsSpot) {
+  int next = 0;
+  cow::ptr<tree> a = full(3, next);
+  cow::ptr<tree> b = a;
+  cow::offset_path<tree> walk(&a);
+  walk.push(&walk->left);
+
+  // Step off the end the way a spot would.
+  auto leaf = walk.step(&walk->right);
+  leaf--->value = 42;
+  EXPECT_EQ(a->left->right->value, 42);
+  EXPECT_EQ(b->left->right->value, 2);
+}
@@ -122,3 +122,78 @@ TEST(CowPath, TreeWithPath) {
   EXPECT_EQ(a->right->right.use_count(), 2);
   EXPECT_EQ(a->right->right->value, 7);
 }
+
+namespace {
+cow::ptr<tree> spine(int depth) {
+  cow::ptr<tree> result;
+  for (int i = depth; i > 0; --i) {
+    result = cow::make<tree>(i, std::move(result));
+  }
+  return result;
+}
+
+bool is_inline(const cow::path<tree>& p, const cow::spot<tree>& s) {
+  auto* begin = reinterpret_cast<const char*>(&p);
+  auto* address = reinterpret_cast<const char*>(&s);
+  return address >= begin && address < begin + sizeof(p);
+}
+}  // namespace
+
+TEST(CowPath, DeepPathAndMoves) {
+  cow::ptr<tree> a = spine(40);
+  cow::ptr<tree> b = a;
+
+  cow::path<tree> walk(&a);
+  while (walk->left) {
+    walk.push(&walk->left);
+  }
+  EXPECT_EQ(walk.size(), 40);
+  EXPECT_EQ(walk->value, 40);
+  EXPECT_TRUE(is_inline(walk, walk.front()));
+  EXPECT_FALSE(is_inline(walk, walk.back()));
+
+  // Moving relocates the inline spots and relinks everything after them.
+  cow::path<tree> moved = std::move(walk);
+  EXPECT_EQ(walk.size(), 0);
+  EXPECT_EQ(moved.size(), 40);
+  EXPECT_TRUE(is_inline(moved, moved.front()));
+  moved--->value = 400;
+
+  EXPECT_NE(a, b);
+  EXPECT_EQ(b->left->left->value, 3);
+  const tree* node = a.get();
+  for (int i = 1; i < 40; ++i) {
+    node = node->left.get();
+  }
+  EXPECT_EQ(node->value, 400);
+}
+
+TEST(CowPath, PopRewindsArena) {
+  cow::ptr<tree> a = spine(20);
+  cow::path<tree> walk(&a);
+  walk.push(&walk->left).push(&walk->left);
+  const cow::spot<tree>* third = &walk.back();
+  EXPECT_TRUE(is_inline(walk, *third));
+
+  walk.pop(2).push([](const tree& t) { return &t.left; });
+  walk.pop().push(&walk->left).push(&walk->left);
+  EXPECT_EQ(&walk.back(), third);
+  EXPECT_EQ(walk->value, 3);
+
+  // Deeper than the inline buffer, back up, and down again the same way:
+  // the heap chunk is reused.
+  for (int i = 0; i < 15; ++i) {
+    walk.push(&walk->left);
+  }
+  const cow::spot<tree>* deepest = &walk.back();
+  walk.resize(3);
+  for (int i = 0; i < 15; ++i) {
+    walk.push(&walk->left);
+  }
+  EXPECT_EQ(&walk.back(), deepest);
+  EXPECT_EQ(walk->value, 18);
+
+  walk.clear();
+  EXPECT_EQ(walk.size(), 0);
+  EXPECT_FALSE(walk);
+}
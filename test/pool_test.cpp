@@ -0,0 +1,81 @@
+#include "cow/ptr.h"
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <vector>
+
+namespace {
+struct point2i {
+  int x, y;
+};
+
+struct big {
+  char bytes[4096];
+};
+
+int liveCount = 0;
+
+struct counted {
+  counted() { ++liveCount; }
+  counted(const counted&) { ++liveCount; }
+  ~counted() { --liveCount; }
+  int value{0};
+};
+}  // namespace
+
+TEST(CowPool, ReleasesObjects) {
+  {
+    auto a = cow::make<counted>();
+    auto b = a;
+    EXPECT_EQ(liveCount, 1);
+    b--->value = 1;
+    EXPECT_EQ(liveCount, 2);
+  }
+  EXPECT_EQ(liveCount, 0);
+}
+
+TEST(CowPool, ReusesFreedBlocks) {
+  cow::block_pool pool;
+  const point2i* first = cow::allocate_make<point2i>(pool, 1, 2).get();
+  const point2i* second = cow::allocate_make<point2i>(pool, 3, 4).get();
+  EXPECT_EQ(first, second);
+  EXPECT_EQ(pool.reserved_bytes(), cow::detail::pool_slab_size);
+}
+
+TEST(CowPool, ClonesStayInPool) {
+  cow::block_pool pool;
+  auto a = cow::allocate_make<point2i>(pool, 1, 2);
+  auto b = a;
+  b--->x = 10;
+  EXPECT_NE(a, b);
+  EXPECT_EQ(cow::detail::slab_of(b.get())->owner, cow::detail::state_of(pool));
+  EXPECT_EQ(a->x, 1);
+  EXPECT_EQ(b->x, 10);
+}
+
+TEST(CowPool, LargeBlocks) {
+  cow::block_pool pool;
+  auto a = cow::allocate_make<big>(pool);
+  auto b = a;
+  b--->bytes[0] = 1;
+  EXPECT_NE(a, b);
+  EXPECT_EQ(pool.reserved_bytes(), 0);
+}
+
+TEST(CowPool, CrossThreadRelease) {
+  cow::block_pool pool;
+  std::vector<cow::ptr<point2i>> points;
+  for (int i = 0; i < 1000; ++i) {
+    points.push_back(cow::allocate_make<point2i>(pool, i, i));
+  }
+  const size_t reserved = pool.reserved_bytes();
+
+  std::thread([&] { points.clear(); }).join();
+
+  // Everything the other thread released went back to the shared lists, so
+  // allocating the same amount again needs no new slabs.
+  for (int i = 0; i < 1000; ++i) {
+    points.push_back(cow::allocate_make<point2i>(pool, i, i));
+  }
+  EXPECT_EQ(pool.reserved_bytes(), reserved);
+}
@@ -0,0 +1,137 @@
+#include "cow/priority_queue.h"
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+template <typename T, typename Compare>
+std::vector<T> drain(cow::priority_queue<T, Compare> queue) {
+  std::vector<T> result;
+  while (!queue.empty()) {
+    result.push_back(queue.top());
+    queue.pop();
+  }
+  return result;
+}
+
+template <typename T, typename Compare>
+std::vector<T> drain(std::priority_queue<T, std::vector<T>, Compare> queue) {
+  std::vector<T> result;
+  while (!queue.empty()) {
+    result.push_back(queue.top());
+    queue.pop();
+  }
+  return result;
+}
+
+// Puts the values nearest a target on top, so the queue has to use the
+// comparator it was made with.
+struct nearest_to {
+  explicit nearest_to(int target) : target(target) {}
+  bool operator()(int a, int b) const { return std::abs(a - target) > std::abs(b - target); }
+  int target;
+};
+}  // namespace
+
+TEST(CowPriorityQueue, MatchesStdPriorityQueue) {
+  cow::priority_queue<int> queue;
+  std::priority_queue<int> expected;
+  std::vector<std::pair<cow::priority_queue<int>, std::priority_queue<int>>> snapshots;
+
+  std::mt19937 random(3);
+  for (int i = 0; i < 20000; ++i) {
+    if (expected.empty() || random() % 3 != 0) {
+      const int value = int(random() % 1000);
+      queue.push(value);
+      expected.push(value);
+    } else {
+      queue.pop();
+      expected.pop();
+    }
+    ASSERT_EQ(queue.size(), expected.size());
+    if (!expected.empty()) {
+      ASSERT_EQ(queue.top(), expected.top());
+    }
+    if (i % 2000 == 0) {
+      snapshots.emplace_back(queue, expected);
+    }
+  }
+  EXPECT_EQ(drain(queue), drain(expected));
+
+  // Earlier copies never see later pushes and pops, even when popped
+  // themselves after the live queue has relinked their nodes.
+  for (const auto& [snapshot, then] : snapshots) {
+    EXPECT_EQ(drain(snapshot), drain(then));
+  }
+}
+
+TEST(CowPriorityQueue, HeapifyAndMerge) {
+  std::vector<std::string> words;
+  for (int i = 0; i < 1000; ++i) {
+    words.push_back(std::to_string(i * 7919 % 1000));
+  }
+  using min_queue = cow::priority_queue<std::string, std::greater<std::string>>;
+  const min_queue first = min_queue::from_range(words);
+  ASSERT_EQ(first.size(), words.size());
+  EXPECT_EQ(first.top(), "0");
+
+  min_queue second;
+  second.emplace("!");
+  second.emplace(3, 'z');
+
+  min_queue merged = first;
+  merged.merge(second);
+  ASSERT_EQ(merged.size(), 1002u);
+  EXPECT_EQ(merged.top(), "!");
+
+  std::vector<std::string> expected = words;
+  expected.push_back("!");
+  expected.push_back("zzz");
+  std::sort(expected.begin(), expected.end());
+  EXPECT_EQ(drain(merged), expected);
+
+  EXPECT_EQ(first.size(), 1000u);
+  EXPECT_EQ(second.top(), "!");
+  EXPECT_TRUE(min_queue::from_range(std::vector<std::string>()).empty());
+}
+
+TEST(CowPriorityQueue, UsesItsOwnComparator) {
+  cow::priority_queue<int, nearest_to> queue(nearest_to(50));
+  for (int i = 0; i < 100; i += 7) {
+    queue.push(i);
+  }
+  EXPECT_EQ(queue.top(), 49);
+  EXPECT_EQ(queue.value_comp().target, 50);
+
+  const std::vector<int> values = {0, 100, 10, 90, 45};
+  auto heaped = cow::priority_queue<int, nearest_to>::from_range(values, nearest_to(95));
+  EXPECT_EQ(heaped.top(), 100);
+  queue.merge(heaped);
+  EXPECT_EQ(drain(queue).front(), 49);
+  EXPECT_EQ(drain(heaped), (std::vector<int>{100, 90, 45, 10, 0}));
+}
+
+TEST(CowPriorityQueue, LongChainsFreeWithoutRecursion) {
+  // Ascending pushes make one long chain of first children, and a pop
+  // from a snapshot leaves a long chain of siblings shared with it.
+  cow::priority_queue<int> ascending;
+  for (int i = 0; i < 1000000; ++i) {
+    ascending.push(i);
+  }
+  cow::priority_queue<int> descending;
+  for (int i = 1000000; i-- > 0;) {
+    descending.push(i);
+  }
+  cow::priority_queue<int> popped = descending;
+  popped.pop();
+  EXPECT_EQ(popped.top(), 999998);
+  descending.clear();
+  ascending.clear();
+  EXPECT_EQ(popped.size(), 999999u);
+}
@@ -1,6 +1,11 @@
 #include "cow/ptr.h"
+#include "cow/biased.h"
 #include <gtest/gtest.h>
 
+#include <cstdint>
+#include <string>
+#include <vector>
+
 namespace {
 struct point2i {
   int x, y;
@@ -182,3 +187,160 @@ TEST(CowPtr, ExplicitCasts) {
   EXPECT_EQ(b, nullptr);
   EXPECT_EQ(d1, nullptr);
 }
+
+TEST(CowPtr, WriteThroughBase) {
+  cow::ptr<Derived> d = cow::make<Derived>();
+  d.write()->d = 20;
+  cow::ptr<Base> b = d;
+  cow::ptr<Base> shared = b;
+  EXPECT_EQ(b.use_count(), 3);
+
+  // The copy is made through the block's own type, so it keeps the whole
+  // Derived, not just its Base.
+  b.write()->b = 10;
+  EXPECT_NE(b, shared);
+  EXPECT_EQ(b.use_count(), 1);
+  EXPECT_EQ(shared.use_count(), 2);
+  EXPECT_EQ(b.type_info(), typeid(Derived));
+  EXPECT_EQ(b->b, 10);
+  EXPECT_EQ(b.cast<Derived>()->d, 20);
+  EXPECT_EQ(shared->b, 1);
+  EXPECT_EQ(d->d, 20);
+
+  // Unshared, it's written in place.
+  const Base* before = b.get();
+  b.write()->b = 11;
+  EXPECT_EQ(b.get(), before);
+  EXPECT_EQ(b.dynamic<Derived>()->d, 20);
+}
+
+namespace {
+struct pod_base {
+  int a;
+};
+
+struct pod_derived : pod_base {
+  int b;
+};
+}  // namespace
+
+TEST(CowPtr, StaticControlBlock) {
+  static_assert(cow::detail::uses_static_control_block<point2i>);
+  static_assert(!cow::detail::uses_static_control_block<Base>);
+  static_assert(sizeof(cow::detail::control_block_with_object<point2i>) ==
+                sizeof(size_t) + sizeof(point2i));
+
+  // Without a vtable a pod_base block can't clone a pod_derived, so the
+  // upcast isn't allowed.
+  static_assert(!std::is_constructible_v<cow::ptr<pod_base>, cow::ptr<pod_derived>>);
+  static_assert(std::is_constructible_v<cow::ptr<Base>, cow::ptr<Derived>>);
+
+  auto p = cow::make<point2i>(1, 2);
+  EXPECT_EQ(p.type_info(), typeid(point2i));
+  auto q = p;
+  q--->y = 20;
+  EXPECT_NE(p, q);
+  EXPECT_EQ(p->x, 1);
+  EXPECT_EQ(p->y, 2);
+  EXPECT_EQ(q->x, 1);
+  EXPECT_EQ(q->y, 20);
+
+  auto s = cow::make<std::string>("a string too long for the small buffer");
+  auto t = s;
+  *--t += "!";
+  EXPECT_EQ(*s, "a string too long for the small buffer");
+  EXPECT_EQ(*t, "a string too long for the small buffer!");
+}
+
+namespace {
+struct payload {
+  std::string name;
+  std::vector<int> values;
+  static inline int copies = 0;
+
+  payload(std::string n, std::vector<int> v) : name(std::move(n)), values(std::move(v)) {}
+  payload(const payload& other) : name(other.name), values(other.values) { ++copies; }
+  payload(payload&&) = default;
+  payload& operator=(const payload& other) {
+    ++copies;
+    name = other.name;
+    values = other.values;
+    return *this;
+  }
+  payload& operator=(payload&&) = default;
+};
+}
+
+TEST(CowPtr, Update) {
+  auto a = cow::make<payload>("a", std::vector<int>{1, 2, 3});
+  auto b = a;
+  payload::copies = 0;
+
+  // Shared: the new block is built from the result, with no clone.
+  a.update([](const payload& old) { return payload(old.name + "!", {4, 5}); });
+  EXPECT_NE(a, b);
+  EXPECT_EQ(a->name, "a!");
+  EXPECT_EQ(a->values.size(), 2);
+  EXPECT_EQ(b->name, "a");
+  EXPECT_EQ(b->values.size(), 3);
+  EXPECT_EQ(payload::copies, 0);
+
+  // Unique: assigned in place.
+  const payload* before = a.get();
+  a.update([](const payload& old) { return payload(old.name, {6}); });
+  EXPECT_EQ(a.get(), before);
+  EXPECT_EQ(a->values, std::vector<int>{6});
+  EXPECT_EQ(payload::copies, 0);
+}
+
+TEST(CowPtr, UpdateMove) {
+  auto a = cow::make<payload>("a", std::vector<int>(1000, 7));
+  auto append = [](auto&& old) {
+    payload result(std::forward<decltype(old)>(old));
+    result.values.push_back(8);
+    return result;
+  };
+
+  // Unique: the vector is moved through, not copied.
+  payload::copies = 0;
+  a.update_move(append);
+  EXPECT_EQ(a->values.size(), 1001);
+  EXPECT_EQ(payload::copies, 0);
+
+  // Shared: it has to be copied once, into the new block.
+  auto b = a;
+  a.update_move(append);
+  EXPECT_EQ(payload::copies, 1);
+  EXPECT_EQ(a->values.size(), 1002);
+  EXPECT_EQ(b->values.size(), 1001);
+  EXPECT_NE(a->values.data(), b->values.data());
+}
+
+namespace {
+struct hot_config {
+  long values[4];
+};
+}  // namespace
+
+template <>
+inline constexpr bool cow::isolate_refcount<hot_config> = true;
+
+TEST(CowPtr, IsolatedRefcount) {
+  auto line_of = [](const void* address) {
+    return reinterpret_cast<uintptr_t>(address) / cow::detail::cache_line_size;
+  };
+
+  auto a = cow::make<hot_config>(hot_config{{1, 2, 3, 4}});
+  const auto* control = cow::detail::ptr_access::control(a);
+  EXPECT_NE(line_of(&control->refCount), line_of(a.get()));
+  EXPECT_EQ(line_of(a.get()), line_of(&a->values[3]));
+
+  // Clones and biased blocks keep the layout.
+  auto b = a;
+  b.write()->values[0] = 10;
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(b.get()) % cow::detail::cache_line_size, 0u);
+  EXPECT_EQ(a->values[0], 1);
+  auto biased = cow::allocate_make<hot_config>(cow::default_pool(), cow::block_flags::biased, *a);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(biased.get()) % cow::detail::cache_line_size, 0u);
+  EXPECT_EQ(biased->values[3], 4);
+}
@@ -0,0 +1,97 @@
+#include "cow/reclaim.h"
+#include "cow/local.h"
+#include <gtest/gtest.h>
+
+#include <atomic>
+
+namespace {
+std::atomic<int> liveCount{0};
+
+struct node {
+  explicit node(int v, cow::ptr<node> n = nullptr) : value(v), next(std::move(n)) { ++liveCount; }
+  node(const node& other) : value(other.value), next(other.next) { ++liveCount; }
+  ~node() { --liveCount; }
+  int value;
+  cow::ptr<node> next;
+};
+
+cow::ptr<node> chain(int length) {
+  cow::ptr<node> head;
+  for (int i = 0; i < length; ++i) {
+    head = cow::make<node>(i, std::move(head));
+  }
+  return head;
+}
+}  // namespace
+
+TEST(CowReclaim, BudgetedReclaim) {
+  cow::deferred_scope scope;
+  auto head = chain(10);
+  head = nullptr;
+
+  // Only the head is queued; each one destroyed queues the next.
+  EXPECT_EQ(liveCount, 10);
+  EXPECT_EQ(scope.stats().pending_blocks, 1);
+  EXPECT_GE(scope.stats().pending_bytes, sizeof(node));
+
+  EXPECT_EQ(scope.reclaim(4), 4);
+  EXPECT_EQ(liveCount, 6);
+  EXPECT_EQ(scope.stats().pending_blocks, 1);
+  EXPECT_EQ(scope.stats().reclaimed_blocks, 4);
+
+  EXPECT_EQ(scope.reclaim(), 6);
+  EXPECT_EQ(liveCount, 0);
+  EXPECT_EQ(scope.stats().pending_blocks, 0);
+  EXPECT_EQ(scope.stats().pending_bytes, 0);
+}
+
+TEST(CowReclaim, LongChainDoesNotRecurse) {
+  {
+    cow::deferred_scope scope;
+    auto head = chain(1'000'000);
+    head = nullptr;
+  }
+  EXPECT_EQ(liveCount, 0);
+}
+
+TEST(CowReclaim, SharedChildrenSurvive) {
+  cow::deferred_scope scope;
+  auto tail = chain(3);
+  auto head = cow::make<node>(10, tail);
+  head = nullptr;
+  scope.reclaim();
+  EXPECT_EQ(liveCount, 3);
+  EXPECT_EQ(tail.use_count(), 1);
+}
+
+TEST(CowReclaim, Background) {
+  cow::reclaimer background;
+  {
+    cow::deferred_scope scope(background);
+    for (int i = 0; i < 1000; ++i) {
+      auto head = chain(10);
+    }
+    EXPECT_LT(scope.stats().pending_blocks, 256);
+  }
+  background.flush();
+  EXPECT_EQ(liveCount, 0);
+  EXPECT_EQ(background.stats().pending_blocks, 0);
+  EXPECT_EQ(background.stats().pending_bytes, 0);
+  EXPECT_EQ(background.stats().reclaimed_blocks, 10'000);
+}
+
+TEST(CowReclaim, LocalBlocksStayOnThread) {
+  cow::reclaimer background;
+  cow::local_scope local;
+  {
+    cow::deferred_scope scope(background);
+    auto head = chain(100);
+    EXPECT_EQ(local.size(), 100);
+    head = nullptr;
+    scope.hand_off();
+    EXPECT_EQ(scope.stats().pending_blocks, 1);
+  }
+  EXPECT_EQ(liveCount, 0);
+  EXPECT_EQ(local.size(), 0);
+  EXPECT_EQ(background.stats().reclaimed_blocks, 0);
+}
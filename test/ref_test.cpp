@@ -0,0 +1,102 @@
+#include "cow/ref.h"
+#include "cow/spot.h"
+#include <gtest/gtest.h>
+
+#include <type_traits>
+#include <vector>
+
+namespace {
+struct tree {
+  int value{0};
+  cow::ptr<tree> left;
+  cow::ptr<tree> right;
+};
+
+cow::ptr<tree> build(int depth, int& next) {
+  if (depth == 0) {
+    return nullptr;
+  }
+  auto result = cow::make<tree>();
+  result.write()->left = build(depth - 1, next);
+  result.write()->value = next++;
+  result.write()->right = build(depth - 1, next);
+  return result;
+}
+
+// Read-only helpers take refs, so walking the tree takes no references.
+long total(cow::ref<tree> t) {
+  return t ? t->value + total(t->left) + total(t->right) : 0;
+}
+
+void collect(cow::ref<tree> t, std::vector<cow::ref<tree>>& into) {
+  if (t) {
+    collect(t->left, into);
+    into.push_back(t);
+    collect(t->right, into);
+  }
+}
+
+struct Base {
+  virtual ~Base() = default;
+  int b{1};
+};
+
+struct Derived : public Base {
+  int d{2};
+};
+}  // namespace
+
+TEST(CowRef, BorrowsWithoutCounting) {
+  int next = 0;
+  const cow::ptr<tree> root = build(8, next);
+  EXPECT_EQ(total(root), long(next) * (next - 1) / 2);
+
+  std::vector<cow::ref<tree>> nodes;
+  collect(root, nodes);
+  ASSERT_EQ(nodes.size(), size_t(next));
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    EXPECT_EQ(nodes[i]->value, int(i));
+    EXPECT_EQ(nodes[i].use_count(), 1u);
+  }
+
+  // Owning one takes a single reference, which outlives the tree.
+  cow::ptr<tree> kept = nodes[5].own();
+  EXPECT_EQ(kept, nodes[5]);
+  EXPECT_EQ(nodes[5].use_count(), 2u);
+  cow::ref<tree> none;
+  EXPECT_EQ(none, nullptr);
+  EXPECT_FALSE(none.own());
+}
+
+TEST(CowRef, Conversions) {
+  cow::ptr<Derived> derived = cow::make<Derived>();
+  cow::ref<Derived> d = derived;
+  cow::ref<Base> b = d;
+  cow::ref<Base> fromPtr = derived;
+  EXPECT_EQ(b, fromPtr);
+  EXPECT_EQ(b->b, 1);
+  cow::ptr<Base> owned = b.own();
+  EXPECT_EQ(owned, derived);
+  EXPECT_EQ(derived.use_count(), 2u);
+}
+
+// A ref can't be made from a ptr that's about to go away.
+static_assert(std::is_constructible_v<cow::ref<tree>, const cow::ptr<tree>&>);
+static_assert(!std::is_constructible_v<cow::ref<tree>, cow::ptr<tree>&&>);
+static_assert(!std::is_convertible_v<cow::ptr<tree>, cow::ref<tree>>);
+static_assert(std::is_constructible_v<cow::ref<Base>, const cow::ptr<Derived>&>);
+static_assert(!std::is_constructible_v<cow::ref<Base>, cow::ptr<Derived>&&>);
+static_assert(!std::is_convertible_v<cow::ptr<Derived>, cow::ref<Base>>);
+
+TEST(CowRef, FromSpot) {
+  int next = 0;
+  cow::ptr<tree> root = build(4, next);
+  cow::root_spot<tree> top(&root);
+  auto left = top.step(&top->left);
+  EXPECT_EQ(left.borrow(), root->left);
+  EXPECT_EQ(total(left.borrow()), total(root->left));
+
+  left--->value = -100;
+  EXPECT_EQ(left.borrow()->value, -100);
+  EXPECT_EQ(left.borrow(), root->left);
+}
@@ -0,0 +1,121 @@
+#include "cow/rope.h"
+#include <gtest/gtest.h>
+
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace {
+std::string pattern(size_t size, char first = 'a') {
+  std::string result(size, ' ');
+  for (size_t i = 0; i < size; ++i) {
+    result[i] = char(first + i % 26);
+  }
+  return result;
+}
+
+size_t chunk_count(const cow::rope& r) {
+  size_t count = 0;
+  r.for_each_chunk([&](std::string_view) { ++count; });
+  return count;
+}
+}  // namespace
+
+TEST(CowRope, MatchesString) {
+  cow::rope r(pattern(10000));
+  std::string expected = pattern(10000);
+  std::vector<std::pair<cow::rope, std::string>> snapshots;
+
+  std::mt19937 random(7);
+  for (int i = 0; i < 3000; ++i) {
+    const size_t at = random() % (expected.size() + 1);
+    switch (random() % 3) {
+      case 0: {
+        const std::string bytes = pattern(random() % 40 + 1, 'A');
+        r.insert(at, bytes);
+        expected.insert(at, bytes);
+        break;
+      }
+      case 1: {
+        const size_t count = std::min<size_t>(random() % 60, expected.size() - at);
+        r.erase(at, count);
+        expected.erase(at, count);
+        break;
+      }
+      case 2: {
+        const std::string bytes = pattern(random() % 3000 + 1, '0');
+        r.append(bytes);
+        expected.append(bytes);
+        break;
+      }
+    }
+    ASSERT_EQ(r.size(), expected.size());
+    if (i % 300 == 0) {
+      snapshots.emplace_back(r, expected);
+    }
+  }
+  EXPECT_EQ(r.str(), expected);
+  for (size_t i = 0; i < expected.size(); i += 97) {
+    ASSERT_EQ(r[i], expected[i]);
+  }
+
+  // Earlier copies never see later edits.
+  for (const auto& [snapshot, then] : snapshots) {
+    EXPECT_EQ(snapshot.str(), then);
+  }
+}
+
+TEST(CowRope, EditsShareUnchangedChunks) {
+  const cow::rope original(pattern(1 << 20));
+  cow::rope edited = original;
+  edited.insert(500000, "x");
+  edited.erase(10, 1);
+
+  EXPECT_EQ(original.str(), pattern(1 << 20));
+  std::string expected = pattern(1 << 20);
+  expected.insert(500000, "x");
+  expected.erase(10, 1);
+  EXPECT_EQ(edited.str(), expected);
+
+  std::set<const char*> before;
+  original.for_each_chunk([&](std::string_view bytes) { before.insert(bytes.data()); });
+  size_t shared = 0;
+  size_t total = 0;
+  edited.for_each_chunk([&](std::string_view bytes) {
+    shared += before.count(bytes.data());
+    ++total;
+  });
+  EXPECT_GE(shared + 4, total);
+}
+
+TEST(CowRope, SliceAndAppendRope) {
+  const std::string text = pattern(50000);
+  const cow::rope r(text);
+
+  cow::rope middle = r.slice(12345, 20000);
+  EXPECT_EQ(middle.str(), text.substr(12345, 20000));
+  EXPECT_EQ(r.slice(49990, 100).str(), text.substr(49990));
+  EXPECT_TRUE(r.slice(100, 0).empty());
+
+  cow::rope joined = r.slice(0, 100);
+  joined.append(middle);
+  joined.insert(50, r.slice(40000, 10));
+  EXPECT_EQ(joined.str(), text.substr(0, 50) + text.substr(40000, 10) +
+                              text.substr(50, 50) + text.substr(12345, 20000));
+
+  joined.erase(0, joined.size());
+  EXPECT_TRUE(joined.empty());
+  EXPECT_EQ(r.size(), 50000u);
+}
+
+TEST(CowRope, SmallAppendsFillChunks) {
+  cow::rope r;
+  std::string expected;
+  for (int i = 0; i < 10000; ++i) {
+    r.append("abc");
+    expected.append("abc");
+  }
+  EXPECT_EQ(r.str(), expected);
+  EXPECT_LE(chunk_count(r), 2 * (expected.size() / cow::rope_chunk_size + 1));
+}
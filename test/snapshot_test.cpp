@@ -0,0 +1,109 @@
+#include "cow/snapshot.h"
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <string>
+#include <system_error>
+
+namespace {
+struct tree {
+  int value{0};
+  cow::ptr<tree> left;
+  cow::ptr<tree> right;
+};
+
+template <typename Func>
+void cow_for_each_child(const tree& node, Func&& func) {
+  func(node.left);
+  func(node.right);
+}
+
+struct leaf {
+  int value{0};
+};
+
+template <typename Func>
+void cow_for_each_child(const leaf&, Func&&) {}
+
+cow::ptr<tree> node(int value, cow::ptr<tree> left = nullptr, cow::ptr<tree> right = nullptr) {
+  return cow::make<tree>(tree{value, std::move(left), std::move(right)});
+}
+
+long total(const cow::ptr<tree>& t) {
+  return t ? t->value + total(t->left) + total(t->right) : 0;
+}
+
+std::string temp_path(const char* name) {
+  return (std::filesystem::temp_directory_path() / name).string();
+}
+}  // namespace
+
+TEST(CowSnapshot, KeepsSharedNodesShared) {
+  const std::string path = temp_path("cow_snapshot_shared.cow");
+  const cow::ptr<tree> shared = node(3, node(1), node(2));
+  const cow::ptr<tree> roots[] = {node(10, shared, shared), node(20, shared), nullptr};
+  cow::save_snapshot(path, std::span<const cow::ptr<tree>>(roots));
+
+  {
+    cow::snapshot<tree> saved(path);
+    ASSERT_EQ(saved.roots().size(), 3u);
+    EXPECT_EQ(saved.node_count(), 5u);
+    EXPECT_EQ(total(saved.root(0)), 22);
+    EXPECT_EQ(total(saved.root(1)), 26);
+    EXPECT_EQ(saved.root(2), nullptr);
+    EXPECT_EQ(saved.root(0)->left, saved.root(0)->right);
+    EXPECT_EQ(saved.root(0)->left, saved.root(1)->left);
+    EXPECT_NE(saved.root(0)->left, shared);
+
+    // Copies and edits leave the mapped nodes alone. Edited copies are on
+    // the heap, sharing what they didn't change with the file.
+    cow::ptr<tree> edited = saved.root(0);
+    edited.write()->value = 100;
+    edited.write()->left.write()->value = 30;
+    EXPECT_EQ(total(edited), 100 + 33 + 6);
+    EXPECT_EQ(edited->right, saved.root(0)->right);
+    EXPECT_EQ(edited->left->left, saved.root(0)->left->left);
+    EXPECT_EQ(total(saved.root(0)), 22);
+    EXPECT_EQ(saved.root(0).use_count(), 1u);
+    EXPECT_EQ(edited.use_count(), 1u);
+
+    // An edited tree saves like any other.
+    cow::save_snapshot(path, edited);
+  }
+  cow::snapshot<tree> resaved(path);
+  EXPECT_EQ(resaved.node_count(), 5u);
+  EXPECT_EQ(total(resaved.root()), 100 + 33 + 6);
+  std::filesystem::remove(path);
+}
+
+TEST(CowSnapshot, Relocates) {
+  const std::string path = temp_path("cow_snapshot_relocates.cow");
+  cow::ptr<tree> root;
+  for (int i = 1; i <= 1000; ++i) {
+    root = node(i, root, i % 3 ? node(-i) : nullptr);
+  }
+  cow::save_snapshot(path, root);
+
+  // Only one mapping can have the address the file was written for.
+  cow::snapshot<tree> first(path);
+  cow::snapshot<tree> second(path);
+  EXPECT_TRUE(second.relocated());
+  EXPECT_NE(first.root(), second.root());
+  EXPECT_EQ(total(first.root()), total(root));
+  EXPECT_EQ(total(second.root()), total(root));
+
+  cow::snapshot<tree> moved = std::move(second);
+  EXPECT_EQ(total(moved.root()), total(root));
+  std::filesystem::remove(path);
+}
+
+TEST(CowSnapshot, RejectsOtherFiles) {
+  const std::string path = temp_path("cow_snapshot_rejects.cow");
+  EXPECT_THROW(cow::snapshot<tree>(temp_path("cow_snapshot_missing.cow")), std::system_error);
+
+  cow::save_snapshot(path, cow::make<leaf>(leaf{7}));
+  EXPECT_THROW(cow::snapshot<tree>{path}, std::runtime_error);
+  cow::snapshot<leaf> leaves(path);
+  EXPECT_EQ(leaves.root()->value, 7);
+  std::filesystem::remove(path);
+}
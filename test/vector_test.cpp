@@ -0,0 +1,147 @@
+#include "cow/vector.h"
+#include <gtest/gtest.h>
+
+#include <numeric>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace {
+template <typename T>
+void expect_same(const cow::vector<T>& actual, const std::vector<T>& expected) {
+  ASSERT_EQ(actual.size(), expected.size());
+  for (size_t i = 0; i < expected.size(); ++i) {
+    ASSERT_EQ(actual[i], expected[i]) << "at " << i;
+  }
+  size_t i = 0;
+  for (const T& value : actual) {
+    ASSERT_EQ(value, expected[i++]);
+  }
+  EXPECT_EQ(i, expected.size());
+}
+}  // namespace
+
+// Nodes get the static control block, with no vtable to pay for.
+static_assert(!std::is_polymorphic_v<cow::detail::vector_branch<std::string>>);
+static_assert(!std::is_polymorphic_v<cow::detail::vector_chunk<std::string>>);
+
+TEST(CowVector, PushBackAcrossLevels) {
+  cow::vector<int> v;
+  std::vector<int> expected;
+  std::vector<cow::vector<int>> snapshots;
+  for (int i = 0; i < 40000; ++i) {
+    v.push_back(i);
+    expected.push_back(i);
+    if (i % 997 == 0) {
+      snapshots.push_back(v);
+    }
+  }
+  expect_same(v, expected);
+  EXPECT_EQ(v.front(), 0);
+  EXPECT_EQ(v.back(), 39999);
+
+  // Earlier copies never see later pushes.
+  for (size_t s = 0; s < snapshots.size(); ++s) {
+    ASSERT_EQ(snapshots[s].size(), s * 997 + 1);
+    EXPECT_EQ(snapshots[s].back(), int(s * 997));
+  }
+}
+
+TEST(CowVector, SetLeavesCopiesAlone) {
+  auto a = cow::vector<int>::from_range(std::vector<int>(5000, 1));
+  auto b = a;
+
+  b.set(0, 10);
+  b.set(1234, 20);
+  b.set(4999, 30);
+  b.write(1235) += 5;
+  EXPECT_EQ(b[0], 10);
+  EXPECT_EQ(b[1234], 20);
+  EXPECT_EQ(b[1235], 6);
+  EXPECT_EQ(b[4999], 30);
+  EXPECT_EQ(b[2000], 1);
+
+  std::vector<int> ones(5000, 1);
+  expect_same(a, ones);
+
+  // Unique now, so writing again changes b in place.
+  const int* before = &b[1234];
+  b.set(1234, 21);
+  EXPECT_EQ(&b[1234], before);
+  EXPECT_EQ(b[1234], 21);
+}
+
+TEST(CowVector, PopBackShrinksTrie) {
+  cow::vector<std::string> v;
+  std::vector<std::string> expected;
+  for (int i = 0; i < 33 * 32 + 5; ++i) {
+    v.push_back(std::to_string(i));
+    expected.push_back(std::to_string(i));
+  }
+  auto kept = v;
+
+  while (!expected.empty()) {
+    v.pop_back();
+    expected.pop_back();
+    if (expected.size() % 31 == 0 || expected.size() < 40) {
+      expect_same(v, expected);
+    }
+  }
+  EXPECT_TRUE(v.empty());
+  EXPECT_EQ(kept.size(), 33u * 32 + 5);
+  EXPECT_EQ(kept.back(), std::to_string(33 * 32 + 4));
+
+  // Grows again after emptying.
+  v.push_back("again");
+  EXPECT_EQ(v.size(), 1u);
+  EXPECT_EQ(v[0], "again");
+}
+
+TEST(CowVector, FromRangeMatchesPushBack) {
+  for (size_t n : {0u, 1u, 31u, 32u, 33u, 1024u, 1056u, 1057u, 33000u}) {
+    std::vector<int> expected(n);
+    std::iota(expected.begin(), expected.end(), 0);
+    auto v = cow::vector<int>::from_range(expected);
+    expect_same(v, expected);
+
+    // And it can carry on as if it had been pushed.
+    for (int i = 0; i < 40; ++i) {
+      v.push_back(-i);
+      expected.push_back(-i);
+    }
+    for (int i = 0; i < 70 && !expected.empty(); ++i) {
+      v.pop_back();
+      expected.pop_back();
+    }
+    expect_same(v, expected);
+  }
+
+  cow::vector<std::string> words{"a", "b", "c"};
+  EXPECT_EQ(words.size(), 3u);
+  EXPECT_EQ(words[2], "c");
+}
+
+TEST(CowVector, ChunkIteration) {
+  std::vector<int> expected(2000);
+  std::iota(expected.begin(), expected.end(), 0);
+  auto v = cow::vector<int>::from_range(expected);
+
+  size_t chunks = 0;
+  size_t seen = 0;
+  long long sum = 0;
+  v.for_each_chunk([&](const int* data, size_t count) {
+    ++chunks;
+    for (size_t i = 0; i < count; ++i) {
+      EXPECT_EQ(data[i], int(seen + i));
+      sum += data[i];
+    }
+    seen += count;
+  });
+  EXPECT_EQ(chunks, (2000u + 31) / 32);
+  EXPECT_EQ(seen, 2000u);
+  EXPECT_EQ(sum, std::accumulate(expected.begin(), expected.end(), 0LL));
+
+  EXPECT_EQ(std::accumulate(v.begin(), v.end(), 0LL), sum);
+  cow::vector<int> none;
+  EXPECT_TRUE(none.begin() == none.end());
+}